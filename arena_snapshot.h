@@ -0,0 +1,327 @@
+/*
+Relocatable arena: everything inside points with offset_ptr (distance from the pointer itself to its target), so the
+bytes mean the same thing at any address. A table built once can be written to a file as is and mapped read-only on
+the next start: no parsing, no pointer fixing, pages are read in on first touch and the page cache shares them
+between every process mapping the same file.
+
+  relocatable_arena arena(size_t(1) << 30);          // reserves address space, pages are committed on use
+  table* root = arena.create<table>();
+  root->entries = arena.create_array<entry>(count);  // offset_array, assigning raw pointers to offset_ptr is fine
+  arena.save("table.arena", root);
+
+  arena_snapshot snapshot;
+  if (snapshot.open("table.arena")) { const table* t = snapshot.root<table>(); ... }
+
+What goes in the arena has to be trivially destructible (the mapping is dropped, nothing is destroyed) and point only
+through offset_ptr / offset_array, never raw pointers: the bytes are saved and mapped back as they are. offset_ptr
+isn't trivially copyable (a copy recomputes the offset from its own address), so neither are the types holding one.
+The file starts with a header (magic, format version, size, root offset and the size of the root type) that open()
+checks; the layout of the types themselves isn't versioned, bump the version passed to save() / open() when it
+changes. The file is native endian.
+
+The arena reserves its capacity up front (mmap, no swap reservation), so allocations never move and the usual raw
+pointers can be used while building. It satisfies the Allocator concept of memory_allocators.h.
+
+posix only (mmap).
+*/
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+///Self relative pointer: stores target - this, 0 is null (nothing points at itself)
+template<typename T>
+class offset_ptr
+{
+public:
+    offset_ptr() = default;
+    offset_ptr(std::nullptr_t) {}
+    offset_ptr(T* target) { set(target); }
+    offset_ptr(const offset_ptr& other) { set(other.get()); }
+    offset_ptr& operator=(const offset_ptr& other)
+    {
+        set(other.get());
+        return *this;
+    }
+    offset_ptr& operator=(T* target)
+    {
+        set(target);
+        return *this;
+    }
+
+    T* get() const
+    {
+        return m_offset == 0 ? nullptr : reinterpret_cast<T*>(const_cast<char*>(reinterpret_cast<const char*>(this)) + m_offset);
+    }
+    T* operator->() const { return get(); }
+    T& operator*() const { return *get(); }
+    T& operator[](size_t i) const { return get()[i]; }
+    explicit operator bool() const { return m_offset != 0; }
+
+private:
+    void set(T* target)
+    {
+        m_offset = target == nullptr ? 0 : reinterpret_cast<const char*>(target) - reinterpret_cast<const char*>(this);
+    }
+
+    std::ptrdiff_t m_offset = 0;
+};
+
+///Array whose elements live in the same arena
+template<typename T>
+struct offset_array
+{
+    offset_ptr<T> data;
+    uint64_t count = 0;
+
+    size_t size() const { return static_cast<size_t>(count); }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return data[i]; }
+    T* begin() const { return data.get(); }
+    T* end() const { return data.get() + count; }
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct arena_file_header
+{
+    static constexpr uint64_t k_magic = 0x414e455241434c52ull; // "RLCARENA"
+
+    uint64_t magic = k_magic;
+    uint32_t version = 0;
+    uint32_t rootSize = 0;
+    uint64_t bytes = 0; // header included
+    uint64_t rootOffset = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Bump allocator over a reserved range that can be saved and mapped back (see arena_snapshot)
+class relocatable_arena
+{
+public:
+    static constexpr size_t alignment = 16;
+    static constexpr size_t k_headerBytes = (sizeof(detail::arena_file_header) + alignment - 1) / alignment * alignment;
+
+public:
+    ///Reserves capacity bytes of address space, nothing is committed before it's used
+    explicit relocatable_arena(size_t capacity)
+        : m_capacity(std::max(capacity, k_headerBytes))
+    {
+        void* mapping = mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            std::cerr << "relocatable_arena mmap failed: " << std::strerror(errno) << std::endl;
+            m_capacity = 0;
+            return;
+        }
+        m_base = static_cast<char*>(mapping);
+        m_used = k_headerBytes;
+    }
+    ~relocatable_arena()
+    {
+        if (m_base != nullptr)
+        {
+            munmap(m_base, m_capacity);
+        }
+    }
+    relocatable_arena(const relocatable_arena&) = delete;
+    relocatable_arena& operator=(const relocatable_arena&) = delete;
+
+    ///@return nullptr when the reserved range is full
+    char* allocate(size_t n)
+    {
+        const size_t alignedSize = (n + alignment - 1) / alignment * alignment;
+        if (m_base == nullptr || alignedSize > m_capacity - m_used)
+        {
+            return nullptr;
+        }
+        char* alloc = m_base + m_used;
+        m_used += alignedSize;
+        return alloc;
+    }
+    ///Only the last allocation is given back
+    void deallocate(char* p, size_t n)
+    {
+        const size_t alignedSize = (n + alignment - 1) / alignment * alignment;
+        if (p + alignedSize == m_base + m_used)
+        {
+            m_used -= alignedSize;
+        }
+    }
+    bool owns(const char* p) const { return m_base != nullptr && m_base <= p && p < m_base + m_capacity; }
+    void deallocate_all() { m_used = k_headerBytes; }
+
+    ///Value initialized T (or built from args), nullptr when full
+    template<typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "arena contents are unmapped, never destroyed");
+        static_assert(!std::is_pointer_v<T>, "raw pointers don't survive the reload, use offset_ptr");
+        static_assert(alignof(T) <= alignment);
+        char* memory = allocate(sizeof(T));
+        return memory == nullptr ? nullptr : new (memory) T(std::forward<Args>(args)...);
+    }
+    ///count value initialized T, empty when full
+    template<typename T>
+    offset_array<T> create_array(size_t count)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "arena contents are unmapped, never destroyed");
+        static_assert(!std::is_pointer_v<T>, "raw pointers don't survive the reload, use offset_ptr");
+        static_assert(alignof(T) <= alignment);
+        offset_array<T> array;
+        char* memory = allocate(count * sizeof(T));
+        if (memory != nullptr)
+        {
+            array.data = new (memory) T[count]();
+            array.count = count;
+        }
+        return array;
+    }
+
+    char* base() const { return m_base; }
+    ///Bytes that save() writes
+    size_t used() const { return m_used; }
+    size_t capacity() const { return m_capacity; }
+
+    ///Writes the used bytes, root has to be in the arena
+    ///@return false on I/O errors
+    template<typename Root>
+    bool save(const std::string& path, const Root* root, uint32_t version = 1) const
+    {
+        if (!owns(reinterpret_cast<const char*>(root)))
+        {
+            std::cerr << "relocatable_arena::save: the root isn't in the arena" << std::endl;
+            return false;
+        }
+        detail::arena_file_header header;
+        header.version = version;
+        header.rootSize = sizeof(Root);
+        header.bytes = m_used;
+        header.rootOffset = reinterpret_cast<const char*>(root) - m_base;
+        std::memcpy(m_base, &header, sizeof(header));
+
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            std::cerr << "cannot create " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        size_t written = 0;
+        while (written < m_used)
+        {
+            const ssize_t count = ::write(fd, m_base + written, m_used - written);
+            if (count <= 0)
+            {
+                std::cerr << "write to " << path << " failed: " << std::strerror(errno) << std::endl;
+                ::close(fd);
+                return false;
+            }
+            written += static_cast<size_t>(count);
+        }
+        return ::close(fd) == 0;
+    }
+
+private:
+    char* m_base = nullptr;
+    size_t m_capacity = 0;
+    size_t m_used = 0;
+};
+
+///Read-only mapping of a file written by relocatable_arena::save
+class arena_snapshot
+{
+public:
+    arena_snapshot() = default;
+    ~arena_snapshot()
+    {
+        close();
+    }
+    arena_snapshot(const arena_snapshot&) = delete;
+    arena_snapshot& operator=(const arena_snapshot&) = delete;
+
+    ///Maps path, populate reads every page in now instead of on first touch
+    ///@return false if the file can't be mapped or isn't a snapshot of this version
+    bool open(const std::string& path, uint32_t version = 1, bool populate = false)
+    {
+        close();
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "cannot open " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || size_t(fileStat.st_size) < sizeof(detail::arena_file_header))
+        {
+            std::cerr << path << " is not an arena snapshot" << std::endl;
+            ::close(fd);
+            return false;
+        }
+        const size_t bytes = static_cast<size_t>(fileStat.st_size);
+        void* mapping = mmap(nullptr, bytes, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            std::cerr << "mmap of " << path << " failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        m_base = static_cast<const char*>(mapping);
+        m_bytes = bytes;
+
+        std::memcpy(&m_header, m_base, sizeof(m_header));
+        if (m_header.magic != detail::arena_file_header::k_magic || m_header.version != version || m_header.bytes != bytes
+            || m_header.rootOffset < relocatable_arena::k_headerBytes || m_header.rootOffset > bytes
+            || m_header.rootSize > bytes - m_header.rootOffset)
+        {
+            std::cerr << path << ": bad snapshot header (version " << m_header.version << ", expected " << version << ")" << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (m_base != nullptr)
+        {
+            munmap(const_cast<char*>(m_base), m_bytes);
+            m_base = nullptr;
+            m_bytes = 0;
+        }
+    }
+
+    ///@return nullptr if nothing is mapped or the root saved wasn't a Root
+    template<typename Root>
+    const Root* root() const
+    {
+        if (m_base == nullptr || m_header.rootSize != sizeof(Root))
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<const Root*>(m_base + m_header.rootOffset);
+    }
+
+    size_t size() const { return m_bytes; }
+
+private:
+    const char* m_base = nullptr;
+    size_t m_bytes = 0;
+    detail::arena_file_header m_header;
+};
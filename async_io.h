@@ -0,0 +1,522 @@
+/*
+File I/O awaitables on a single threaded event loop, io_uring when the kernel allows it, otherwise pread/pwrite on a
+small work_stealing_pool. Coroutines always resume on the thread calling io_loop::run.
+
+  coro::io_loop loop;
+  coro::task<size_t> copy(coro::io_loop& loop, int in, int out, char* buffer)
+  {
+      const ssize_t n = co_await loop.read(in, buffer, 4096, 0);
+      co_return n > 0 ? co_await loop.write(out, buffer, n, 0) : 0;
+  }
+  loop.run(copy(loop, in, out, buffer));
+
+Operations are eager: they're queued when created and submitted in one batch (a single io_uring_enter) the next
+time the loop polls, so a coroutine can keep several reads in flight and await them in order:
+
+  std::optional<coro::io_operation> next;
+  next.emplace(loop, coro::io_operation::kind::read, fd, buffer, size, offset);
+  ...
+  const ssize_t bytes = co_await *next;
+
+An io_operation can't be moved and has to be awaited (or at least completed) before it's destroyed. Buffers passed
+to register_buffers are pinned by the kernel, reads into them by index skip the per request page mapping.
+
+Like pread/pwrite, one operation transfers at most io_operation::k_maxTransfer bytes (the kernel's MAX_RW_COUNT), a
+bigger request completes short on both backends and the caller continues from the returned count.
+
+Linux only, raw syscalls (no liburing dependency).
+*/
+#pragma once
+
+#include "task.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace coro
+{
+
+class io_loop;
+
+///One read or write, queued on construction, awaiting it returns the transferred bytes or -errno
+class io_operation : public pool_task
+{
+public:
+    enum class kind { read, write };
+
+    ///Linux MAX_RW_COUNT, also keeps the size within the 32-bit length of an io_uring submission
+    static constexpr size_t k_maxTransfer = 0x7ffff000;
+
+    ///@param fixedBuffer index in the buffers registered with io_loop::register_buffers, -1 for any buffer
+    io_operation(io_loop& loop, kind operation, int fd, void* buffer, size_t size, uint64_t offset, int fixedBuffer = -1);
+    io_operation(const io_operation&) = delete;
+    io_operation& operator=(const io_operation&) = delete;
+    ~io_operation()
+    {
+        assert(m_isDone && "destroyed while in flight, the kernel would write into freed memory");
+    }
+
+    bool is_done() const { return m_isDone; }
+
+    ///Separate awaiter: gcc 12 copies an lvalue awaitable that is its own awaiter
+    auto operator co_await() noexcept
+    {
+        struct awaiter
+        {
+            io_operation& m_operation;
+
+            bool await_ready() const noexcept { return m_operation.m_isDone; }
+            void await_suspend(std::coroutine_handle<> handle) noexcept { m_operation.m_waiter = handle; }
+            ssize_t await_resume() const noexcept { return m_operation.m_result; }
+        };
+        return awaiter{*this};
+    }
+
+    ///thread pool backend
+    void execute() override;
+
+private:
+    friend class io_loop;
+
+    void complete(ssize_t result)
+    {
+        m_result = result;
+        m_isDone = true;
+        if (m_waiter)
+        {
+            m_waiter.resume();
+        }
+    }
+
+    io_loop& m_loop;
+    kind m_kind;
+    int m_fd;
+    void* m_buffer;
+    size_t m_size;
+    uint64_t m_offset;
+    int m_fixedBuffer;
+
+    io_operation* m_next = nullptr; // intrusive queues of the loop
+    ssize_t m_result = 0;
+    bool m_isDone = false;
+    std::coroutine_handle<> m_waiter;
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Runs the task given to io_loop::run, done() once the task completed
+class io_driver
+{
+public:
+    struct promise_type : promise_allocation
+    {
+        io_driver get_return_object() noexcept { return io_driver(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); } // the awaited task keeps its own exceptions
+    };
+
+    explicit io_driver(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {}
+    io_driver(const io_driver&) = delete;
+    io_driver& operator=(const io_driver&) = delete;
+    ~io_driver() { m_handle.destroy(); }
+
+    void start() { m_handle.resume(); }
+    bool is_done() const { return m_handle.done(); }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template<typename Task>
+io_driver make_io_driver(Task& awaited)
+{
+    co_await awaited.when_ready();
+}
+
+///Intrusive FIFO of io_operation
+class io_queue
+{
+public:
+    bool empty() const { return m_head == nullptr; }
+    void push(io_operation* operation, io_operation*& next)
+    {
+        next = nullptr;
+        if (m_tail != nullptr)
+        {
+            *m_tailNext = operation;
+        }
+        else
+        {
+            m_head = operation;
+        }
+        m_tail = operation;
+        m_tailNext = &next;
+    }
+    template<typename GetNext>
+    io_operation* pop(GetNext getNext)
+    {
+        io_operation* operation = m_head;
+        m_head = getNext(operation);
+        if (m_head == nullptr)
+        {
+            m_tail = nullptr;
+        }
+        return operation;
+    }
+
+private:
+    io_operation* m_head = nullptr;
+    io_operation* m_tail = nullptr;
+    io_operation** m_tailNext = nullptr;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+class io_loop
+{
+public:
+    enum class backend { automatic, io_uring, thread_pool };
+
+    ///@param queueDepth submission queue entries (io_uring) or threads (thread pool backend)
+    explicit io_loop(unsigned queueDepth = 64, backend requested = backend::automatic)
+    {
+        if (requested != backend::thread_pool && setup_ring(queueDepth))
+        {
+            m_backend = backend::io_uring;
+            return;
+        }
+        if (requested == backend::io_uring)
+        {
+            std::cerr << "io_uring not available, falling back to the thread pool" << std::endl;
+        }
+        m_backend = backend::thread_pool;
+        m_pool.reset(new work_stealing_pool(std::min(queueDepth, 8u)));
+    }
+    ~io_loop()
+    {
+        assert(m_inFlight == 0 && m_pending.empty());
+        m_pool.reset();
+        if (m_ringFd >= 0)
+        {
+            if (m_sqes != nullptr)
+            {
+                munmap(m_sqes, m_sqesSize);
+            }
+            if (m_cqRing != nullptr && m_cqRing != m_sqRing)
+            {
+                munmap(m_cqRing, m_cqRingSize);
+            }
+            if (m_sqRing != nullptr)
+            {
+                munmap(m_sqRing, m_sqRingSize);
+            }
+            close(m_ringFd);
+        }
+    }
+    io_loop(const io_loop&) = delete;
+    io_loop& operator=(const io_loop&) = delete;
+
+    backend active_backend() const { return m_backend; }
+    const char* backend_name() const { return m_backend == backend::io_uring ? "io_uring" : "thread pool"; }
+
+    ///Pins the buffers for the fixed-buffer reads and writes (io_uring), the thread pool backend ignores them
+    bool register_buffers(const std::vector<iovec>& buffers)
+    {
+        if (m_backend != backend::io_uring)
+        {
+            return true;
+        }
+        if (syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) != 0)
+        {
+            std::cerr << "io_uring buffer registration failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    io_operation read(int fd, void* buffer, size_t size, uint64_t offset, int fixedBuffer = -1)
+    {
+        return io_operation(*this, io_operation::kind::read, fd, buffer, size, offset, fixedBuffer);
+    }
+    io_operation write(int fd, const void* buffer, size_t size, uint64_t offset, int fixedBuffer = -1)
+    {
+        return io_operation(*this, io_operation::kind::write, fd, const_cast<void*>(buffer), size, offset, fixedBuffer);
+    }
+
+    ///Runs the task on the calling thread until it completes, pumping the I/O completions
+    template<typename T>
+    T run(task<T>&& root)
+    {
+        detail::io_driver driver = detail::make_io_driver(root);
+        driver.start();
+        while (!driver.is_done())
+        {
+            if (!poll())
+            {// waiting on something else than our I/O
+                std::this_thread::yield();
+            }
+        }
+        return root.result();
+    }
+
+    ///Submits the queued operations and resumes the waiters of the completed ones
+    ///@return false if there was nothing to submit or wait for
+    bool poll()
+    {
+        if (m_pending.empty() && m_inFlight == 0)
+        {
+            return false;
+        }
+        if (m_backend == backend::io_uring)
+        {
+            poll_ring();
+        }
+        else
+        {
+            poll_pool();
+        }
+        return true;
+    }
+
+private:
+    friend class io_operation;
+
+    static io_operation* next_of(io_operation* operation) { return operation->m_next; }
+
+    void enqueue(io_operation* operation)
+    {
+        m_pending.push(operation, operation->m_next);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    bool setup_ring(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_ringFd < 0)
+        {
+            return false;
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool isSingleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (isSingleMapping)
+        {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+
+        void* sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+        m_sqRing = sqRing == MAP_FAILED ? nullptr : static_cast<char*>(sqRing);
+        void* cqRing = isSingleMapping ? sqRing : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+        m_cqRing = cqRing == MAP_FAILED ? nullptr : static_cast<char*>(cqRing);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+        m_sqes = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+        if (m_sqRing == nullptr || m_cqRing == nullptr || m_sqes == nullptr)
+        {
+            std::cerr << "io_uring ring mapping failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        m_sqHead = reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        m_sqArray = reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.array);
+        m_cqHead = reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.ring_mask);
+        m_cqEntries = params.cq_entries;
+        m_cqes = reinterpret_cast<io_uring_cqe*>(m_cqRing + params.cq_off.cqes);
+        return true;
+    }
+
+    void poll_ring()
+    {
+        // fill the submission ring, never more in flight than the completion ring holds
+        unsigned tail = *m_sqTail;
+        const unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        while (!m_pending.empty() && tail - head < m_sqEntries && m_inFlight < m_cqEntries)
+        {
+            io_operation* operation = m_pending.pop(&next_of);
+            const unsigned index = tail & m_sqMask;
+            io_uring_sqe& sqe = m_sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            const bool isFixed = operation->m_fixedBuffer >= 0;
+            if (operation->m_kind == io_operation::kind::read)
+            {
+                sqe.opcode = isFixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            }
+            else
+            {
+                sqe.opcode = isFixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            }
+            sqe.fd = operation->m_fd;
+            sqe.addr = reinterpret_cast<uint64_t>(operation->m_buffer);
+            sqe.len = static_cast<uint32_t>(std::min(operation->m_size, io_operation::k_maxTransfer));
+            sqe.off = operation->m_offset;
+            sqe.buf_index = static_cast<uint16_t>(isFixed ? operation->m_fixedBuffer : 0);
+            sqe.user_data = reinterpret_cast<uint64_t>(operation);
+            m_sqArray[index] = index;
+            ++tail;
+            ++m_inFlight;
+        }
+        __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+
+        // everything the kernel hasn't consumed yet: entries left over by an interrupted or partial enter included
+        const unsigned unsubmitted = tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        const bool hasCompletions = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) != *m_cqHead;
+        const unsigned waitCount = hasCompletions || m_inFlight == 0 ? 0 : 1;
+        if (unsubmitted > 0 || waitCount > 0)
+        {
+            const long submitted = syscall(__NR_io_uring_enter, m_ringFd, unsubmitted, waitCount, waitCount > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {// not transient: take back what the kernel didn't consume and fail it
+                const int error = errno;
+                std::cerr << "io_uring_enter failed: " << std::strerror(error) << std::endl;
+                fail_unsubmitted(error);
+            }
+        }
+
+        // resuming may queue new operations, they go out with the next poll
+        unsigned cqHead = *m_cqHead;
+        while (cqHead != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe& cqe = m_cqes[cqHead & m_cqMask];
+            io_operation* operation = reinterpret_cast<io_operation*>(cqe.user_data);
+            const ssize_t result = cqe.res;
+            ++cqHead;
+            __atomic_store_n(m_cqHead, cqHead, __ATOMIC_RELEASE);
+            --m_inFlight;
+            operation->complete(result);
+        }
+    }
+
+    // without SQPOLL the kernel only reads the submission ring inside io_uring_enter, the tail can be moved back
+    void fail_unsubmitted(int error)
+    {
+        const unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        const unsigned tail = *m_sqTail;
+        __atomic_store_n(m_sqTail, head, __ATOMIC_RELEASE);
+        for (unsigned i = head; i != tail; ++i)
+        {
+            io_operation* operation = reinterpret_cast<io_operation*>(m_sqes[m_sqArray[i & m_sqMask]].user_data);
+            --m_inFlight;
+            operation->complete(-error);
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void poll_pool()
+    {
+        while (!m_pending.empty())
+        {
+            ++m_inFlight;
+            m_pool->submit(m_pending.pop(&next_of));
+        }
+
+        detail::io_queue completed;
+        {
+            std::unique_lock<std::mutex> lock(m_completedMutex);
+            m_completedCondition.wait(lock, [this]() { return !m_completed.empty(); });
+            std::swap(completed, m_completed);
+        }
+        while (!completed.empty())
+        {
+            io_operation* operation = completed.pop(&next_of);
+            --m_inFlight;
+            operation->complete(operation->m_result);
+        }
+    }
+
+    void complete_from_worker(io_operation* operation)
+    {
+        std::lock_guard<std::mutex> lock(m_completedMutex);
+        m_completed.push(operation, operation->m_next);
+        m_completedCondition.notify_one();
+    }
+
+    backend m_backend = backend::thread_pool;
+    detail::io_queue m_pending;
+    unsigned m_inFlight = 0;
+
+    // io_uring
+    int m_ringFd = -1;
+    char* m_sqRing = nullptr;
+    char* m_cqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+    unsigned m_cqMask = 0;
+    unsigned m_cqEntries = 0;
+
+    // thread pool
+    std::unique_ptr<work_stealing_pool> m_pool;
+    std::mutex m_completedMutex;
+    std::condition_variable m_completedCondition;
+    detail::io_queue m_completed;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline io_operation::io_operation(io_loop& loop, kind operation, int fd, void* buffer, size_t size, uint64_t offset, int fixedBuffer)
+    : m_loop(loop)
+    , m_kind(operation)
+    , m_fd(fd)
+    , m_buffer(buffer)
+    , m_size(size)
+    , m_offset(offset)
+    , m_fixedBuffer(fixedBuffer)
+{
+    loop.enqueue(this);
+}
+
+inline void io_operation::execute()
+{
+    const ssize_t result = m_kind == kind::read
+        ? pread(m_fd, m_buffer, std::min(m_size, k_maxTransfer), static_cast<off_t>(m_offset))
+        : pwrite(m_fd, m_buffer, std::min(m_size, k_maxTransfer), static_cast<off_t>(m_offset));
+    m_result = result < 0 ? -errno : result;
+    m_loop.complete_from_worker(this);
+}
+
+}//coro
@@ -5,18 +5,23 @@
 #include <bitset>
 #include <cassert>
 
-uint64_t k_base36Powers[] = {
-    1ULL,
-    36ULL,
-    36ULL*36ULL,
-    36ULL*36ULL*36ULL,
-    36ULL*36ULL*36ULL*36ULL,
-    36ULL*36ULL*36ULL*36ULL*36ULL,
-    36ULL*36ULL*36ULL*36ULL*36ULL*36ULL,
-    36ULL*36ULL*36ULL*36ULL*36ULL*36ULL*36ULL,
-    36ULL*36ULL*36ULL*36ULL*36ULL*36ULL*36ULL*36ULL,
-    36ULL*36ULL*36ULL*36ULL*36ULL*36ULL*36ULL*36ULL*36ULL // 10digits
-};
+#include "constexpr_math.h"
+
+// 36^0 .. 36^12, every power a uint64_t holds
+constexpr auto k_base36Powers = constexpr_math::powers<uint64_t, 36>();
+static_assert(k_base36Powers.size() == 13 && k_base36Powers[9] == 101559956668416ULL);
+
+// the digit extraction divides by a power picked at run time, a multiply instead of a div
+constexpr auto k_base36Dividers = constexpr_math::make_table<k_base36Powers.size()>([](size_t i) {
+    return constexpr_math::divider(k_base36Powers[i]);
+});
+
+constexpr uint8_t k_invalidDigit = 0xFF;
+constexpr auto k_base36Digits = constexpr_math::make_table<256>([](size_t c) -> uint8_t {
+    if (c >= '0' && c <= '9') return static_cast<uint8_t>(c - '0');
+    if (c >= 'A' && c <= 'Z') return static_cast<uint8_t>(c - 'A' + 10);
+    return k_invalidDigit;
+});
 
 
 std::string EncodeBase36(const uint64_t data, uint8_t maxOutputDigits, bool trimLeftZeroes) {
@@ -29,6 +34,7 @@ std::string EncodeBase36(const uint64_t data, uint8_t maxOutputDigits, bool trim
         'U', 'V', 'W', 'X', 'Y', 'Z',
     };
 
+    assert(maxOutputDigits < k_base36Powers.size());
     uint64_t remainder = data;
     if (remainder / 36 > k_base36Powers[maxOutputDigits])
     {
@@ -44,7 +50,7 @@ std::string EncodeBase36(const uint64_t data, uint8_t maxOutputDigits, bool trim
     while(count >= 0)
     {
         const uint64_t currentPower = k_base36Powers[count];
-        const uint64_t c = remainder / currentPower;
+        const uint64_t c = k_base36Dividers[count].divide(remainder);
         remainder -= c * currentPower;
         //std::cout << "remainder("<<currentPower<<"): " << remainder << " C(" << c << ")-> " << std::endl;
         
@@ -78,12 +84,9 @@ uint64_t DecodeBase36(const std::string data) {
     {
         const uint64_t currentPower = k_base36Powers[count];
         //std::cout << "C: " << c << " ("<< currentPower << ")-> ";
-        if (c >= '0' && c <= '9') {
-            const uint64_t value = (c - '0') * currentPower;
-            //std::cout << value;
-            output +=  value;
-        } else if (c >= 'A' && c <= 'Z') {
-            const uint64_t value = (c - 'A' + 10) * currentPower;
+        const uint8_t digit = k_base36Digits[static_cast<uint8_t>(c)];
+        if (digit != k_invalidDigit) {
+            const uint64_t value = digit * currentPower;
             //std::cout << value;
             output += value;
         } else {
@@ -0,0 +1,548 @@
+/*
+Micro benchmark harness shared by the experiments:
+
+  bench::runner runner(bench::config::from_args(argc, argv));
+  runner.run("par reduce", [&]() { bench::do_not_optimize(std::reduce(...)); });
+
+Every run does some warmup calls and then times N samples, reporting min/median/mean/p99/max/stddev. Optionally the
+thread is pinned to one cpu and hardware counters are read through perf_event_open (linux, needs
+/proc/sys/kernel/perf_event_paranoid <= 2 or CAP_PERFMON, otherwise the counters are just skipped).
+Results can be written as JSON/CSV to diff runs against each other:
+
+  --samples N --warmup N --pin CPU --perf --json PATH --csv PATH
+
+https://github.com/google/benchmark/blob/main/docs/user_guide.md#preventing-optimization
+https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench
+{
+
+///Makes the compiler believe value is read (and may be written), so the computation producing it isn't dropped
+template<typename T>
+inline void do_not_optimize(T const& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* s_sink;
+    s_sink = &value;
+#endif
+}
+
+///Forces pending writes to memory to be considered observable
+inline void clobber_memory()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#endif
+}
+
+///@return false if pinning isn't supported or the cpu doesn't exist
+inline bool pin_to_cpu(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    return sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+///Human readable duration, i.e. 950ns, 12.3us, 4.56ms, 1.2s
+inline std::string format_duration(double nanoseconds)
+{
+    std::ostringstream ostr;
+    ostr.precision(3);
+    if (nanoseconds >= 1e9)
+    {
+        ostr << nanoseconds / 1e9 << "s";
+    }
+    else if (nanoseconds >= 1e6)
+    {
+        ostr << nanoseconds / 1e6 << "ms";
+    }
+    else if (nanoseconds >= 1e3)
+    {
+        ostr << nanoseconds / 1e3 << "us";
+    }
+    else
+    {
+        ostr << nanoseconds << "ns";
+    }
+    return ostr.str();
+}
+
+template<typename Rep, typename Period>
+std::string format_duration(std::chrono::duration<Rep, Period> d)
+{
+    return format_duration(std::chrono::duration<double, std::nano>(d).count());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Group of hardware counters read with perf_event_open, is_available() is false when the kernel refuses them
+class perf_counters
+{
+public:
+    enum counter { k_cycles, k_instructions, k_cacheMisses, k_branchMisses, k_count };
+    using values_t = std::array<uint64_t, k_count>;
+
+    static const char* name(size_t index)
+    {
+        static const char* s_names[k_count] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+        return s_names[index];
+    }
+
+public:
+    perf_counters()
+    {
+#if defined(__linux__)
+        const uint64_t configs[k_count] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (size_t i = 0; i < k_count; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = i == 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            m_fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : m_fds[0], 0));
+            if (m_fds[i] < 0)
+            {
+                close_all();
+                return;
+            }
+        }
+#endif
+    }
+    ~perf_counters() { close_all(); }
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool is_available() const { return m_fds[0] >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (is_available())
+        {
+            ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    values_t stop()
+    {
+        values_t values{};
+#if defined(__linux__)
+        if (is_available())
+        {
+            ioctl(m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t buffer[1 + k_count] = {};
+            if (read(m_fds[0], buffer, sizeof(buffer)) == static_cast<ssize_t>(sizeof(buffer)) && buffer[0] == k_count)
+            {
+                std::copy(buffer + 1, buffer + 1 + k_count, values.begin());
+            }
+        }
+#endif
+        return values;
+    }
+
+private:
+    void close_all()
+    {
+#if defined(__linux__)
+        for (int& fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            fd = -1;
+        }
+#endif
+    }
+
+    int m_fds[k_count] = {-1, -1, -1, -1};
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct settings
+{
+    size_t warmup = 2;
+    size_t samples = 11;
+    size_t iterations = 1; // calls per sample, raise it for bodies shorter than a few microseconds
+    uint64_t bytes = 0; // bytes processed per call, reported as GB/s when set
+};
+
+struct statistics
+{
+    double minNs = 0.0;
+    double medianNs = 0.0;
+    double meanNs = 0.0;
+    double p99Ns = 0.0;
+    double maxNs = 0.0;
+    double stddevNs = 0.0;
+
+    ///nearest rank percentiles over the per call times of every sample
+    static statistics compute(std::vector<double> samples)
+    {
+        statistics stats;
+        if (samples.empty())
+        {
+            return stats;
+        }
+        std::sort(std::begin(samples), std::end(samples));
+        auto percentile = [&samples](double p) {
+            const size_t rank = static_cast<size_t>(std::ceil(p * double(samples.size())));
+            return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+        };
+
+        stats.minNs = samples.front();
+        stats.maxNs = samples.back();
+        stats.medianNs = samples.size() % 2 == 1
+            ? samples[samples.size() / 2]
+            : 0.5 * (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]);
+        stats.p99Ns = percentile(0.99);
+        stats.meanNs = std::accumulate(std::begin(samples), std::end(samples), 0.0) / double(samples.size());
+        double sumSquares = 0.0;
+        for (const double sample : samples)
+        {
+            sumSquares += (sample - stats.meanNs) * (sample - stats.meanNs);
+        }
+        stats.stddevNs = samples.size() > 1 ? std::sqrt(sumSquares / double(samples.size() - 1)) : 0.0;
+        return stats;
+    }
+};
+
+struct result
+{
+    std::string name;
+    settings setup;
+    statistics stats;
+    bool hasPerf = false;
+    std::array<double, perf_counters::k_count> perfPerCall{}; // averaged over the timed calls
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Command line: --samples N --warmup N --pin CPU --perf --json PATH --csv PATH
+struct config
+{
+    settings defaults;
+    int pinCpu = -1;
+    bool perfCounters = false;
+    std::string jsonPath;
+    std::string csvPath;
+
+    static config from_args(int argc, char** argv)
+    {
+        config cfg;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--perf")
+            {
+                cfg.perfCounters = true;
+            }
+            else if (arg == "--samples" && hasValue)
+            {
+                cfg.defaults.samples = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (arg == "--warmup" && hasValue)
+            {
+                cfg.defaults.warmup = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--pin" && hasValue)
+            {
+                cfg.pinCpu = std::atoi(argv[++i]);
+            }
+            else if (arg == "--json" && hasValue)
+            {
+                cfg.jsonPath = argv[++i];
+            }
+            else if (arg == "--csv" && hasValue)
+            {
+                cfg.csvPath = argv[++i];
+            }
+            else
+            {
+                std::cerr << "unknown benchmark argument: " << arg << std::endl;
+            }
+        }
+        return cfg;
+    }
+};
+
+class runner
+{
+public:
+    explicit runner(const config& cfg = config())
+        : m_config(cfg)
+    {
+        if (m_config.pinCpu >= 0 && !pin_to_cpu(m_config.pinCpu))
+        {
+            std::cerr << "cannot pin to cpu " << m_config.pinCpu << std::endl;
+        }
+        if (m_config.perfCounters)
+        {
+            m_perf.reset(new perf_counters());
+            if (!m_perf->is_available())
+            {
+                std::cerr << "perf_event_open not available, running without hardware counters" << std::endl;
+            }
+        }
+    }
+    ~runner()
+    {
+        if (!m_config.jsonPath.empty())
+        {
+            std::ofstream file(m_config.jsonPath);
+            write_json(file);
+        }
+        if (!m_config.csvPath.empty())
+        {
+            std::ofstream file(m_config.csvPath);
+            write_csv(file);
+        }
+    }
+    runner(const runner&) = delete;
+    runner& operator=(const runner&) = delete;
+
+    const config& get_config() const { return m_config; }
+    const std::vector<result>& results() const { return m_results; }
+
+    template<typename F>
+    const result& run(const std::string& name, F&& f)
+    {
+        return run(name, m_config.defaults, std::forward<F>(f));
+    }
+
+    template<typename F>
+    const result& run(const std::string& name, const settings& setup, F&& f)
+    {
+        using clock_t = std::chrono::steady_clock;
+
+        for (size_t i = 0; i < setup.warmup; ++i)
+        {
+            f();
+        }
+
+        const size_t iterations = std::max<size_t>(1, setup.iterations);
+        std::vector<double> samples;
+        samples.reserve(setup.samples);
+        perf_counters::values_t perfTotals{};
+        const bool usePerf = m_perf && m_perf->is_available();
+
+        for (size_t sample = 0; sample < std::max<size_t>(1, setup.samples); ++sample)
+        {
+            if (usePerf)
+            {
+                m_perf->start();
+            }
+            const clock_t::time_point t0 = clock_t::now();
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                f();
+            }
+            clobber_memory();
+            const clock_t::time_point t1 = clock_t::now();
+            if (usePerf)
+            {
+                const perf_counters::values_t values = m_perf->stop();
+                for (size_t c = 0; c < perf_counters::k_count; ++c)
+                {
+                    perfTotals[c] += values[c];
+                }
+            }
+            samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() / double(iterations));
+        }
+
+        result res;
+        res.name = name;
+        res.setup = setup;
+        res.stats = statistics::compute(samples);
+        res.hasPerf = usePerf;
+        for (size_t c = 0; c < perf_counters::k_count; ++c)
+        {
+            res.perfPerCall[c] = double(perfTotals[c]) / double(samples.size() * iterations);
+        }
+        m_results.push_back(res);
+        print(std::cout, m_results.back());
+        return m_results.back();
+    }
+
+    static void print(std::ostream& os, const result& res)
+    {
+        const statistics& stats = res.stats;
+        os << res.name << ": median " << format_duration(stats.medianNs)
+            << ", p99 " << format_duration(stats.p99Ns)
+            << ", min " << format_duration(stats.minNs)
+            << ", stddev " << format_duration(stats.stddevNs)
+            << " (" << res.setup.samples << "x" << res.setup.iterations << ")";
+        if (res.setup.bytes > 0 && stats.medianNs > 0.0)
+        {
+            os << ", " << double(res.setup.bytes) / stats.medianNs << "GB/s";
+        }
+        if (res.hasPerf)
+        {
+            for (size_t c = 0; c < perf_counters::k_count; ++c)
+            {
+                os << ", " << perf_counters::name(c) << " " << uint64_t(res.perfPerCall[c]);
+            }
+        }
+        os << std::endl;
+    }
+
+    void write_json(std::ostream& os) const
+    {
+        os << "{\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < m_results.size(); ++i)
+        {
+            const result& res = m_results[i];
+            os << "    {\"name\": \"" << escape_json(res.name) << "\""
+                << ", \"samples\": " << res.setup.samples
+                << ", \"iterations\": " << res.setup.iterations
+                << ", \"bytes\": " << res.setup.bytes
+                << ", \"min_ns\": " << res.stats.minNs
+                << ", \"median_ns\": " << res.stats.medianNs
+                << ", \"mean_ns\": " << res.stats.meanNs
+                << ", \"p99_ns\": " << res.stats.p99Ns
+                << ", \"max_ns\": " << res.stats.maxNs
+                << ", \"stddev_ns\": " << res.stats.stddevNs;
+            if (res.hasPerf)
+            {
+                for (size_t c = 0; c < perf_counters::k_count; ++c)
+                {
+                    os << ", \"" << perf_counters::name(c) << "\": " << res.perfPerCall[c];
+                }
+            }
+            os << "}" << (i + 1 < m_results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n}\n";
+    }
+
+    void write_csv(std::ostream& os) const
+    {
+        os << "name,samples,iterations,bytes,min_ns,median_ns,mean_ns,p99_ns,max_ns,stddev_ns";
+        for (size_t c = 0; c < perf_counters::k_count; ++c)
+        {
+            os << "," << perf_counters::name(c);
+        }
+        os << "\n";
+        for (const result& res : m_results)
+        {
+            os << "\"" << escape_csv(res.name) << "\"," << res.setup.samples << "," << res.setup.iterations << "," << res.setup.bytes
+                << "," << res.stats.minNs << "," << res.stats.medianNs << "," << res.stats.meanNs
+                << "," << res.stats.p99Ns << "," << res.stats.maxNs << "," << res.stats.stddevNs;
+            for (size_t c = 0; c < perf_counters::k_count; ++c)
+            {
+                os << ",";
+                if (res.hasPerf)
+                {
+                    os << res.perfPerCall[c];
+                }
+            }
+            os << "\n";
+        }
+    }
+
+private:
+    static std::string escape_json(const std::string& str)
+    {
+        std::string escaped;
+        escaped.reserve(str.size());
+        for (const char c : str)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped.push_back('\\');
+            }
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+    ///RFC 4180: quotes inside a quoted field are doubled
+    static std::string escape_csv(const std::string& str)
+    {
+        std::string escaped;
+        escaped.reserve(str.size());
+        for (const char c : str)
+        {
+            if (c == '"')
+            {
+                escaped.push_back('"');
+            }
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+
+    config m_config;
+    std::unique_ptr<perf_counters> m_perf;
+    std::vector<result> m_results;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///One shot measurement for things that can't be repeated (cold caches, first touch), prints when it goes out of scope
+class scoped_timer
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+public:
+    explicit scoped_timer(const std::string& tag, std::ostream& os = std::cout)
+        : m_tag(tag)
+        , m_os(os)
+        , m_t0(clock_t::now())
+    {}
+    ~scoped_timer()
+    {
+        m_os << m_tag << ": " << format_duration(elapsed()) << " (single run)" << std::endl;
+    }
+
+    clock_t::duration elapsed() const { return clock_t::now() - m_t0; }
+
+private:
+    std::string m_tag;
+    std::ostream& m_os;
+    clock_t::time_point m_t0;
+};
+
+}//bench
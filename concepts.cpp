@@ -1,22 +1,219 @@
 /**
 https://www.foonathan.net/2021/07/concepts-structural-nominal/
+
+equality_comparable, vec2 and the vector types built on them live in vec.h. The benchmarks below run the batch
+kernels over AoS and SoA copies of the same 10M points, then compare soa_vector<float, float> (soa_vector.h) with
+std::vector<vec2> on scans. GB/s counts the bytes the scan needs (4 per point for x alone), so the AoS rows show what
+dragging the unused field through the caches costs.
+
+compile with -std=c++20 -O2
 **/
-template <typename T>
-concept equality_comparable = requires (T obj) {
-  { obj == obj } -> std::same_as<bool>;
-  { obj != obj } -> std::same_as<bool>;
-};
 
-struct vec2
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark.h"
+#include "simd_reduce.h"
+#include "soa_vector.h"
+#include "vec.h"
+
+static_assert(equality_comparable<vec2>);
+static_assert(vector_space<vec2> && vector_space<vec3> && vector_space<vec4>);
+static_assert(soa_record<vec2, float, float> && !soa_record<vec2, float, float, float>);
+static_assert(equality_comparable<soa_vector<float, float>::reference>);
+
+template<packed_vector V>
+std::vector<V> make_points(size_t i_count)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(-100.f, 100.f);
+    std::vector<V> points(i_count);
+    for (V& point : points)
+    {
+        for (size_t c = 0; c < V::dimension; ++c)
+        {
+            point[c] = dist(gen);
+        }
+    }
+    return points;
+}
+
+template<packed_vector V>
+void test_layouts(bench::runner& runner, const std::string& i_name, size_t i_count)
 {
-    float x, y;
+    std::vector<V> points = make_points<V>(i_count);
+    for (size_t i = 0; i < i_count; i += 997)
+    {// lengths around 1e-20: the squared length is denormal
+        points[i] = points[i] * 1e-22f;
+    }
+    const vec_soa<V> soaPoints(points);
+    std::vector<float> aosOut(i_count);
+    std::vector<float> soaOut(i_count);
 
-    friend bool operator==(vec2 lhs, vec2 rhs)
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = i_count * sizeof(V);
+
+    runner.run("AoS " + i_name + " dot", setup, [&]() {
+        dot(points.data(), points.data(), i_count, aosOut.data());
+        bench::do_not_optimize(aosOut.data());
+    });
+    runner.run("AoS " + i_name + " length", setup, [&]() {
+        length(points.data(), i_count, aosOut.data());
+        bench::do_not_optimize(aosOut.data());
+    });
+    std::vector<V> normalized = points;
+    runner.run("AoS " + i_name + " normalize", setup, [&]() {
+        normalize(normalized.data(), i_count);
+        bench::do_not_optimize(normalized.data());
+    });
+
+    for (const simd::isa isa : {simd::isa::scalar, simd::isa::avx2, simd::isa::avx512})
     {
-        return lhs.x == rhs.x && lhs.y == rhs.y;
+        if (isa > simd::detected_isa())
+        {
+            continue;
+        }
+        simd::set_isa(isa);
+        const std::string name = "SoA " + i_name + " " + simd::isa_name(isa);
+
+        runner.run(name + " dot", setup, [&]() {
+            dot(soaPoints, soaPoints, soaOut.data());
+            bench::do_not_optimize(soaOut.data());
+        });
+        runner.run(name + " length", setup, [&]() {
+            length(soaPoints, soaOut.data());
+            bench::do_not_optimize(soaOut.data());
+        });
+        if (soaOut != aosOut)
+        {
+            std::cerr << name << " length differs from AoS" << std::endl;
+        }
+        vec_soa<V> soaNormalized = soaPoints;
+        runner.run(name + " normalize", setup, [&]() {
+            normalize(soaNormalized);
+            bench::do_not_optimize(soaNormalized.component(0));
+        });
+        // rsqrt + Newton is a few ULP off the AoS division
+        for (size_t i = 0; i < i_count; ++i)
+        {
+            const V difference = soaNormalized.get(i) - normalized[i];
+            if (!(dot(difference, difference) < 1e-10f))
+            {
+                std::cerr << name << " normalize differs from AoS at " << i << std::endl;
+                break;
+            }
+        }
     }
+    simd::set_isa(simd::detected_isa());
+}
 
-    // operator!= not needed in C++20 due to operator rewrite rules!
-};
+void test_soa_vector(bench::runner& runner, size_t i_count)
+{
+    {// appending its own elements while the columns grow
+        soa_vector<float, float> self;
+        self.push_back(1.f, 2.f);
+        while (self.size() < self.capacity())
+        {
+            self.push_back(3.f, 4.f);
+        }
+        self.push_back(self.data<0>()[0], self.data<1>()[0]);
+        if (vec2(self.back()) != vec2{1.f, 2.f})
+        {
+            std::cerr << "soa_vector push_back of its own element lost the value" << std::endl;
+        }
+    }
 
-static_assert(equality_comparable<vec2>);
+    const std::vector<vec2> points = make_points<vec2>(i_count);
+    soa_vector<float, float> soaPoints;
+    soaPoints.reserve(i_count);
+    for (const vec2& point : points)
+    {
+        soaPoints.push_back(point);
+    }
+    for (size_t i = 0; i < i_count; ++i)
+    {
+        if (vec2(soaPoints[i]) != points[i])
+        {
+            std::cerr << "soa_vector differs at " << i << std::endl;
+            break;
+        }
+    }
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = i_count * sizeof(float);
+
+    runner.run("std::vector<vec2> sum x", setup, [&]() {
+        float sum = 0.f;
+        for (const vec2& point : points)
+        {
+            sum += point.x;
+        }
+        bench::do_not_optimize(sum);
+    });
+    runner.run("soa_vector proxies sum x", setup, [&]() {
+        float sum = 0.f;
+        for (const auto [x, y] : soaPoints)
+        {
+            sum += x;
+        }
+        bench::do_not_optimize(sum);
+    });
+    runner.run("soa_vector column sum x", setup, [&]() {
+        float sum = 0.f;
+        for (const float x : soaPoints.column<0>())
+        {
+            sum += x;
+        }
+        bench::do_not_optimize(sum);
+    });
+    runner.run("soa_vector column simd::sum x", setup, [&]() {
+        const std::span<const float> xs = std::as_const(soaPoints).column<0>();
+        bench::do_not_optimize(simd::sum(xs.data(), xs.size()));
+    });
+
+    std::vector<vec2> scaled = points;
+    soa_vector<float, float> soaScaled = soaPoints;
+    runner.run("std::vector<vec2> x *= 0.5", setup, [&]() {
+        for (vec2& point : scaled)
+        {
+            point.x *= 0.5f;
+        }
+        bench::do_not_optimize(scaled.data());
+    });
+    runner.run("soa_vector column x *= 0.5", setup, [&]() {
+        for (float& x : soaScaled.column<0>())
+        {
+            x *= 0.5f;
+        }
+        bench::do_not_optimize(soaScaled.data<0>());
+    });
+
+    // both fields: the layouts read the same bytes
+    setup.bytes = i_count * sizeof(vec2);
+    runner.run("std::vector<vec2> sum x * y", setup, [&]() {
+        float sum = 0.f;
+        for (const vec2& point : points)
+        {
+            sum += point.x * point.y;
+        }
+        bench::do_not_optimize(sum);
+    });
+    runner.run("soa_vector columns simd::dot x, y", setup, [&]() {
+        bench::do_not_optimize(simd::dot(soaPoints.data<0>(), soaPoints.data<1>(), i_count));
+    });
+}
+
+// benchmark.h options: --samples N --warmup N --pin CPU --perf --json PATH --csv PATH
+int main(int argc, char** argv)
+{
+    bench::runner runner(bench::config::from_args(argc, argv));
+    test_layouts<vec2>(runner, "vec2", 10000000);
+    test_layouts<vec3>(runner, "vec3", 10000000);
+    test_layouts<vec4>(runner, "vec4", 10000000);
+    test_soa_vector(runner, 10000000);
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+Math usable in constant expressions, so lookup tables and divisor constants are computed by the compiler instead of
+written out by hand or filled at startup:
+
+  constexpr auto k_powers = constexpr_math::powers<uint64_t, 36>();             // 36^0 .. 36^12, as many as fit
+  constexpr auto k_squares = constexpr_math::make_table<256>([](size_t i) { return i * i; });
+  constexpr constexpr_math::divider k_by36(36);                                  // k_by36.divide(n) == n / 36
+  static_assert(constexpr_math::sqrt(2.0) == 1.4142135623730951);
+
+Everything also works at run time. sqrt(double) is correctly rounded (integer square root of the significand, round
+to nearest even), the same result as the hardware instruction. divider is the round-up reciprocal of Granlund and
+Montgomery: one 64x64->128 multiply, an add and two shifts per division, exact for every uint64_t dividend. It's
+what compilers emit for a literal divisor, useful when the divisor is only known once the table is built (a row of
+the table picks it at run time).
+
+https://gmplib.org/~tege/divcnst-pldi94.pdf
+*/
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace constexpr_math
+{
+
+///base^exponent, wraps like the multiplication loop on overflow
+template<typename T>
+constexpr T ipow(T base, unsigned exponent)
+{
+    T result = 1;
+    while (exponent != 0)
+    {
+        if (exponent & 1)
+        {
+            result *= base;
+        }
+        base *= base;
+        exponent >>= 1;
+    }
+    return result;
+}
+
+///floor(log2(n)), n > 0
+constexpr unsigned ilog2(uint64_t n) { return static_cast<unsigned>(std::bit_width(n)) - 1; }
+
+///ceil(log2(n)), n > 0
+constexpr unsigned ceil_log2(uint64_t n) { return n <= 1 ? 0 : ilog2(n - 1) + 1; }
+
+///floor(log_base(n)), n > 0 and base > 1
+constexpr unsigned ilog(uint64_t base, uint64_t n)
+{
+    unsigned result = 0;
+    while (n >= base)
+    {
+        n /= base;
+        ++result;
+    }
+    return result;
+}
+
+///floor(sqrt(n))
+constexpr uint64_t isqrt(uint64_t n)
+{
+    uint64_t root = 0;
+    uint64_t bit = uint64_t(1) << 62;
+    while (bit > n)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {// digit by digit, one result bit per step
+        if (n >= root + bit)
+        {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///floor(sqrt(n)) and whether it's exact
+constexpr std::pair<uint64_t, bool> isqrt128(unsigned __int128 n)
+{
+    unsigned __int128 root = 0;
+    unsigned __int128 bit = static_cast<unsigned __int128>(1) << 126;
+    while (bit > n)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (n >= root + bit)
+        {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return {static_cast<uint64_t>(root), n == 0};
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Correctly rounded square root, NaN for negative inputs
+constexpr double sqrt(double x)
+{
+    if (x != x || x == 0.0 || x == std::numeric_limits<double>::infinity())
+    {
+        return x; // NaN, +-0 and +inf are their own root
+    }
+    if (x < 0.0)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    constexpr uint64_t k_implicitBit = uint64_t(1) << 52;
+    const uint64_t bits = std::bit_cast<uint64_t>(x);
+    int exponent = static_cast<int>(bits >> 52);
+    uint64_t significand = bits & (k_implicitBit - 1);
+    if (exponent == 0)
+    {// subnormal, normalize
+        exponent = 1;
+        while ((significand & k_implicitBit) == 0)
+        {
+            significand <<= 1;
+            --exponent;
+        }
+    }
+    else
+    {
+        significand |= k_implicitBit;
+    }
+
+    // x = significand * 2^scale with an even scale
+    int scale = exponent - 1023 - 52;
+    if (scale % 2 != 0)
+    {
+        significand <<= 1;
+        --scale;
+    }
+
+    // sqrt(significand << 64) has 59 bits: 53 kept, 6 to round
+    const auto [root, isExact] = detail::isqrt128(static_cast<unsigned __int128>(significand) << 64);
+    uint64_t kept = root >> 6;
+    const uint64_t rest = root & 63;
+    if (rest > 32 || (rest == 32 && (!isExact || (kept & 1) != 0)))
+    {
+        ++kept;
+    }
+    int resultExponent = scale / 2 + 26;
+    if (kept == (k_implicitBit << 1))
+    {
+        kept >>= 1;
+        ++resultExponent;
+    }
+    return std::bit_cast<double>((static_cast<uint64_t>(resultExponent + 1023) << 52) | (kept & (k_implicitBit - 1)));
+}
+
+///Division of any uint64_t by a fixed divisor with a multiply and shifts
+class divider
+{
+public:
+    constexpr divider() = default;
+    ///i_divisor can't be 0 (a compile error when constructed in a constant expression)
+    constexpr explicit divider(uint64_t i_divisor)
+        : m_divisor(i_divisor)
+    {
+        assert(i_divisor != 0);
+        if (i_divisor > 1)
+        {
+            // m = 2^64 * (2^l - d) / d + 1, the low 64 bits of the 65 bit magic ceil(2^(64 + l) / d)
+            const unsigned l = ceil_log2(i_divisor);
+            const unsigned __int128 excess = (static_cast<unsigned __int128>(1) << l) - i_divisor;
+            m_multiplier = static_cast<uint64_t>((excess << 64) / i_divisor + 1);
+            m_shift = l - 1;
+        }
+    }
+
+    constexpr uint64_t divisor() const { return m_divisor; }
+
+    constexpr uint64_t divide(uint64_t n) const
+    {
+        if (m_divisor == 1)
+        {
+            return n;
+        }
+        const uint64_t high = static_cast<uint64_t>((static_cast<unsigned __int128>(m_multiplier) * n) >> 64);
+        return (((n - high) >> 1) + high) >> m_shift;
+    }
+
+    constexpr uint64_t modulo(uint64_t n) const { return n - divide(n) * m_divisor; }
+
+private:
+    uint64_t m_divisor = 1;
+    uint64_t m_multiplier = 0;
+    unsigned m_shift = 0;
+};
+
+///{f(0), f(1), ..., f(N - 1)}
+template<size_t N, typename F>
+constexpr auto make_table(F f)
+{
+    using T = std::invoke_result_t<F, size_t>;
+    std::array<T, N> table{};
+    for (size_t i = 0; i < N; ++i)
+    {
+        table[i] = f(i);
+    }
+    return table;
+}
+
+///Number of powers of Base representable in T, 1 included
+template<typename T, uint64_t Base>
+constexpr size_t power_count() { return ilog(Base, std::numeric_limits<T>::max()) + 1; }
+
+///{1, Base, Base^2, ...} up to the largest one T holds
+template<typename T, uint64_t Base, size_t Count = power_count<T, Base>()>
+constexpr std::array<T, Count> powers()
+{
+    static_assert(Count <= power_count<T, Base>(), "the last power overflows");
+    return make_table<Count>([](size_t i) { return ipow<T>(static_cast<T>(Base), static_cast<unsigned>(i)); });
+}
+
+static_assert(ipow<uint64_t>(36, 12) == 4738381338321616896ull);
+static_assert(ilog2(1) == 0 && ilog2(1024) == 10 && ilog2(1025) == 10 && ceil_log2(1025) == 11);
+static_assert(isqrt(std::numeric_limits<uint64_t>::max()) == 0xFFFFFFFFull && isqrt(99) == 9);
+static_assert(sqrt(4.0) == 2.0 && sqrt(2.0) == 1.4142135623730951 && sqrt(0.25) == 0.5);
+static_assert(divider(36).divide(std::numeric_limits<uint64_t>::max()) == std::numeric_limits<uint64_t>::max() / 36);
+static_assert(divider(7).divide(48) == 6 && divider(1).divide(5) == 5 && divider(1ull << 63).divide(~0ull) == 1);
+
+}//constexpr_math
@@ -1,20 +1,98 @@
 /*
-compile with -std=c++17 and ensure the compiler supports coroutines (i.e., gcc with coroutines)
+compile with -std=c++20 and ensure the compiler supports coroutines (i.e., gcc with coroutines)
 
 https://dev.to/dwd/coroutines-in-c-2i5b
 https://medium.com/pranayaggarwal25/coroutines-in-cpp-15afdf88e17e
 https://lewissbaker.github.io/2018/09/05/understanding-the-promise-type
 https://devblogs.microsoft.com/oldnewthing/20191209-00/?p=103195
 
+std::future isn't a coroutine type and std::coroutine_traits can't be specialized for it (no program-defined type
+involved), so future_task below wraps one: eager, resumed from a thread that blocks on the awaited future. Every
+await costs a thread: coro::task (task.h) does the same job lazily with symmetric transfer and no thread at all.
+With coro::executor (executor.h) the fan-out of test_async_fib runs thousands of tasks on a fixed set of workers.
+Streams of values are coro::generator and coro::async_generator (generator.h). Frames of all of them, the
+future_task ones included, come from the thread local pool of task.h instead of one operator new per call.
+
 */
 
 #include <future>
 #include <coroutine>
 #include <iostream>
+#include <thread>
+
+#include "benchmark.h"
+#include "executor.h"
+#include "generator.h"
+#include "task.h"
 
 using namespace std;
 
-future<int> async_add(int a, int b)
+////////////////////////////////////////////////////////////
+
+template<typename T>
+struct future_promise_base : coro::promise_allocation
+{
+    std::promise<T> promise;
+
+    void return_value(const T& value) { promise.set_value(value); }
+};
+
+template<>
+struct future_promise_base<void> : coro::promise_allocation
+{
+    std::promise<void> promise;
+
+    void return_void() { promise.set_value(); }
+};
+
+///std::future as a coroutine return type: eager, the result is set through a std::promise
+template<typename T>
+class future_task
+{
+public:
+    struct promise_type : future_promise_base<T>
+    {
+        future_task get_return_object() { return future_task(this->promise.get_future()); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void unhandled_exception() { this->promise.set_exception(std::current_exception()); }
+    };
+
+public:
+    future_task(std::future<T>&& future) : m_future(std::move(future)) {} // std::async results convert
+    future_task(future_task&&) = default;
+    future_task& operator=(future_task&&) = default;
+
+    T get() { return m_future.get(); }
+    void wait() const { m_future.wait(); }
+
+    ///Resumed from a thread that blocks on the future
+    auto operator co_await() &&
+    {
+        struct awaiter
+        {
+            std::future<T> future;
+
+            bool await_ready() const { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                std::thread([this, handle]() {
+                    future.wait();
+                    handle.resume();
+                }).detach();
+            }
+            T await_resume() { return future.get(); }
+        };
+        return awaiter{std::move(m_future)};
+    }
+
+private:
+    std::future<T> m_future;
+};
+
+////////////////////////////////////////////////////////////
+
+future_task<int> async_add(int a, int b)
 {
     auto fut = std::async([=]() {
         int c = a + b;
@@ -24,7 +102,7 @@ future<int> async_add(int a, int b)
     return fut;
 }
 
-future<int> async_fib(int n)
+future_task<int> async_fib(int n)
 {
     if (n <= 2)
         co_return 1;
@@ -43,7 +121,7 @@ future<int> async_fib(int n)
     co_return b;
 }
 
-future<void> test_async_fib()
+future_task<void> test_async_fib()
 {
     for (int i = 1; i < 10; ++i)
     {
@@ -52,10 +130,279 @@ future<void> test_async_fib()
     }
 }
 
-int main()
+////////////////////////////////////////////////////////////
+
+coro::task<int> task_add(int a, int b)
+{
+    co_return a + b;
+}
+
+coro::task<int> task_fib(int n)
+{
+    if (n <= 2)
+        co_return 1;
+
+    int a = 1;
+    int b = 1;
+
+    for (int i = 0; i < n - 2; ++i)
+    {
+        int c = co_await task_add(a, b);
+        a = b;
+        b = c;
+    }
+
+    co_return b;
+}
+
+coro::task<> test_task_fib()
+{
+    for (int i = 1; i < 10; ++i)
+    {
+        int ret = co_await task_fib(i);
+        cout << "task_fib(" << i << ") returns " << ret << endl;
+    }
+}
+
+////////////////////////////////////////////////////////////
+
+future_task<unsigned> async_add_unsigned(unsigned a, unsigned b)
+{
+    return std::async([=]() { return a + b; });
+}
+
+// fib shaped chain of i_count awaits (wraps around, only the await cost matters)
+future_task<unsigned> async_chain(unsigned i_count)
+{
+    unsigned a = 1;
+    unsigned b = 1;
+    for (unsigned i = 0; i < i_count; ++i)
+    {
+        const unsigned c = co_await async_add_unsigned(a, b);
+        a = b;
+        b = c;
+    }
+    co_return b;
+}
+
+coro::task<unsigned> task_add_unsigned(unsigned a, unsigned b)
+{
+    co_return a + b;
+}
+
+coro::task<unsigned> task_chain(unsigned i_count)
+{
+    unsigned a = 1;
+    unsigned b = 1;
+    for (unsigned i = 0; i < i_count; ++i)
+    {
+        const unsigned c = co_await task_add_unsigned(a, b);
+        a = b;
+        b = c;
+    }
+    co_return b;
+}
+
+void benchmark_await_chains(bench::runner& runner)
+{
+    // a thread per await, 1M of them would take minutes
+    const unsigned futureAwaits = 2000;
+    const unsigned taskAwaits = 1000000;
+
+    const bench::result futures = runner.run("future chain, " + to_string(futureAwaits) + " awaits", [&]() {
+        bench::do_not_optimize(async_chain(futureAwaits).get());
+    });
+    const bench::result tasks = runner.run("task chain, " + to_string(taskAwaits) + " awaits", [&]() {
+        bench::do_not_optimize(coro::sync_wait(task_chain(taskAwaits)));
+    });
+
+    const double futureNs = futures.stats.medianNs / futureAwaits;
+    const double taskNs = tasks.stats.medianNs / taskAwaits;
+    cout << "per await: future " << bench::format_duration(futureNs) << ", task " << bench::format_duration(taskNs) << endl;
+}
+
+////////////////////////////////////////////////////////////
+
+coro::task<int> scheduled_fib(coro::executor& executor, int n)
+{
+    co_await executor.schedule();
+    co_return co_await task_fib(n);
+}
+
+// every fib on its own task, all of them in flight at once on the executor threads
+coro::task<> test_fan_out_fib(coro::executor& executor, int i_count)
+{
+    vector<coro::task<int>> tasks;
+    for (int i = 0; i < i_count; ++i)
+    {
+        tasks.push_back(scheduled_fib(executor, 1 + i % 40));
+    }
+    const vector<int> results = co_await coro::when_all(std::move(tasks));
+    cout << "fan-out: fib(1.." << min(i_count, 40) << ") = " << results[0];
+    for (int i = 1; i < min(i_count, 40); ++i)
+    {
+        cout << ", " << results[i];
+    }
+    cout << endl;
+
+    vector<coro::task<int>> racing;
+    racing.push_back(scheduled_fib(executor, 40));
+    racing.push_back(scheduled_fib(executor, 5));
+    const pair<size_t, int> first = co_await coro::when_any(std::move(racing));
+    cout << "when_any: task " << first.first << " finished first with " << first.second << endl;
+}
+
+void benchmark_fan_out(bench::runner& runner, coro::executor& executor)
+{
+    // std::async: one thread per operation
+    const unsigned futureTasks = 1000;
+    const unsigned coroutineTasks = 100000;
+
+    const bench::result futures = runner.run("std::async fan-out, " + to_string(futureTasks) + " tasks", [&]() {
+        vector<future_task<unsigned>> pending;
+        pending.reserve(futureTasks);
+        for (unsigned i = 0; i < futureTasks; ++i)
+        {
+            pending.push_back(async_add_unsigned(i, i));
+        }
+        unsigned sum = 0;
+        for (future_task<unsigned>& result : pending)
+        {
+            sum += result.get();
+        }
+        bench::do_not_optimize(sum);
+    });
+
+    const bench::result tasks = runner.run("executor fan-out, " + to_string(coroutineTasks) + " tasks, " + to_string(executor.thread_count()) + " threads", [&]() {
+        auto add = [](coro::executor& executor, unsigned a, unsigned b) -> coro::task<unsigned> {
+            co_await executor.schedule();
+            co_return a + b;
+        };
+        vector<coro::task<unsigned>> pending;
+        pending.reserve(coroutineTasks);
+        for (unsigned i = 0; i < coroutineTasks; ++i)
+        {
+            pending.push_back(add(executor, i, i));
+        }
+        unsigned sum = 0;
+        for (const unsigned result : coro::sync_wait(coro::when_all(std::move(pending))))
+        {
+            sum += result;
+        }
+        bench::do_not_optimize(sum);
+    });
+
+    cout << "per task: std::async " << bench::format_duration(futures.stats.medianNs / futureTasks)
+         << ", executor " << bench::format_duration(tasks.stats.medianNs / coroutineTasks) << endl;
+}
+
+////////////////////////////////////////////////////////////
+
+coro::generator<unsigned> fib_sequence(int n)
+{
+    unsigned a = 1;
+    unsigned b = 1;
+    for (int i = 0; i < n; ++i)
+    {
+        co_yield a;
+        a = exchange(b, a + b);
+    }
+}
+
+// every element computed on an executor thread, the consumer follows the producer from thread to thread
+coro::async_generator<int> scheduled_fibs(coro::executor& executor, int n)
+{
+    for (int i = 1; i <= n; ++i)
+    {
+        co_yield co_await scheduled_fib(executor, i);
+    }
+}
+
+coro::task<> test_generators(coro::executor& executor)
+{
+    cout << "generator:";
+    for (const unsigned fib : fib_sequence(10))
+    {
+        cout << " " << fib;
+    }
+    cout << endl;
+
+    coro::async_generator<int> fibs = scheduled_fibs(executor, 10);
+    cout << "async_generator:";
+    while (const int* fib = co_await fibs.next())
+    {
+        cout << " " << *fib;
+    }
+    cout << endl;
+}
+
+////////////////////////////////////////////////////////////
+
+void print_frame_stats(const string& i_name, const coro::frame_statistics& i_stats)
+{
+    cout << i_name << ": " << i_stats.invocations << " coroutine calls, " << i_stats.allocations << " frames allocated ("
+         << i_stats.pooled << " pooled), " << i_stats.elided() << " elided" << endl;
+}
+
+// the same chains and fan-out with one operator new per frame and with the pool
+void benchmark_frame_allocation(bench::runner& runner, coro::executor& executor)
+{
+    const unsigned chainAwaits = 1000000;
+    const unsigned fanOutTasks = 100000;
+    auto add = [](coro::executor& executor, unsigned a, unsigned b) -> coro::task<unsigned> {
+        co_await executor.schedule();
+        co_return a + b;
+    };
+    auto fan_out = [&]() {
+        vector<coro::task<unsigned>> pending;
+        pending.reserve(fanOutTasks);
+        for (unsigned i = 0; i < fanOutTasks; ++i)
+        {
+            pending.push_back(add(executor, i, i));
+        }
+        bench::do_not_optimize(coro::sync_wait(coro::when_all(std::move(pending))).size());
+    };
+
+    for (const coro::frame_allocator* allocator : {&coro::heap_frame_allocator(), &coro::pooled_frame_allocator()})
+    {
+        const string name = allocator == &coro::heap_frame_allocator() ? "operator new" : "frame pool";
+        coro::scoped_frame_allocator scope(*allocator);
+
+        const coro::frame_statistics before = coro::frame_stats();
+        bench::do_not_optimize(coro::sync_wait(task_chain(chainAwaits)));
+        print_frame_stats("task chain", coro::frame_stats() - before);
+
+        const bench::result chain = runner.run("task chain, " + name, [&]() {
+            bench::do_not_optimize(coro::sync_wait(task_chain(chainAwaits)));
+        });
+        const bench::result fanOut = runner.run("executor fan-out, " + name, fan_out);
+        cout << name << " per call: chain " << bench::format_duration(chain.stats.medianNs / chainAwaits)
+             << ", fan-out " << bench::format_duration(fanOut.stats.medianNs / fanOutTasks) << endl;
+    }
+
+    const coro::frame_statistics before = coro::frame_stats();
+    async_fib(20).get();
+    print_frame_stats("async_fib(20)", coro::frame_stats() - before);
+}
+
+////////////////////////////////////////////////////////////
+
+// benchmark.h options: --samples N --warmup N --pin CPU --perf --json PATH --csv PATH
+int main(int argc, char** argv)
 {
     auto fut = test_async_fib();
     fut.wait();
 
+    coro::sync_wait(test_task_fib());
+
+    coro::executor executor;
+    coro::sync_wait(test_fan_out_fib(executor, 10000));
+    coro::sync_wait(test_generators(executor));
+
+    bench::runner runner(bench::config::from_args(argc, argv));
+    benchmark_await_chains(runner);
+    benchmark_fan_out(runner, executor);
+    benchmark_frame_allocation(runner, executor);
+
     return 0;
 }
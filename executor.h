@@ -0,0 +1,319 @@
+/*
+Runs coroutines on work_stealing_pool: co_await executor.schedule() moves the coroutine to a worker (the awaiter is
+the pool_task, it lives in the suspended frame so scheduling doesn't allocate). Fan-out uses the combinators:
+
+  coro::task<int> work(coro::executor& executor, int i) { co_await executor.schedule(); co_return i * i; }
+
+  std::vector<coro::task<int>> tasks;
+  for (int i = 0; i < 1000; ++i) tasks.push_back(work(executor, i));
+  std::vector<int> squares = coro::sync_wait(coro::when_all(std::move(tasks)));
+
+when_all starts every task and resumes the caller (on whichever thread finished last) once all of them are done.
+when_any resumes it as soon as the first is done, there is no cancellation: the others still run to completion in
+the background, owned by a shared state.
+*/
+#pragma once
+
+#include "task.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace coro
+{
+
+class executor
+{
+public:
+    class schedule_awaiter : public pool_task
+    {
+    public:
+        explicit schedule_awaiter(work_stealing_pool& pool)
+            : m_pool(pool)
+        {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_handle = handle;
+            m_pool.submit(this);
+        }
+        void await_resume() noexcept {}
+
+        void execute() override { m_handle.resume(); }
+
+    private:
+        work_stealing_pool& m_pool;
+        std::coroutine_handle<> m_handle;
+    };
+
+    ///@param threadCount 0 uses std::thread::hardware_concurrency()
+    explicit executor(size_t threadCount = 0)
+        : m_pool(threadCount)
+    {}
+
+    size_t thread_count() const { return m_pool.thread_count(); }
+    work_stealing_pool& pool() { return m_pool; }
+
+    ///Resumes the awaiting coroutine on a worker
+    schedule_awaiter schedule() { return schedule_awaiter(m_pool); }
+
+private:
+    work_stealing_pool m_pool;
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Counts the children down, the last one resumes the awaiting coroutine. Starts at children + 1 so none can finish
+///the count while the parent is still starting them.
+struct when_all_latch
+{
+    std::atomic<size_t> count;
+    std::coroutine_handle<> continuation;
+
+    bool arrive() { return count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+};
+
+///Awaits one task for when_all, destroyed by its owner once the latch opened
+class when_all_child
+{
+public:
+    struct promise_type : promise_allocation
+    {
+        struct final_awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                when_all_latch& latch = *handle.promise().m_latch;
+                return latch.arrive() ? latch.continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        when_all_child get_return_object() noexcept { return when_all_child(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); } // the awaited task keeps its own exceptions
+
+        when_all_latch* m_latch = nullptr;
+    };
+
+    explicit when_all_child(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {}
+    when_all_child(when_all_child&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {}
+    when_all_child(const when_all_child&) = delete;
+    when_all_child& operator=(const when_all_child&) = delete;
+    ~when_all_child()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    void start(when_all_latch& latch)
+    {
+        m_handle.promise().m_latch = &latch;
+        m_handle.resume();
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template<typename Task>
+when_all_child make_when_all_child(Task& awaited)
+{
+    co_await awaited.when_ready();
+}
+
+class when_all_awaiter
+{
+public:
+    explicit when_all_awaiter(std::vector<when_all_child>&& children)
+        : m_children(std::move(children))
+    {}
+
+    bool await_ready() const noexcept { return m_children.empty(); }
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        m_latch.count.store(m_children.size() + 1, std::memory_order_relaxed);
+        m_latch.continuation = handle;
+        for (when_all_child& child : m_children)
+        {
+            child.start(m_latch);
+        }
+        return !m_latch.arrive(); // everything completed synchronously, don't suspend
+    }
+    void await_resume() noexcept {}
+
+private:
+    std::vector<when_all_child> m_children;
+    when_all_latch m_latch{{0}, {}};
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Fire and forget coroutine, destroys itself when it returns
+struct detached_task
+{
+    struct promise_type : promise_allocation
+    {
+        detached_task get_return_object() noexcept { return detached_task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+///Outlives the when_any call, every child holds a reference
+template<typename T>
+struct when_any_state
+{
+    static constexpr size_t k_none = SIZE_MAX;
+
+    explicit when_any_state(std::vector<task<T>>&& i_tasks)
+        : tasks(std::move(i_tasks))
+    {}
+
+    ///First completed child and the parent's await_suspend both arrive, the second one to do so resumes the parent
+    void complete(size_t index)
+    {
+        size_t expected = k_none;
+        if (winner.compare_exchange_strong(expected, index, std::memory_order_acq_rel) && arrivals.fetch_add(1, std::memory_order_acq_rel) == 1)
+        {
+            continuation.resume();
+        }
+    }
+
+    std::vector<task<T>> tasks;
+    std::atomic<size_t> winner{k_none};
+    std::atomic<int> arrivals{0};
+    std::coroutine_handle<> continuation;
+};
+
+template<typename T>
+detached_task when_any_child(std::shared_ptr<when_any_state<T>> state, size_t index)
+{
+    co_await state->tasks[index].when_ready();
+    state->complete(index);
+}
+
+///Keeps a reference only: gcc 12 can destroy a co_await temporary twice, the calling frame holds the state
+template<typename T>
+class when_any_awaiter
+{
+public:
+    explicit when_any_awaiter(const std::shared_ptr<when_any_state<T>>& state)
+        : m_state(state)
+    {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        m_state->continuation = handle;
+        for (size_t i = 0; i < m_state->tasks.size(); ++i)
+        {
+            when_any_child(m_state, i).handle.resume();
+        }
+        return m_state->arrivals.fetch_add(1, std::memory_order_acq_rel) == 0;
+    }
+    void await_resume() noexcept {}
+
+private:
+    const std::shared_ptr<when_any_state<T>>& m_state;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Results in the order of the tasks, the first exception is rethrown after all of them completed
+template<typename T>
+task<std::vector<T>> when_all(std::vector<task<T>> tasks)
+{
+    std::vector<detail::when_all_child> children;
+    children.reserve(tasks.size());
+    for (task<T>& awaited : tasks)
+    {
+        children.push_back(detail::make_when_all_child(awaited));
+    }
+    co_await detail::when_all_awaiter(std::move(children));
+
+    std::vector<T> results;
+    results.reserve(tasks.size());
+    for (task<T>& awaited : tasks)
+    {
+        results.push_back(awaited.result());
+    }
+    co_return results;
+}
+
+inline task<> when_all(std::vector<task<>> tasks)
+{
+    std::vector<detail::when_all_child> children;
+    children.reserve(tasks.size());
+    for (task<>& awaited : tasks)
+    {
+        children.push_back(detail::make_when_all_child(awaited));
+    }
+    co_await detail::when_all_awaiter(std::move(children));
+
+    for (task<>& awaited : tasks)
+    {
+        awaited.result();
+    }
+}
+
+template<typename... Ts>
+task<std::tuple<Ts...>> when_all(task<Ts>... tasks)
+{
+    std::vector<detail::when_all_child> children;
+    children.reserve(sizeof...(Ts));
+    (children.push_back(detail::make_when_all_child(tasks)), ...);
+    co_await detail::when_all_awaiter(std::move(children));
+
+    co_return std::tuple<Ts...>{tasks.result()...};
+}
+
+///@return index and result of the first task to complete, tasks can't be empty
+template<typename T>
+task<std::pair<size_t, T>> when_any(std::vector<task<T>> tasks)
+{
+    assert(!tasks.empty());
+    auto state = std::make_shared<detail::when_any_state<T>>(std::move(tasks));
+    co_await detail::when_any_awaiter<T>(state);
+
+    const size_t index = state->winner.load(std::memory_order_acquire);
+    co_return std::pair<size_t, T>(index, state->tasks[index].result());
+}
+
+///@return index of the first task to complete
+inline task<size_t> when_any(std::vector<task<>> tasks)
+{
+    assert(!tasks.empty());
+    auto state = std::make_shared<detail::when_any_state<void>>(std::move(tasks));
+    co_await detail::when_any_awaiter<void>(state);
+
+    const size_t index = state->winner.load(std::memory_order_acquire);
+    state->tasks[index].result();
+    co_return index;
+}
+
+}//coro
@@ -0,0 +1,217 @@
+/*
+Out-of-core map/reduce over files of fixed-size records.
+
+The file is walked in windows of options.windowBytes: while the pool maps/combines window N, a prefetch thread is
+already bringing window N+1 in (pread into the second buffer, or mmap + touching the pages), so I/O overlaps compute
+and memory stays bounded by two windows whatever the file size is.
+
+  map:     const Record& -> V
+  combine: (Acc, V) -> Acc        folds the mapped records of a chunk
+  reduce:  (Acc, Acc) -> Acc      merges chunk results, init has to be its identity
+
+posix only (pread/mmap).
+*/
+#pragma once
+
+#include "parallel_algorithms.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct file_map_reduce_options
+{
+    size_t windowBytes = size_t(64) << 20; // memory budget is two windows
+    size_t grain = 0; // records per parallel chunk, 0 = automatic
+    bool useMmap = true; // false reads with pread into two owned buffers
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class file_window
+{
+public:
+    file_window() = default;
+    file_window(const file_window&) = delete;
+    file_window& operator=(const file_window&) = delete;
+    ~file_window() { release(); }
+
+    ///Maps [offset, offset + bytes) and touches every page so the reads happen on the calling (prefetch) thread
+    bool map(int fd, size_t offset, size_t bytes)
+    {
+        release();
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t alignedOffset = offset & ~(pageSize - 1);
+        m_mappedBytes = bytes + (offset - alignedOffset);
+        m_mapping = mmap(nullptr, m_mappedBytes, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(alignedOffset));
+        if (m_mapping == MAP_FAILED)
+        {
+            m_mapping = nullptr;
+            std::cerr << "mmap failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        madvise(m_mapping, m_mappedBytes, MADV_SEQUENTIAL);
+        madvise(m_mapping, m_mappedBytes, MADV_WILLNEED);
+
+        volatile const char* bytesPtr = static_cast<const char*>(m_mapping);
+        for (size_t i = 0; i < m_mappedBytes; i += pageSize)
+        {
+            (void)bytesPtr[i];
+        }
+        m_data = static_cast<const char*>(m_mapping) + (offset - alignedOffset);
+        return true;
+    }
+
+    ///Reads [offset, offset + bytes) into the owned buffer, which keeps its capacity between windows
+    bool read(int fd, size_t offset, size_t bytes)
+    {
+        release();
+        m_buffer.resize(bytes);
+        size_t done = 0;
+        while (done < bytes)
+        {
+            const ssize_t readBytes = pread(fd, m_buffer.data() + done, bytes - done, static_cast<off_t>(offset + done));
+            if (readBytes <= 0)
+            {
+                std::cerr << "pread failed: " << (readBytes == 0 ? "unexpected end of file" : std::strerror(errno)) << std::endl;
+                return false;
+            }
+            done += static_cast<size_t>(readBytes);
+        }
+        m_data = m_buffer.data();
+        return true;
+    }
+
+    void release()
+    {
+        if (m_mapping != nullptr)
+        {
+            munmap(m_mapping, m_mappedBytes);
+            m_mapping = nullptr;
+        }
+        m_data = nullptr;
+    }
+
+    const char* data() const { return m_data; }
+
+private:
+    void* m_mapping = nullptr;
+    size_t m_mappedBytes = 0;
+    std::vector<char> m_buffer;
+    const char* m_data = nullptr;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///@return false if the file couldn't be opened or read, o_result is left untouched then
+template<typename Record, typename Acc, typename MapOp, typename CombineOp, typename ReduceOp>
+bool map_reduce_file(work_stealing_pool& pool, const std::string& path, Acc init,
+    MapOp mapOp, CombineOp combineOp, ReduceOp reduceOp, Acc& o_result,
+    const file_map_reduce_options& options = file_map_reduce_options())
+{
+    static_assert(std::is_trivially_copyable<Record>::value, "records are read straight from the file bytes");
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        std::cerr << "cannot stat " << path << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    const size_t fileBytes = static_cast<size_t>(fileStat.st_size);
+    const size_t recordCount = fileBytes / sizeof(Record);
+    if (fileBytes % sizeof(Record) != 0)
+    {
+        std::cerr << path << ": ignoring " << fileBytes % sizeof(Record) << " trailing bytes" << std::endl;
+    }
+    const size_t windowRecords = std::max<size_t>(1, options.windowBytes / sizeof(Record));
+    const size_t windowCount = (recordCount + windowRecords - 1) / windowRecords;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    detail::file_window windows[2];
+    auto load = [fd, &options, &windows, recordCount, windowRecords](size_t window) {
+        const size_t first = window * windowRecords;
+        const size_t bytes = (std::min(first + windowRecords, recordCount) - first) * sizeof(Record);
+        detail::file_window& target = windows[window % 2];
+        return options.useMmap ? target.map(fd, first * sizeof(Record), bytes) : target.read(fd, first * sizeof(Record), bytes);
+    };
+
+    struct partial_t // keeps Acc = bool out of std::vector<bool>, chunks write their slot concurrently
+    {
+        Acc value;
+    };
+
+    bool isOk = true;
+    Acc result = init;
+    std::future<bool> pending;
+    if (windowCount > 0)
+    {
+        pending = std::async(std::launch::async, load, size_t(0));
+    }
+    for (size_t window = 0; window < windowCount && isOk; ++window)
+    {
+        isOk = pending.get();
+        if (!isOk)
+        {
+            break;
+        }
+        if (window + 1 < windowCount)
+        {// double buffering: the other window is free again since its compute finished last iteration
+            pending = std::async(std::launch::async, load, window + 1);
+        }
+
+        const Record* records = reinterpret_cast<const Record*>(windows[window % 2].data());
+        const size_t count = std::min((window + 1) * windowRecords, recordCount) - window * windowRecords;
+        const size_t chunkSize = parallel::chunk_size(pool, count, options.grain);
+
+        std::vector<partial_t> partials(parallel::chunk_count(count, chunkSize), partial_t{init});
+        parallel::for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+            Acc accum = init;
+            for (size_t i = begin; i < end; ++i)
+            {
+                accum = combineOp(std::move(accum), mapOp(records[i]));
+            }
+            partials[chunk].value = std::move(accum);
+        });
+        for (partial_t& partial : partials)
+        {
+            result = reduceOp(std::move(result), std::move(partial.value));
+        }
+        windows[window % 2].release();
+    }
+
+    if (pending.valid())
+    {
+        pending.wait();
+    }
+    close(fd);
+
+    if (isOk)
+    {
+        o_result = std::move(result);
+    }
+    return isOk;
+}
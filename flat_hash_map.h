@@ -0,0 +1,513 @@
+/*
+Open addressing hash map in the SwissTable layout: one allocation holding the slots and a control byte per slot.
+
+  flat_hash_map<uint64_t, uint32_t> counts;
+  ++counts[id];
+  if (uint32_t* count = counts.find(id)) { ... }
+  counts.erase(id);
+
+  LinearAllocator<flat_hash_map<uint64_t, uint32_t>::slot_type> allocator(buffer, bufferBytes);
+  flat_hash_map<uint64_t, uint32_t, flat_hash<uint64_t>, LinearAllocator<...>> table(allocator);
+
+A control byte is empty (0x80), deleted (0xFE) or the low 7 bits of the hash of the key in the slot (0x00..0x7F).
+Lookups load the 16 control bytes of a group in one SSE2 register and compare them with the 7 bits, so most probes
+touch a single cache line of control bytes and compare keys only for the (rare) false positives; a group with an
+empty byte ends the search. Groups are visited in triangular steps (+16, +32, +48 ...), which covers the whole
+power of two table. The first 15 control bytes are repeated after the last one so a group can start anywhere.
+
+The load factor stays under 7/8. erase leaves a tombstone only if a probe sequence may have walked past the slot
+while it was full (no empty byte within 16 slots on both sides), tombstones are dropped by the next rehash.
+
+Allocator is any object with T* allocate(n) / deallocate(T*, n) for T = slot_type: std::allocator or the stateful
+allocators of memory_allocators.h (LinearAllocator, ArenaAllocator, ConcurrentArenaAllocator). It is referenced, not
+copied, as a LinearAllocator owns its cursor; default constructed maps share one static Allocator. An allocator
+returning nullptr makes the insert fail (try_emplace returns nullptr) and leaves the map as it was.
+
+Hash must satisfy the hasher concept. flat_hash<K> (the default) runs std::hash through the murmur3 finalizer, the
+identity std::hash of integers would leave the 7 bits of sequential keys almost constant.
+
+https://abseil.io/about/design/swisstables
+*/
+#pragma once
+
+#include "reduce_by_key.h" // detail::mix_hash
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional> // std::hash
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new> // std::bad_alloc
+#include <tuple>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+///Hash functions usable by flat_hash_map: a copyable callable from const K& to 64 bits
+template<typename H, typename K>
+concept hasher = std::copy_constructible<H> && requires (const H& hash, const K& key) {
+    { hash(key) } -> std::convertible_to<uint64_t>;
+};
+
+///What flat_hash_map needs from an allocator of T (no rebind, no construct: slots are built in place)
+template<typename A, typename T>
+concept slot_allocator = requires (A& allocator, T* p, size_t n) {
+    { allocator.allocate(n) } -> std::same_as<T*>;
+    allocator.deallocate(p, n);
+};
+
+template<typename K>
+struct flat_hash
+{
+    uint64_t operator()(const K& key) const { return detail::mix_hash(static_cast<uint64_t>(std::hash<K>()(key))); }
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+using ctrl_t = int8_t;
+constexpr ctrl_t k_ctrlEmpty = -128;
+constexpr ctrl_t k_ctrlDeleted = -2;
+
+///16 control bytes, match* return a bit per byte
+class ctrl_group
+{
+public:
+    static constexpr size_t width = 16;
+
+#if defined(__SSE2__)
+    explicit ctrl_group(const ctrl_t* ctrl) : m_bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    uint32_t match(ctrl_t h2) const { return mask_of(_mm_cmpeq_epi8(m_bytes, _mm_set1_epi8(h2))); }
+    uint32_t match_empty() const { return mask_of(_mm_cmpeq_epi8(m_bytes, _mm_set1_epi8(k_ctrlEmpty))); }
+    ///Empty and deleted are the bytes with the high bit set
+    uint32_t match_empty_or_deleted() const { return mask_of(m_bytes); }
+
+private:
+    static uint32_t mask_of(__m128i bytes) { return static_cast<uint32_t>(_mm_movemask_epi8(bytes)); }
+
+    __m128i m_bytes;
+#else
+    explicit ctrl_group(const ctrl_t* ctrl) { std::memcpy(m_bytes, ctrl, width); }
+
+    uint32_t match(ctrl_t h2) const
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < width; ++i)
+        {
+            mask |= uint32_t(m_bytes[i] == h2) << i;
+        }
+        return mask;
+    }
+    uint32_t match_empty() const { return match(k_ctrlEmpty); }
+    uint32_t match_empty_or_deleted() const
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < width; ++i)
+        {
+            mask |= uint32_t(m_bytes[i] < 0) << i;
+        }
+        return mask;
+    }
+
+private:
+    ctrl_t m_bytes[width];
+#endif
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+template<typename K, typename V, typename Hash = flat_hash<K>, typename Allocator = std::allocator<std::pair<K, V>>>
+    requires std::equality_comparable<K> && hasher<Hash, K> && slot_allocator<Allocator, std::pair<K, V>>
+class flat_hash_map
+{
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using slot_type = std::pair<K, V>; // the key must not be modified through iterators
+    using hasher_type = Hash;
+    using allocator_type = Allocator;
+
+    template<bool IsConst>
+    class basic_iterator
+    {
+        using map_t = std::conditional_t<IsConst, const flat_hash_map, flat_hash_map>;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = slot_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst, const slot_type*, slot_type*>;
+        using reference = std::conditional_t<IsConst, const slot_type&, slot_type&>;
+
+        basic_iterator() = default;
+        basic_iterator(map_t* i_map, size_t i_index)
+            : m_map(i_map)
+            , m_index(i_index)
+        {
+            skip_free();
+        }
+        operator basic_iterator<true>() const requires (!IsConst) { return {m_map, m_index}; }
+
+        reference operator*() const { return m_map->m_slots[m_index]; }
+        pointer operator->() const { return m_map->m_slots + m_index; }
+        basic_iterator& operator++()
+        {
+            ++m_index;
+            skip_free();
+            return *this;
+        }
+        basic_iterator operator++(int)
+        {
+            basic_iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        friend bool operator==(const basic_iterator& lhs, const basic_iterator& rhs) { return lhs.m_index == rhs.m_index; }
+
+    private:
+        void skip_free()
+        {
+            while (m_index < m_map->m_capacity && m_map->m_ctrl[m_index] < 0)
+            {
+                ++m_index;
+            }
+        }
+
+        map_t* m_map = nullptr;
+        size_t m_index = 0;
+    };
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+public:
+    flat_hash_map() requires std::default_initializable<Allocator>
+        : flat_hash_map(default_allocator())
+    {
+    }
+    explicit flat_hash_map(Allocator& allocator, const Hash& hash = Hash())
+        : m_allocator(&allocator)
+        , m_hash(hash)
+    {
+    }
+    flat_hash_map(flat_hash_map&& other) noexcept
+        : m_allocator(other.m_allocator)
+        , m_hash(other.m_hash)
+        , m_slots(std::exchange(other.m_slots, nullptr))
+        , m_ctrl(std::exchange(other.m_ctrl, nullptr))
+        , m_capacity(std::exchange(other.m_capacity, 0))
+        , m_size(std::exchange(other.m_size, 0))
+        , m_growthLeft(std::exchange(other.m_growthLeft, 0))
+    {
+    }
+    flat_hash_map& operator=(flat_hash_map&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            m_allocator = other.m_allocator;
+            m_hash = other.m_hash;
+            m_slots = std::exchange(other.m_slots, nullptr);
+            m_ctrl = std::exchange(other.m_ctrl, nullptr);
+            m_capacity = std::exchange(other.m_capacity, 0);
+            m_size = std::exchange(other.m_size, 0);
+            m_growthLeft = std::exchange(other.m_growthLeft, 0);
+        }
+        return *this;
+    }
+    flat_hash_map(const flat_hash_map&) = delete;
+    flat_hash_map& operator=(const flat_hash_map&) = delete;
+    ~flat_hash_map()
+    {
+        release();
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    ///Number of slots, a power of 2 (0 before the first insert)
+    size_t capacity() const { return m_capacity; }
+
+    ///@return nullptr when the key isn't there
+    V* find(const K& key)
+    {
+        const size_t index = find_index(key, m_hash(key));
+        return index == k_npos ? nullptr : &m_slots[index].second;
+    }
+    const V* find(const K& key) const
+    {
+        const size_t index = find_index(key, m_hash(key));
+        return index == k_npos ? nullptr : &m_slots[index].second;
+    }
+    bool contains(const K& key) const { return find(key) != nullptr; }
+
+    ///Builds V from args if the key is missing, args may refer to values of this map
+    ///@return the value and whether it was inserted, nullptr if the allocator failed
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace(const K& key, Args&&... args)
+    {
+        const uint64_t hash = m_hash(key);
+        const size_t found = find_index(key, hash);
+        if (found != k_npos)
+        {
+            return {&m_slots[found].second, false};
+        }
+        if (m_growthLeft == 0)
+        {// args may point into the slots grow() moves and frees, the entry is built before
+            slot_type entry(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+            if (!grow())
+            {
+                return {nullptr, false};
+            }
+            return {construct_new(hash, std::move(entry)), true};
+        }
+        return {construct_new(hash, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...)), true};
+    }
+
+    ///@return nullptr if the allocator failed
+    V* insert_or_assign(const K& key, V value)
+    {
+        auto [found, isInserted] = try_emplace(key, std::move(value));
+        if (found != nullptr && !isInserted)
+        {
+            *found = std::move(value);
+        }
+        return found;
+    }
+
+    ///Value initializes missing keys, throws std::bad_alloc if the allocator fails
+    V& operator[](const K& key)
+    {
+        V* found = try_emplace(key).first;
+        if (found == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return *found;
+    }
+
+    ///@return false if the key wasn't there
+    bool erase(const K& key)
+    {
+        const size_t index = find_index(key, m_hash(key));
+        if (index == k_npos)
+        {
+            return false;
+        }
+        std::destroy_at(m_slots + index);
+        --m_size;
+
+        // a probe stops at the first group with an empty byte: if the 16 bytes starting here or the 16 ending here
+        // have one, no group spanning this slot was ever full and it can go back to empty
+        const size_t mask = m_capacity - 1;
+        const uint32_t emptyAfter = detail::ctrl_group(m_ctrl + index).match_empty();
+        const uint32_t emptyBefore = detail::ctrl_group(m_ctrl + ((index - detail::ctrl_group::width) & mask)).match_empty();
+        const bool wasNeverFull = emptyAfter != 0 && emptyBefore != 0
+            && size_t(std::countr_zero(emptyAfter)) + size_t(std::countl_zero(emptyBefore << 16)) < detail::ctrl_group::width;
+        set_ctrl(index, wasNeverFull ? detail::k_ctrlEmpty : detail::k_ctrlDeleted);
+        m_growthLeft += wasNeverFull;
+        return true;
+    }
+
+    void clear()
+    {
+        destroy_slots();
+        if (m_capacity > 0)
+        {
+            std::memset(m_ctrl, static_cast<uint8_t>(detail::k_ctrlEmpty), m_capacity + detail::ctrl_group::width - 1);
+        }
+        m_size = 0;
+        m_growthLeft = max_load(m_capacity);
+    }
+
+    ///Makes room for count keys without rehashing
+    ///@return false if the allocator failed
+    bool reserve(size_t count)
+    {
+        size_t capacity = std::max(m_capacity, detail::ctrl_group::width);
+        while (max_load(capacity) < count)
+        {
+            capacity *= 2;
+        }
+        return capacity == m_capacity || rehash(capacity);
+    }
+
+    iterator begin() { return {this, 0}; }
+    iterator end() { return {this, m_capacity}; }
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, m_capacity}; }
+
+private:
+    static constexpr size_t k_npos = size_t(-1);
+
+    static Allocator& default_allocator()
+    {
+        static Allocator s_allocator;
+        return s_allocator;
+    }
+
+    static size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+    static detail::ctrl_t h2_of(uint64_t hash) { return static_cast<detail::ctrl_t>(hash & 0x7F); }
+    static size_t h1_of(uint64_t hash) { return static_cast<size_t>(hash >> 7); }
+
+    ///Slots for the table then enough for the control bytes, so they share one allocation of slot_type
+    static size_t allocated_slots(size_t capacity)
+    {
+        const size_t ctrlBytes = capacity + detail::ctrl_group::width - 1;
+        return capacity + (ctrlBytes + sizeof(slot_type) - 1) / sizeof(slot_type);
+    }
+
+    size_t find_index(const K& key, uint64_t hash) const
+    {
+        if (m_capacity == 0)
+        {
+            return k_npos;
+        }
+        const size_t mask = m_capacity - 1;
+        const detail::ctrl_t h2 = h2_of(hash);
+        size_t position = h1_of(hash) & mask;
+        for (size_t step = detail::ctrl_group::width;; step += detail::ctrl_group::width)
+        {
+            const detail::ctrl_group group(m_ctrl + position);
+            for (uint32_t matches = group.match(h2); matches != 0; matches &= matches - 1)
+            {
+                const size_t index = (position + std::countr_zero(matches)) & mask;
+                if (m_slots[index].first == key)
+                {
+                    return index;
+                }
+            }
+            if (group.match_empty() != 0)
+            {
+                return k_npos;
+            }
+            position = (position + step) & mask;
+        }
+    }
+
+    ///First empty or deleted slot on the probe sequence of hash
+    size_t find_free(uint64_t hash) const
+    {
+        const size_t mask = m_capacity - 1;
+        size_t position = h1_of(hash) & mask;
+        for (size_t step = detail::ctrl_group::width;; step += detail::ctrl_group::width)
+        {
+            const uint32_t free = detail::ctrl_group(m_ctrl + position).match_empty_or_deleted();
+            if (free != 0)
+            {
+                return (position + std::countr_zero(free)) & mask;
+            }
+            position = (position + step) & mask;
+        }
+    }
+
+    void set_ctrl(size_t index, detail::ctrl_t value)
+    {
+        m_ctrl[index] = value;
+        if (index < detail::ctrl_group::width - 1)
+        {// the copy read by groups that wrap around
+            m_ctrl[m_capacity + index] = value;
+        }
+    }
+
+    // the key is missing and there is room for it
+    template<typename... SlotArgs>
+    V* construct_new(uint64_t hash, SlotArgs&&... slotArgs)
+    {
+        const size_t index = find_free(hash);
+        m_growthLeft -= m_ctrl[index] == detail::k_ctrlEmpty; // reusing a tombstone doesn't fill the table more
+        std::construct_at(m_slots + index, std::forward<SlotArgs>(slotArgs)...);
+        set_ctrl(index, h2_of(hash));
+        ++m_size;
+        return &m_slots[index].second;
+    }
+
+    ///Rehash in place when tombstones take most of the room, double otherwise
+    bool grow()
+    {
+        if (m_capacity > 0 && m_size <= max_load(m_capacity) / 2)
+        {
+            return rehash(m_capacity);
+        }
+        return rehash(std::max(detail::ctrl_group::width, m_capacity * 2));
+    }
+
+    bool rehash(size_t capacity)
+    {
+        slot_type* slots = m_allocator->allocate(allocated_slots(capacity));
+        if (slots == nullptr)
+        {
+            std::cerr << "flat_hash_map: allocation of " << capacity << " slots failed" << std::endl;
+            return false;
+        }
+        slot_type* oldSlots = m_slots;
+        detail::ctrl_t* oldCtrl = m_ctrl;
+        const size_t oldCapacity = m_capacity;
+
+        m_slots = slots;
+        m_ctrl = reinterpret_cast<detail::ctrl_t*>(slots + capacity);
+        m_capacity = capacity;
+        std::memset(m_ctrl, static_cast<uint8_t>(detail::k_ctrlEmpty), capacity + detail::ctrl_group::width - 1);
+        for (size_t i = 0; i < oldCapacity; ++i)
+        {
+            if (oldCtrl[i] >= 0)
+            {
+                const uint64_t hash = m_hash(oldSlots[i].first);
+                const size_t index = find_free(hash);
+                std::construct_at(m_slots + index, std::move(oldSlots[i]));
+                std::destroy_at(oldSlots + i);
+                set_ctrl(index, h2_of(hash));
+            }
+        }
+        m_growthLeft = max_load(capacity) - m_size;
+
+        if (oldSlots != nullptr)
+        {
+            m_allocator->deallocate(oldSlots, allocated_slots(oldCapacity));
+        }
+        return true;
+    }
+
+    void destroy_slots()
+    {
+        if constexpr (!std::is_trivially_destructible_v<slot_type>)
+        {
+            for (size_t i = 0; i < m_capacity; ++i)
+            {
+                if (m_ctrl[i] >= 0)
+                {
+                    std::destroy_at(m_slots + i);
+                }
+            }
+        }
+    }
+
+    void release()
+    {
+        if (m_slots != nullptr)
+        {
+            destroy_slots();
+            m_allocator->deallocate(m_slots, allocated_slots(m_capacity));
+            m_slots = nullptr;
+            m_ctrl = nullptr;
+            m_capacity = 0;
+            m_size = 0;
+            m_growthLeft = 0;
+        }
+    }
+
+    Allocator* m_allocator;
+    Hash m_hash;
+    slot_type* m_slots = nullptr;
+    detail::ctrl_t* m_ctrl = nullptr;
+    size_t m_capacity = 0;
+    size_t m_size = 0;
+    size_t m_growthLeft = 0;
+};
@@ -0,0 +1,274 @@
+/*
+Pull based coroutine streams. The producer only runs while the consumer asks for the next element and is suspended
+at its co_yield until then, so a chain of stages holds one element (one batch) per stage, whatever the input size:
+that's the backpressure, a fast producer can't run ahead of a slow consumer.
+
+generator<T> is synchronous and a range:
+
+  coro::generator<int> iota(int n) { for (int i = 0; i < n; ++i) co_yield i; }
+  for (int i : iota(10)) ...
+
+async_generator<T> can co_await between its yields (executor.schedule(), io_loop reads, other tasks), the consumer
+is a coroutine awaiting next(), which returns a pointer to the element or nullptr at the end:
+
+  coro::async_generator<std::vector<char>> blocks(coro::io_loop& loop, int fd);
+  coro::task<size_t> count(coro::async_generator<std::vector<char>> input)
+  {
+      size_t bytes = 0;
+      while (const std::vector<char>* block = co_await input.next()) bytes += block->size();
+      co_return bytes;
+  }
+
+Yielded values aren't copied: the consumer sees the producer's object (or the temporary of the co_yield expression),
+valid until it asks for the next one. Moving out of it is allowed, yielding a batch and clear()ing it after the
+co_yield reuses its capacity. Exceptions thrown by the producer are rethrown to the consumer.
+
+Both switch between producer and consumer with symmetric transfer, stages are plain function calls away from each
+other, no thread and no allocation per element. Frames go through promise_allocation like coro::task.
+*/
+#pragma once
+
+#include "task.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace coro
+{
+
+template<typename T>
+class generator
+{
+public:
+    using value_type = std::remove_cvref_t<T>;
+    using reference = std::remove_reference_t<T>&;
+    using pointer = std::remove_reference_t<T>*;
+
+    class promise_type : public promise_allocation
+    {
+    public:
+        generator get_return_object() noexcept { return generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+        void return_void() noexcept {}
+
+        std::suspend_always yield_value(std::remove_reference_t<T>& value) noexcept
+        {
+            m_value = std::addressof(value);
+            return {};
+        }
+        std::suspend_always yield_value(std::remove_reference_t<T>&& value) noexcept
+        {
+            m_value = std::addressof(value);
+            return {};
+        }
+
+        ///No co_await in a synchronous generator, use async_generator
+        template<typename U>
+        void await_transform(U&&) = delete;
+
+        reference value() const { return *m_value; }
+        void rethrow_if_failed() const
+        {
+            if (m_exception)
+            {
+                std::rethrow_exception(m_exception);
+            }
+        }
+
+    private:
+        pointer m_value = nullptr;
+        std::exception_ptr m_exception;
+    };
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = generator::value_type;
+        using reference = generator::reference;
+        using pointer = generator::pointer;
+
+        iterator() = default;
+        explicit iterator(std::coroutine_handle<promise_type> handle)
+            : m_handle(handle)
+        {}
+
+        reference operator*() const { return m_handle.promise().value(); }
+        pointer operator->() const { return std::addressof(m_handle.promise().value()); }
+
+        iterator& operator++()
+        {
+            advance(m_handle);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator& it, std::default_sentinel_t) { return !it.m_handle || it.m_handle.done(); }
+
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    generator() = default;
+    explicit generator(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {}
+    generator(generator&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {}
+    generator& operator=(generator&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    generator(const generator&) = delete;
+    generator& operator=(const generator&) = delete;
+    ~generator() { destroy(); }
+
+    ///Runs the producer up to its first co_yield, single pass: begin() can only be called once
+    iterator begin()
+    {
+        advance(m_handle);
+        return iterator(m_handle);
+    }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    static void advance(std::coroutine_handle<promise_type> handle)
+    {
+        handle.resume();
+        if (handle.done())
+        {
+            handle.promise().rethrow_if_failed();
+        }
+    }
+
+    void destroy()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template<typename T>
+class async_generator
+{
+public:
+    using value_type = std::remove_cvref_t<T>;
+    using pointer = std::remove_reference_t<T>*;
+
+    class promise_type : public promise_allocation
+    {
+        ///Suspends the producer and hands the thread back to the consumer waiting in next()
+        struct yield_awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept { return handle.promise().m_consumer; }
+            void await_resume() noexcept {}
+        };
+
+    public:
+        async_generator get_return_object() noexcept { return async_generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        yield_awaiter final_suspend() noexcept
+        {
+            m_value = nullptr;
+            return {};
+        }
+        void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+        void return_void() noexcept {}
+
+        yield_awaiter yield_value(std::remove_reference_t<T>& value) noexcept
+        {
+            m_value = std::addressof(value);
+            return {};
+        }
+        yield_awaiter yield_value(std::remove_reference_t<T>&& value) noexcept
+        {
+            m_value = std::addressof(value);
+            return {};
+        }
+
+        void set_consumer(std::coroutine_handle<> consumer) { m_consumer = consumer; }
+        pointer value() const
+        {
+            if (m_exception)
+            {
+                std::rethrow_exception(m_exception);
+            }
+            return m_value;
+        }
+
+    private:
+        pointer m_value = nullptr;
+        std::coroutine_handle<> m_consumer;
+        std::exception_ptr m_exception;
+    };
+
+    async_generator() = default;
+    explicit async_generator(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {}
+    async_generator(async_generator&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {}
+    async_generator& operator=(async_generator&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    async_generator(const async_generator&) = delete;
+    async_generator& operator=(const async_generator&) = delete;
+    ~async_generator() { destroy(); }
+
+    ///Resumes the producer until its next co_yield, the awaiting coroutine gets the element or nullptr once the
+    ///producer returned. The producer may finish the step on another thread, the consumer follows it there.
+    auto next() noexcept
+    {
+        struct awaiter
+        {
+            std::coroutine_handle<promise_type> m_handle;
+
+            bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept
+            {
+                m_handle.promise().set_consumer(consumer);
+                return m_handle;
+            }
+            pointer await_resume() const { return m_handle ? m_handle.promise().value() : nullptr; }
+        };
+        return awaiter{m_handle};
+    }
+
+private:
+    void destroy()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+}//coro
@@ -1,517 +1,512 @@
 /**
 https://en.cppreference.com/w/cpp/memory/align
 **/
+#include "memory_allocators.h"
+#include "arena_snapshot.h"
+#include "string_interner.h"
+#include "benchmark.h"
+
 #include <vector>
-#include <algorithm> // std::find
-#include <numeric> // std::accumulate
-#include <memory> // malloc
+#include <bit> // std::bit_ceil
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <algorithm> // std::shuffle
+#include <numeric> // std::iota
+#include <memory> // std::unique_ptr
 #include <iostream> // std::cout
 #include <cassert>
-#include <chrono>
-#include <sstream>
+#include <random>
 
-template<typename TClock = std::chrono::high_resolution_clock>
-class Timer
+template<typename T, typename Allocator>
+bool unit_test_allocator(Allocator& allocator)
 {
-public:
-    using chrono_t = TClock;
-    using timepoint = typename chrono_t::time_point;
-    using duration = typename chrono_t::duration;
-
-    using secondsf = std::chrono::duration<float>;
-    using millisecondsf = std::chrono::duration<float, std::milli>;
+    T initialValue = T(0);
+    T* a = allocator.allocate(1);       // space for one int
+    allocator.construct(a, initialValue); // construct the int
+    std::cout << a[0] << '\n';
+    allocator.destroy(a);           
+    allocator.deallocate(a, 1);        // deallocate space for one int
+ 
+    T* s = allocator.allocate(2); // space for 2 strings
+ 
+    allocator.construct(s, initialValue);
+    allocator.construct(s + 1, initialValue);
+ 
+    std::cout << s[0] << ' ' << s[1] << '\n';
+ 
+    allocator.destroy(s);
+    allocator.destroy(s + 1);
+    allocator.deallocate(s, 2);
 
-protected:
-    timepoint m_begin;
-    std::string m_tag;
+    return true;
+}
+template<typename T, typename Allocator, size_t TestCount = 10>
+bool unit_test_allocator_vector(Allocator& allocator)
+{
+    std::vector<T, Allocator> container(allocator);
 
-public:
-    Timer(const std::string& tag = "")
-        : m_begin(Now())
-        , m_tag(tag)
-    {}
-    ~Timer()
+    const int k_count = TestCount;
+    container.reserve(k_count);
+    for(int i=0; i<k_count; ++i)
     {
-        auto elapsedDuration = GetElapsed();
-        auto humanReadableDuration = [](const duration& t) {
-            std::ostringstream ostr;
-            if (t > std::chrono::seconds(1))
-            {
-                ostr << std::chrono::duration_cast<secondsf>(t).count() << "s";
-            }
-            else if (t > std::chrono::milliseconds(1))
-            {
-                ostr << std::chrono::duration_cast<millisecondsf>(t).count() << "ms";
-            }
-            else if (t > std::chrono::microseconds(1))
-            {
-                ostr << std::chrono::duration_cast<std::chrono::microseconds>(t).count() << "us";
-            }
-            else
-            {
-                ostr << std::chrono::duration_cast<std::chrono::nanoseconds>(t).count() << "ns";
-            }
-
-            return ostr.str();
-        };
-        std::cout << "Duration(" << m_tag << "): " << humanReadableDuration(elapsedDuration) << std::endl;
+        container.push_back(T(i));        
     }
+    std::cout << "container size: " << container.size() << std::endl;
 
-    static timepoint Now() { return chrono_t::now(); }
+    return true;
+}
 
-    void Start()
-    {
-        m_begin = Now();
-    }
+class Dummy
+{
+    int a = 0;
+    int b = 0;
+    std::string str = "";
 
-    duration GetElapsed() const
+    template<typename T>
+    void initialize(T t)
     {
-        return Now() - m_begin;
+        a = t;
+        b = t;
+        str = "test";
     }
 
-    duration GetElapsedAndReset() const
+public:
+    Dummy() {}
+    Dummy(int d = -1) : a(d), b(d), str(std::to_string(d)) {}
+
+    friend std::ostream& operator<<(std::ostream& os, const Dummy& d);
+    std::ostream& operator<<(std::ostream& os)
     {
-        auto beginT = m_begin;
-        m_begin = Now();
-        return Now() - beginT;
+        os << "Dummy_"<< a << "_" << b << "_" << str;
+        return os;
     }
-
 };
 
-template<class T>
-class IAllocator {
-public:
-    using value_type = T;
-
-public:
-    virtual ~IAllocator() = default;
-
-    virtual T* allocate(int n) = 0;
-    virtual void deallocate(T* p, int n) = 0;
+std::ostream& operator<<(std::ostream& os, const Dummy& d)
+{
+    os << "Dummy_"<< d.a << "_" << d.b << "_" << d.str;
+    return os;
+}
 
-    virtual void construct(T* p, const T& v) = 0;
-    virtual void destroy(T* p) = 0;
-};
 
-template<typename T>
-class DummyAllocator : public IAllocator<T>
+struct Particle
 {
-    size_t m_countAllocs = 0;
-    size_t m_countConstructs = 0;
+    float position[3] = {0.f, 0.f, 0.f};
+    float velocity[3] = {0.f, 0.f, 0.f};
 
-public:
-    DummyAllocator() {}
-    ~DummyAllocator()
-    {
-        assert(m_countAllocs == 0);
-        std::cout << "Allocations: " << m_countAllocs << std::endl;
-        std::cout << "Constructs: " << m_countConstructs << std::endl;
-    }
+    Particle() = default;
+    explicit Particle(float v) : position{v, v, v}, velocity{1.f, 0.5f, 0.25f} {}
 
-    T* allocate(int n)
+    void Update(float dt)
     {
-        T* alloc = reinterpret_cast<T*>(malloc(n * sizeof(T)));
-        if (alloc)
-        {
-            m_countAllocs += n;
-        }
-        return alloc;
+        position[0] += velocity[0] * dt;
+        position[1] += velocity[1] * dt;
+        position[2] += velocity[2] * dt;
     }
-    void deallocate(T* p, int n)
-    {
-        free(p);
-        m_countAllocs -= n;
-    }
-
-    void construct(T* p, const T& v)
-    {
-        p = new (p)T(v);
-        m_countConstructs++;
-    }
-    void destroy(T* p)
-    {
-        p->~T();
-        m_countConstructs--;
-    }
-
 };
 
-template<typename T>
-class LinearAllocator : public IAllocator<T>
+// Creates 2 * count objects, destroys a random half (so the heap is fragmented the way a long running
+// process would leave it) and then times iterating all the live objects.
+void benchmark_factory_iteration(bench::runner& runner, size_t count)
 {
-    T* m_buffer;
-    size_t m_bufferSize;
-    T* m_next = nullptr;
+    std::mt19937 gen(42);
+    std::vector<size_t> order(count * 2);
+    std::iota(std::begin(order), std::end(order), 0);
+    std::shuffle(std::begin(order), std::end(order), gen);
 
-    size_t m_countAllocs = 0;
-    size_t m_countConstructs = 0;
-
-public:
-    LinearAllocator(void* buffer, size_t bufferBytes)
-        : m_buffer(reinterpret_cast<T*>(buffer))
-        , m_bufferSize(bufferBytes / sizeof(T))
-        , m_next(m_buffer)
-    {
-    }
-    ~LinearAllocator()
+    float checksum = 0.f;
     {
-        assert(m_countAllocs == 0);
-        std::cout << "Allocations: " << (m_next - m_buffer) / sizeof(T)  << std::endl;
-        std::cout << "Constructs: " << m_countConstructs << std::endl;
-    }
-
-    T* allocate(int n)
-    {
-        T* alloc = nullptr;
-
-        if (m_next + n < m_buffer + m_bufferSize)
+        std::vector<std::unique_ptr<Particle>> objects;
+        objects.reserve(count * 2);
+        for (size_t i = 0; i < count * 2; ++i)
         {
-            alloc = m_next;
-            m_next += n;
-            m_countAllocs += n;
+            objects.push_back(std::unique_ptr<Particle>(new Particle(float(i))));
         }
-        else
+        for (size_t i = 0; i < count; ++i)
         {
-            std::cerr << "No memory available" << std::endl;
+            objects[order[i]].reset();
         }
-        return alloc;
-    }
-    void deallocate(T* p, int n)
-    {
-        //free(p);
-        m_countAllocs -= n;
-    }
+        objects.erase(std::remove(std::begin(objects), std::end(objects), nullptr), std::end(objects));
 
-    void construct(T* p, const T& v)
-    {
-        p = new (p)T(v);
-        m_countConstructs++;
+        runner.run("vector<unique_ptr> iterate", [&objects]() {
+            for (const auto& object : objects)
+            {
+                object->Update(0.016f);
+            }
+        });
+        checksum += objects.front()->position[0];
     }
-    void destroy(T* p)
     {
-        p->~T();
-        m_countConstructs--;
-    }
-};
+        Factory<Particle> factory;
+        factory.Reserve(count * 2);
+        std::vector<FactoryHandle> handles;
+        handles.reserve(count * 2);
+        for (size_t i = 0; i < count * 2; ++i)
+        {
+            handles.push_back(factory.Create(float(i)));
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            factory.Destroy(handles[order[i]]);
+        }
 
-template<size_t Capacity, size_t Alignment>
-class arena_naive
-{
-    char m_buffer[Capacity + Alignment];
-    
-    char* m_alignedPtr0;
-    char* m_nextPtr;
-protected:
-    static inline intptr_t align(intptr_t n)
-    {
-        return (n + (Alignment-1)) & ~(Alignment-1);
-    }
-    static inline uintptr_t align(uintptr_t n)
-    {
-        return (n + (Alignment-1)) & ~(Alignment-1);
+        runner.run("slot map factory iterate", [&factory]() {
+            for (Particle& object : factory)
+            {
+                object.Update(0.016f);
+            }
+        });
+        checksum += factory.begin()->position[0];
     }
+    std::cout << "checksum: " << checksum << std::endl;
+}
 
+///The same allocator behind IAllocator<char>, one virtual call per operation
+template<Allocator A>
+class virtual_allocator : public IAllocator<char>
+{
 public:
-    arena_naive()
-    : m_alignedPtr0(reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(m_buffer))))
-    , m_nextPtr(m_alignedPtr0)
-    {
-        static_assert((Alignment & 0x01) == 0, "Alignment has to be a power of 2");
-    }
-    
-    char* allocate(size_t n)
-    {
-        const size_t alignedSize = align(n);
-        if (m_nextPtr + alignedSize < m_alignedPtr0 + Capacity)
-        {
-            char* alloc = m_nextPtr;
-            m_nextPtr += alignedSize;
-            return alloc;
-        }
-        
-        std::cerr << "No memory available in the arena" << std::endl;
-        //assert(false);
-        
-        return static_cast<char*>(::operator new(n));
-    }
-    
-    void deallocate(char* p, size_t n)
+    char* allocate(int n) override { return m_allocator.allocate(static_cast<size_t>(n)); }
+    void deallocate(char* p, int n) override { m_allocator.deallocate(p, static_cast<size_t>(n)); }
+
+    void construct(char* p, const char& v) override { new (p) char(v); }
+    void destroy(char*) override {}
+
+private:
+    A m_allocator;
+};
+
+// batches of 64 allocations freed in reverse order (what a bump allocator can take back)
+template<typename A>
+void allocate_free(A& allocator, const std::vector<uint32_t>& sizes, std::vector<char*>& blocks)
+{
+    constexpr size_t k_batch = 64;
+    for (size_t first = 0; first < sizes.size(); first += k_batch)
     {
-        if (m_alignedPtr0 <= p && p <= m_alignedPtr0 + Capacity)
+        for (size_t i = first; i < first + k_batch; ++i)
         {
-            const size_t alignedSize = align(n);
-            if (p + alignedSize == m_nextPtr) // 
-            {
-                m_nextPtr = p;
-            }
+            blocks[i] = allocator.allocate(sizes[i]);
+            blocks[i][0] = char(i);
         }
-        else
+        for (size_t i = first + k_batch; i-- > first;)
         {
-            std::cerr << "cannot deallocate memory which doesn't below to the arena" << std::endl;
+            allocator.deallocate(blocks[i], sizes[i]);
         }
     }
-};
+    bench::do_not_optimize(blocks.data());
+}
 
+// allocate/free latency of A called directly (inlined) and through IAllocator<char>
+template<Allocator A>
+void benchmark_allocator(bench::runner& runner, const std::string& name, const std::vector<uint32_t>& sizes)
+{
+    std::vector<char*> blocks(sizes.size());
+    bench::settings setup = runner.get_config().defaults;
+    setup.iterations = 100;
+
+    auto allocator = std::make_unique<A>();
+    const bench::result& direct = runner.run(name + " direct", setup, [&]() {
+        allocate_free(*allocator, sizes, blocks);
+    });
+
+    std::unique_ptr<IAllocator<char>> virtualAllocator = std::make_unique<virtual_allocator<A>>();
+    // read through volatile so the compiler can't see the dynamic type and devirtualize
+    IAllocator<char>* volatile opaque = virtualAllocator.get();
+    IAllocator<char>& base = *opaque;
+    const bench::result& indirect = runner.run(name + " IAllocator", setup, [&]() {
+        allocate_free(base, sizes, blocks);
+    });
+
+    const double operations = 2.0 * sizes.size();
+    std::cout << name << ": " << direct.stats.medianNs / operations << " ns per allocate/free direct, "
+              << indirect.stats.medianNs / operations << " ns through IAllocator" << std::endl;
+}
 
-template<size_t Capacity, size_t Alignment>
-class arena_reusing
+void benchmark_allocators(bench::runner& runner)
 {
-    char m_buffer[Capacity + Alignment];
-    
-    char* m_alignedPtr0;
-    char* m_nextPtr;
+    std::vector<uint32_t> sizes(64 * 16);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> dist(8, 512);
+    std::generate(std::begin(sizes), std::end(sizes), [&]() { return dist(gen); });
+
+    benchmark_allocator<mallocator>(runner, "mallocator", sizes);
+    benchmark_allocator<arena_naive<1 << 20, 16>>(runner, "arena_naive", sizes);
+    benchmark_allocator<fallback<arena_naive<16 * 1024, 16>, mallocator>>(runner, "fallback<arena_naive<16K>, mallocator>", sizes);
+    benchmark_allocator<segregator<256, free_list<mallocator, 256>, mallocator>>(runner, "segregator<256, free_list, mallocator>", sizes);
+}
 
-    std::vector<std::pair<char*, size_t>> m_freed;
+// id -> name table that lives entirely in a relocatable_arena: open addressing, Fibonacci hashing, id 0 is empty
+struct name_entry
+{
+    uint64_t id = 0;
+    offset_ptr<const char> name;
+    uint64_t length = 0;
+};
 
-protected:
-    static inline intptr_t align(intptr_t n)
-    {
-        return (n + (Alignment-1)) & ~(Alignment-1);
-    }
-    static inline uintptr_t align(uintptr_t n)
-    {
-        return (n + (Alignment-1)) & ~(Alignment-1);
-    }
+struct name_table
+{
+    offset_array<name_entry> buckets;
+    uint64_t count = 0;
+    uint32_t shift = 64;
+};
 
-public:
-    arena_reusing()
-    : m_alignedPtr0(reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(m_buffer))))
-    , m_nextPtr(m_alignedPtr0)
+size_t name_bucket(const name_table& table, uint64_t id)
+{
+    return static_cast<size_t>((id * 11400714819323198485ull) >> table.shift);
+}
+
+std::string make_name(uint64_t id)
+{
+    return "symbol_" + std::to_string(id);
+}
+
+// ids 1..count, 3/4 max load
+name_table* build_name_table(relocatable_arena& arena, size_t count)
+{
+    name_table* table = arena.create<name_table>();
+    const size_t bucketCount = std::bit_ceil(count + count / 3 + 1);
+    table->buckets = arena.create_array<name_entry>(bucketCount);
+    table->shift = 64 - std::countr_zero(bucketCount);
+    if (table->buckets.empty())
     {
-        static_assert((Alignment & 0x01) == 0, "Alignment has to be a power of 2");
+        return nullptr;
     }
-    
-    char* allocate(size_t n)
+    const size_t mask = bucketCount - 1;
+    for (uint64_t id = 1; id <= count; ++id)
     {
-        const size_t alignedSize = align(n);
-        if (m_nextPtr + alignedSize < m_alignedPtr0 + Capacity)
+        const std::string name = make_name(id);
+        char* text = arena.allocate(name.size() + 1);
+        if (text == nullptr)
         {
-            char* alloc = m_nextPtr;
-            m_nextPtr += alignedSize;
-            return alloc;
+            return nullptr;
         }
-        else if (!m_freed.empty())
-        {// compact
-            auto it = std::find_if(std::begin(m_freed), std::end(m_freed), [alignedSize](const std::pair<char*, size_t>& data) {
-                return data.second >= alignedSize;
-            });
-            if (it != std::end(m_freed))
-            {
-                it->second -= alignedSize;
-                char* alloc = it->first;
-                if (it->second == 0)
-                {
-                    std::iter_swap(it, std::begin(m_freed) + m_freed.size());
-                    m_freed.pop_back();
-                }
-            }
+        std::memcpy(text, name.c_str(), name.size() + 1);
+
+        size_t bucket = name_bucket(*table, id);
+        while (table->buckets[bucket].id != 0)
+        {
+            bucket = (bucket + 1) & mask;
         }
-        
-        std::cerr << "No memory available in the arena" << std::endl;        
-        char* alloc = static_cast<char*>(::operator new(n + Alignment));
-        const intptr_t allocPos = reinterpret_cast<intptr_t>(alloc);
-        const intptr_t alignedPos = align(allocPos);
-        assert(alignedPos < allocPos + n + Alignment);
-        return reinterpret_cast<char*>(alignedPos);
+        name_entry& entry = table->buckets[bucket];
+        entry.id = id;
+        entry.name = text;
+        entry.length = name.size();
     }
-    
-    void deallocate(char* p, size_t n)
+    table->count = count;
+    return table;
+}
+
+std::string_view find_name(const name_table& table, uint64_t id)
+{
+    const size_t mask = table.buckets.size() - 1;
+    for (size_t bucket = name_bucket(table, id);; bucket = (bucket + 1) & mask)
     {
-        if (m_alignedPtr0 <= p && p <= m_alignedPtr0 + Capacity)
+        const name_entry& entry = table.buckets[bucket];
+        if (entry.id == id)
         {
-            const size_t alignedSize = align(n);
-            if (p + alignedSize == m_nextPtr) // 
-            {
-                m_nextPtr = p;
-            }
-            else
-            {
-                m_freed.emplace_back(p, n);
-            }
+            return std::string_view(entry.name.get(), entry.length);
         }
-        else
+        if (entry.id == 0)
         {
-            std::cerr << "cannot deallocate memory which doesn't below to the arena" << std::endl;
+            return {};
         }
     }
-};
+}
 
-template<typename T>
-class ArenaAllocator : public IAllocator<T>
+// what a warm start costs: rebuilding the table (arena or std::unordered_map<uint64_t, std::string>) against mapping
+// the snapshot saved by the previous run. The file stays in the page cache between samples, as it would between
+// restarts of a service; a cold cache adds the read of the touched pages only, not of the whole file.
+void benchmark_snapshot(bench::runner& runner, size_t count)
 {
-    T* m_buffer;
-    size_t m_bufferSize;
-    T* m_next = nullptr;
-
-    std::vector<std::pair<T*, size_t>> m_freed;
-
-public:
-    ArenaAllocator(void* buffer, size_t bufferBytes)
-        : m_buffer(reinterpret_cast<T*>(buffer))
-        , m_bufferSize(bufferBytes / sizeof(T))
-        , m_next(m_buffer)
-    {
-    }
-    ~ArenaAllocator()
-    {
-        const size_t freed = std::accumulate(std::begin(m_freed), std::end(m_freed), 0,
-            [](size_t accum, const std::pair<T*, size_t>& data) {
-                return accum + data.second; 
-        });
-        if (freed != m_bufferSize)
+    const std::string path = (std::filesystem::temp_directory_path() / "name_table.arena").string();
+    bench::settings setup = runner.get_config().defaults;
+    setup.warmup = 1;
+    setup.samples = 5;
+
+    std::vector<uint64_t> lookups(1000000);
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<uint64_t> dist(1, count);
+    std::generate(std::begin(lookups), std::end(lookups), [&]() { return dist(gen); });
+    auto sum_lengths = [&](auto&& find) {
+        size_t total = 0;
+        for (const uint64_t id : lookups)
         {
-            std::cerr << "Freed memory: " << freed << " / " << m_bufferSize << std::endl;
+            total += find(id).size();
         }
-    }
-
-    T* allocate(int n)
-    {
-        T* alloc = nullptr;
+        return total;
+    };
 
-        if (m_next + n < m_buffer + m_bufferSize)
+    runner.run("rebuild std::unordered_map", setup, [&]() {
+        std::unordered_map<uint64_t, std::string> names;
+        names.reserve(count);
+        for (uint64_t id = 1; id <= count; ++id)
         {
-            alloc = m_next;
-            m_next += n;
+            names.emplace(id, make_name(id));
         }
-        else if (!m_freed.empty())
+        bench::do_not_optimize(names.size());
+    });
+    runner.run("rebuild relocatable_arena", setup, [&]() {
+        relocatable_arena arena(size_t(1) << 32);
+        bench::do_not_optimize(build_name_table(arena, count));
+    });
+
+    relocatable_arena arena(size_t(1) << 32);
+    const name_table* table = build_name_table(arena, count);
+    if (table == nullptr || !arena.save(path, table))
+    {
+        std::cerr << "name table snapshot failed" << std::endl;
+        return;
+    }
+    const size_t expected = sum_lengths([&](uint64_t id) { return find_name(*table, id); });
+    std::cout << "snapshot: " << count << " names, " << arena.used() / (1024 * 1024) << " MiB" << std::endl;
+
+    runner.run("save snapshot", setup, [&]() {
+        bench::do_not_optimize(arena.save(path, table));
+    });
+    runner.run("mmap snapshot + 1 lookup", setup, [&]() {
+        arena_snapshot snapshot;
+        const name_table* mapped = snapshot.open(path) ? snapshot.root<name_table>() : nullptr;
+        bench::do_not_optimize(mapped != nullptr ? find_name(*mapped, count / 2).size() : 0);
+    });
+    size_t mappedTotal = 0;
+    runner.run("mmap snapshot + 1M lookups", setup, [&]() {
+        arena_snapshot snapshot;
+        const name_table* mapped = snapshot.open(path) ? snapshot.root<name_table>() : nullptr;
+        mappedTotal = mapped != nullptr ? sum_lengths([&](uint64_t id) { return find_name(*mapped, id); }) : 0;
+        bench::do_not_optimize(mappedTotal);
+    });
+    if (mappedTotal != expected)
+    {
+        std::cerr << "snapshot lookups differ from the built table" << std::endl;
+    }
+    runner.run("in memory 1M lookups", setup, [&]() {
+        bench::do_not_optimize(sum_lengths([&](uint64_t id) { return find_name(*table, id); }));
+    });
+    std::filesystem::remove(path);
+}
+
+// tokens as they come out of a parser: short UTF-8 words and Base36 ids, some past the 15 bytes of the SSO buffer
+std::vector<std::string> make_tokens(size_t distinct)
+{
+    std::vector<std::string> tokens(distinct);
+    std::mt19937_64 gen(7);
+    for (size_t i = 0; i < distinct; ++i)
+    {
+        if (i % 2 == 0)
         {
-            auto& freedData =  m_freed.back();
-            alloc = freedData.first;
-            freedData.first  += n;
-            freedData.second -= n;
-            if (freedData.second == 0)
+            std::string id = "ID-";
+            for (uint64_t value = gen(); value != 0; value /= 36)
             {
-                m_freed.pop_back();
+                id += "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[value % 36];
             }
+            tokens[i] = id;
         }
         else
         {
-            std::cerr << "No memory available" << std::endl;
+            tokens[i] = "d\xc3\xa9j\xc3\xa0_vu_" + std::to_string(i);
         }
-        return alloc;
     }
-    void deallocate(T* p, int n)
-    {
-        m_freed.emplace_back(p, n);
-        // std::sort(std::begin(m_freed), std::end(m_freed), [](const std::pair<T*, size_t>& d1, const std::pair<T*, size_t>& d2) {
-        //     return d1.second < d2.second;
-        // });
-    }
-
-    void construct(T* p, const T& v)
-    {
-        p = new (p)T(v);
-    }
-    void destroy(T* p)
-    {
-        p->~T();
-    }
-};
-
+    return tokens;
+}
 
-template<typename T, typename TPointer  = std::unique_ptr<T>, typename Allocator = std::allocator<T>>
-class Factory
+// count occurrences drawn from distinct tokens (skewed: low indices are frequent), stored as std::string each or
+// interned, then compared, and looked up from every hardware thread at once
+void benchmark_interner(bench::runner& runner, size_t count, size_t distinct)
 {
-    Allocator& m_allocator;
-
-public:
-    using pointer_t = TPointer;
-    static_assert(std::is_same<T*, TPointer>::value == false, "Pointer type must be some kind of smart pointer");
-
-public:
-    Factory(Allocator& allocator)
-    : m_allocator(allocator)
-    {}
-
-    template<typename... Args>
-    pointer_t Create(Args... args)
+    const std::vector<std::string> tokens = make_tokens(distinct);
+    std::vector<uint32_t> picks(count);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::generate(std::begin(picks), std::end(picks), [&]() {
+        const double u = dist(gen);
+        return static_cast<uint32_t>(u * u * u * double(distinct - 1));
+    });
+    bench::settings setup = runner.get_config().defaults;
+    setup.warmup = 1;
+    setup.samples = 5;
+
+    std::vector<std::string> strings;
+    runner.run("std::string per occurrence", setup, [&]() {
+        strings.assign(count, std::string());
+        for (size_t i = 0; i < count; ++i)
+        {
+            strings[i] = tokens[picks[i]];
+        }
+        bench::do_not_optimize(strings.data());
+    });
+    std::unique_ptr<string_interner> interner;
+    std::vector<string_interner::symbol> symbols(count);
+    runner.run("string_interner", setup, [&]() {
+        interner = std::make_unique<string_interner>(size_t(64) << 20);
+        for (size_t i = 0; i < count; ++i)
+        {
+            symbols[i] = interner->intern(tokens[picks[i]]);
+        }
+        bench::do_not_optimize(symbols.data());
+    });
+    for (size_t i = 0; i < count; ++i)
     {
-        T* object = m_allocator.allocate(1);
-        m_allocator.contruct(object, args...);
+        if (interner->view(symbols[i]) != strings[i])
+        {
+            std::cerr << "interned string differs at " << i << std::endl;
+            break;
+        }
     }
 
-    void Destroy(pointer_t object)
+    size_t stringBytes = count * sizeof(std::string);
+    for (const std::string& text : strings)
     {
-        m_allocator.destroy(object);
-        m_allocator.deallocate(object);
+        stringBytes += text.capacity() > 15 ? text.capacity() + 1 : 0;
     }
+    const size_t internedBytes = count * sizeof(string_interner::symbol) + interner->memory_bytes();
+    std::cout << "string_interner: " << interner->size() << " symbols, " << internedBytes / 1024 << " KiB against "
+              << stringBytes / 1024 << " KiB of std::string (heap blocks without malloc headers)" << std::endl;
 
-};
-
-template<typename T, typename Allocator>
-bool unit_test_allocator(Allocator& allocator)
-{
-    T initialValue = T(0);
-    T* a = allocator.allocate(1);       // space for one int
-    allocator.construct(a, initialValue); // construct the int
-    std::cout << a[0] << '\n';
-    allocator.destroy(a);           
-    allocator.deallocate(a, 1);        // deallocate space for one int
- 
-    T* s = allocator.allocate(2); // space for 2 strings
- 
-    allocator.construct(s, initialValue);
-    allocator.construct(s + 1, initialValue);
- 
-    std::cout << s[0] << ' ' << s[1] << '\n';
- 
-    allocator.destroy(s);
-    allocator.destroy(s + 1);
-    allocator.deallocate(s, 2);
-
-    return true;
-}
-template<typename T, typename Allocator, size_t TestCount = 10>
-bool unit_test_allocator_vector(Allocator& allocator)
-{
-    std::vector<T, Allocator> container(allocator);
-
-    const int k_count = TestCount;
-    container.reserve(k_count);
-    for(int i=0; i<k_count; ++i)
-    {
-        container.push_back(T(i));        
-    }
-    std::cout << "container size: " << container.size() << std::endl;
+    const std::string& needle = tokens[0];
+    const string_interner::symbol needleSymbol = interner->find(needle);
+    runner.run("std::string ==", setup, [&]() {
+        bench::do_not_optimize(std::count(std::begin(strings), std::end(strings), needle));
+    });
+    runner.run("symbol ==", setup, [&]() {
+        bench::do_not_optimize(std::count(std::begin(symbols), std::end(symbols), needleSymbol));
+    });
 
-    return true;
+    const size_t threadCount = std::max(2u, std::thread::hardware_concurrency());
+    runner.run("string_interner::find 1 thread", setup, [&]() {
+        size_t found = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            found += interner->find(tokens[picks[i]]) == symbols[i];
+        }
+        bench::do_not_optimize(found);
+    });
+    runner.run("string_interner::find " + std::to_string(threadCount) + " threads", setup, [&]() {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                size_t found = 0;
+                for (size_t i = t; i < count; i += threadCount)
+                {
+                    found += interner->find(tokens[picks[i]]) == symbols[i];
+                }
+                bench::do_not_optimize(found);
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    });
 }
 
-class Dummy
+int main(int argc, char** argv)
 {
-    int a = 0;
-    int b = 0;
-    std::string str = "";
+    bench::runner runner(bench::config::from_args(argc, argv));
 
-    template<typename T>
-    void initialize(T t)
-    {
-        a = t;
-        b = t;
-        str = "test";
-    }
-
-public:
-    Dummy() {}
-    Dummy(int d = -1) : a(d), b(d), str(std::to_string(d)) {}
-
-    friend std::ostream& operator<<(std::ostream& os, const Dummy& d);
-    std::ostream& operator<<(std::ostream& os)
-    {
-        os << "Dummy_"<< a << "_" << b << "_" << str;
-        return os;
-    }
-};
-
-std::ostream& operator<<(std::ostream& os, const Dummy& d)
-{
-    os << "Dummy_"<< d.a << "_" << d.b << "_" << d.str;
-    return os;
-}
-
-
-int main(int, char**)
-{
     using value_t = Dummy;
     std::cout << "Sizeof<T>: " << sizeof(value_t) << std::endl;
 
@@ -530,7 +525,7 @@ int main(int, char**)
         using allocator_t = DummyAllocator<value_t>;
         allocator_t allocator;        
         {
-            Timer<> t("dummy allocator");
+            bench::scoped_timer t("dummy allocator");
             unit_test_allocator_vector<value_t, allocator_t, k_testCount>(allocator);
         }
     }
@@ -541,7 +536,7 @@ int main(int, char**)
         char buffer[poolBytes];
         allocator_t allocator(buffer, poolBytes);
         {
-            Timer<> t("linear allocator");
+            bench::scoped_timer t("linear allocator");
             unit_test_allocator_vector<value_t, allocator_t, k_testCount>(allocator);
         }
     }
@@ -552,12 +547,20 @@ int main(int, char**)
         char buffer[poolBytes];
         allocator_t allocator(buffer, poolBytes);
         {
-            Timer<> t("arena allocator");
+            bench::scoped_timer t("arena allocator");
             unit_test_allocator_vector<value_t, allocator_t, k_testCount>(allocator);
         }
     }
     */
     
+    benchmark_factory_iteration(runner, 1000000);
+
+    benchmark_allocators(runner);
+
+    benchmark_snapshot(runner, 4000000);
+
+    benchmark_interner(runner, 4000000, 100000);
+
     arena_reusing<10, 4> myArena;
     auto alloc0 = myArena.allocate(4);
     auto alloc1 = myArena.allocate(3);
@@ -0,0 +1,1121 @@
+/**
+https://en.cppreference.com/w/cpp/memory/align
+**/
+#pragma once
+
+#include "trace.h"
+
+#include <vector>
+#include <array>
+#include <algorithm> // std::find
+#include <numeric> // std::accumulate
+#include <memory> // malloc
+#include <iostream> // std::cerr
+#include <cassert>
+#include <cstdint>
+#include <cstddef> // std::max_align_t
+#include <atomic>
+#include <new> // std::bad_alloc
+#include <utility> // std::forward
+#include <concepts>
+#include <cstdlib> // std::malloc
+
+///Typed allocator interface, every call is virtual. The Allocator concept at the end of the file is the byte level,
+///compile time alternative (no virtual call, composable); IAllocator stays for the code written against it.
+template<class T>
+class IAllocator {
+public:
+    using value_type = T;
+
+public:
+    virtual ~IAllocator() = default;
+
+    virtual T* allocate(int n) = 0;
+    virtual void deallocate(T* p, int n) = 0;
+
+    virtual void construct(T* p, const T& v) = 0;
+    virtual void destroy(T* p) = 0;
+};
+
+template<typename T>
+class DummyAllocator : public IAllocator<T>
+{
+    size_t m_countAllocs = 0;
+    size_t m_countConstructs = 0;
+
+public:
+    DummyAllocator() {}
+    ~DummyAllocator()
+    {
+        assert(m_countAllocs == 0);
+        std::cout << "Allocations: " << m_countAllocs << std::endl;
+        std::cout << "Constructs: " << m_countConstructs << std::endl;
+    }
+
+    T* allocate(int n)
+    {
+        T* alloc = reinterpret_cast<T*>(malloc(n * sizeof(T)));
+        if (alloc)
+        {
+            m_countAllocs += n;
+        }
+        return alloc;
+    }
+    void deallocate(T* p, int n)
+    {
+        free(p);
+        m_countAllocs -= n;
+    }
+
+    void construct(T* p, const T& v)
+    {
+        p = new (p)T(v);
+        m_countConstructs++;
+    }
+    void destroy(T* p)
+    {
+        p->~T();
+        m_countConstructs--;
+    }
+
+};
+
+template<typename T>
+class LinearAllocator : public IAllocator<T>
+{
+    T* m_buffer;
+    size_t m_bufferSize;
+    T* m_next = nullptr;
+
+    size_t m_countAllocs = 0;
+    size_t m_countConstructs = 0;
+
+public:
+    LinearAllocator(void* buffer, size_t bufferBytes)
+        : m_buffer(reinterpret_cast<T*>(buffer))
+        , m_bufferSize(bufferBytes / sizeof(T))
+        , m_next(m_buffer)
+    {
+    }
+    ~LinearAllocator()
+    {
+        assert(m_countAllocs == 0);
+        std::cout << "Allocations: " << (m_next - m_buffer) / sizeof(T)  << std::endl;
+        std::cout << "Constructs: " << m_countConstructs << std::endl;
+    }
+
+    T* allocate(int n)
+    {
+        T* alloc = nullptr;
+
+        if (m_next + n < m_buffer + m_bufferSize)
+        {
+            alloc = m_next;
+            m_next += n;
+            m_countAllocs += n;
+        }
+        else
+        {
+            std::cerr << "No memory available" << std::endl;
+        }
+        return alloc;
+    }
+    void deallocate(T* p, int n)
+    {
+        //free(p);
+        m_countAllocs -= n;
+    }
+
+    void construct(T* p, const T& v)
+    {
+        p = new (p)T(v);
+        m_countConstructs++;
+    }
+    void destroy(T* p)
+    {
+        p->~T();
+        m_countConstructs--;
+    }
+};
+
+template<size_t Capacity, size_t Alignment>
+class arena_naive
+{
+    char m_buffer[Capacity + Alignment];
+    
+    char* m_alignedPtr0;
+    char* m_nextPtr;
+protected:
+    static inline intptr_t align(intptr_t n)
+    {
+        return (n + (Alignment-1)) & ~(Alignment-1);
+    }
+    static inline uintptr_t align(uintptr_t n)
+    {
+        return (n + (Alignment-1)) & ~(Alignment-1);
+    }
+
+public:
+    static constexpr size_t alignment = Alignment;
+
+public:
+    arena_naive()
+    : m_alignedPtr0(reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(m_buffer))))
+    , m_nextPtr(m_alignedPtr0)
+    {
+        static_assert((Alignment & 0x01) == 0, "Alignment has to be a power of 2");
+    }
+    
+    ///@return nullptr when the arena is full, fallback<arena_naive<...>, mallocator> goes to the heap instead
+    char* allocate(size_t n)
+    {
+        const size_t alignedSize = align(n);
+        if (m_nextPtr + alignedSize < m_alignedPtr0 + Capacity)
+        {
+            char* alloc = m_nextPtr;
+            m_nextPtr += alignedSize;
+            return alloc;
+        }
+        return nullptr;
+    }
+    
+    void deallocate(char* p, size_t n)
+    {
+        if (m_alignedPtr0 <= p && p <= m_alignedPtr0 + Capacity)
+        {
+            const size_t alignedSize = align(n);
+            if (p + alignedSize == m_nextPtr) // 
+            {
+                m_nextPtr = p;
+            }
+        }
+        else
+        {
+            std::cerr << "cannot deallocate memory which doesn't below to the arena" << std::endl;
+        }
+    }
+
+    bool owns(const char* p) const { return m_alignedPtr0 <= p && p < m_alignedPtr0 + Capacity; }
+
+    ///Grows or shrinks the last allocation in place
+    bool expand(char* p, size_t oldSize, size_t newSize)
+    {
+        if (p + align(oldSize) != m_nextPtr || p + align(newSize) >= m_alignedPtr0 + Capacity)
+        {
+            return false;
+        }
+        m_nextPtr = p + align(newSize);
+        return true;
+    }
+
+    void deallocate_all() { m_nextPtr = m_alignedPtr0; }
+};
+
+
+template<size_t Capacity, size_t Alignment>
+class arena_reusing
+{
+    char m_buffer[Capacity + Alignment];
+    
+    char* m_alignedPtr0;
+    char* m_nextPtr;
+
+    std::vector<std::pair<char*, size_t>> m_freed;
+
+protected:
+    static inline intptr_t align(intptr_t n)
+    {
+        return (n + (Alignment-1)) & ~(Alignment-1);
+    }
+    static inline uintptr_t align(uintptr_t n)
+    {
+        return (n + (Alignment-1)) & ~(Alignment-1);
+    }
+
+public:
+    static constexpr size_t alignment = Alignment;
+
+public:
+    arena_reusing()
+    : m_alignedPtr0(reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(m_buffer))))
+    , m_nextPtr(m_alignedPtr0)
+    {
+        static_assert((Alignment & 0x01) == 0, "Alignment has to be a power of 2");
+    }
+    
+    char* allocate(size_t n)
+    {
+        const size_t alignedSize = align(n);
+        if (m_nextPtr + alignedSize < m_alignedPtr0 + Capacity)
+        {
+            char* alloc = m_nextPtr;
+            m_nextPtr += alignedSize;
+            return alloc;
+        }
+        else if (!m_freed.empty())
+        {// compact
+            auto it = std::find_if(std::begin(m_freed), std::end(m_freed), [alignedSize](const std::pair<char*, size_t>& data) {
+                return data.second >= alignedSize;
+            });
+            if (it != std::end(m_freed))
+            {
+                it->second -= alignedSize;
+                char* alloc = it->first;
+                it->first += alignedSize;
+                if (it->second == 0)
+                {
+                    std::iter_swap(it, std::prev(std::end(m_freed)));
+                    m_freed.pop_back();
+                }
+                return alloc;
+            }
+        }
+        return nullptr; // full, compose with fallback<> for a heap overflow
+    }
+    
+    void deallocate(char* p, size_t n)
+    {
+        if (m_alignedPtr0 <= p && p <= m_alignedPtr0 + Capacity)
+        {
+            const size_t alignedSize = align(n);
+            if (p + alignedSize == m_nextPtr) // 
+            {
+                m_nextPtr = p;
+            }
+            else
+            {
+                m_freed.emplace_back(p, n);
+            }
+        }
+        else
+        {
+            std::cerr << "cannot deallocate memory which doesn't below to the arena" << std::endl;
+        }
+    }
+
+    bool owns(const char* p) const { return m_alignedPtr0 <= p && p < m_alignedPtr0 + Capacity; }
+
+    void deallocate_all()
+    {
+        m_nextPtr = m_alignedPtr0;
+        m_freed.clear();
+    }
+};
+
+template<typename T>
+class ArenaAllocator : public IAllocator<T>
+{
+    T* m_buffer;
+    size_t m_bufferSize;
+    T* m_next = nullptr;
+
+    std::vector<std::pair<T*, size_t>> m_freed;
+
+public:
+    ArenaAllocator(void* buffer, size_t bufferBytes)
+        : m_buffer(reinterpret_cast<T*>(buffer))
+        , m_bufferSize(bufferBytes / sizeof(T))
+        , m_next(m_buffer)
+    {
+    }
+    ~ArenaAllocator()
+    {
+        const size_t freed = std::accumulate(std::begin(m_freed), std::end(m_freed), 0,
+            [](size_t accum, const std::pair<T*, size_t>& data) {
+                return accum + data.second; 
+        });
+        if (freed != m_bufferSize)
+        {
+            std::cerr << "Freed memory: " << freed << " / " << m_bufferSize << std::endl;
+        }
+    }
+
+    T* allocate(int n)
+    {
+        T* alloc = nullptr;
+
+        if (m_next + n < m_buffer + m_bufferSize)
+        {
+            alloc = m_next;
+            m_next += n;
+        }
+        else if (!m_freed.empty())
+        {
+            auto& freedData =  m_freed.back();
+            alloc = freedData.first;
+            freedData.first  += n;
+            freedData.second -= n;
+            if (freedData.second == 0)
+            {
+                m_freed.pop_back();
+            }
+        }
+        else
+        {
+            std::cerr << "No memory available" << std::endl;
+        }
+        return alloc;
+    }
+    void deallocate(T* p, int n)
+    {
+        m_freed.emplace_back(p, n);
+        // std::sort(std::begin(m_freed), std::end(m_freed), [](const std::pair<T*, size_t>& d1, const std::pair<T*, size_t>& d2) {
+        //     return d1.second < d2.second;
+        // });
+    }
+
+    void construct(T* p, const T& v)
+    {
+        p = new (p)T(v);
+    }
+    void destroy(T* p)
+    {
+        p->~T();
+    }
+};
+
+
+///64-bit generational handle: the low 32 bits index a slot, the high 32 bits hold the slot generation.
+///Generation 0 is never issued, so a default constructed handle is always invalid.
+class FactoryHandle
+{
+public:
+    FactoryHandle() = default;
+    FactoryHandle(uint32_t index, uint32_t generation)
+        : m_value((static_cast<uint64_t>(generation) << 32) | index)
+    {}
+
+    friend bool operator==(FactoryHandle lhs, FactoryHandle rhs) { return lhs.m_value == rhs.m_value; }
+    friend bool operator!=(FactoryHandle lhs, FactoryHandle rhs) { return lhs.m_value != rhs.m_value; }
+
+    uint32_t GetIndex() const { return static_cast<uint32_t>(m_value); }
+    uint32_t GetGeneration() const { return static_cast<uint32_t>(m_value >> 32); }
+    uint64_t GetValue() const { return m_value; }
+    bool IsNull() const { return GetGeneration() == 0; }
+
+private:
+    uint64_t m_value = 0;
+};
+
+///Slot map: objects live packed in a dense array (cache friendly iteration), handles go through a slot table
+///that stores the dense position and the current generation. Destroy swaps the last object into the hole, so
+///both Create and Destroy are O(1) and a stale handle is detected by its generation instead of dangling.
+template<typename T, typename Allocator = std::allocator<T>>
+class Factory
+{
+    struct Slot
+    {
+        uint32_t denseIndex = 0; // next free slot while the slot is in the free list
+        uint32_t generation = 1;
+    };
+
+    using traits_t = std::allocator_traits<Allocator>;
+    using slot_allocator_t = typename traits_t::template rebind_alloc<Slot>;
+    using index_allocator_t = typename traits_t::template rebind_alloc<uint32_t>;
+
+    static constexpr uint32_t k_invalidIndex = uint32_t(-1);
+
+public:
+    using value_type = T;
+    using handle_t = FactoryHandle;
+    using container_t = std::vector<T, Allocator>;
+    using iterator = typename container_t::iterator;
+    using const_iterator = typename container_t::const_iterator;
+
+public:
+    explicit Factory(const Allocator& allocator = Allocator())
+        : m_objects(allocator)
+        , m_denseToSlot(index_allocator_t(allocator))
+        , m_slots(slot_allocator_t(allocator))
+    {}
+
+    void Reserve(size_t count)
+    {
+        m_objects.reserve(count);
+        m_denseToSlot.reserve(count);
+        m_slots.reserve(count);
+    }
+
+    template<typename... Args>
+    handle_t Create(Args&&... args)
+    {
+        assert(m_objects.size() < k_invalidIndex);
+
+        // the bookkeeping grows first and the object goes in last, a throwing allocation or constructor leaves the
+        // factory as it was (a new slot just stays in the free list)
+        if (m_freeHead == k_invalidIndex)
+        {
+            m_slots.emplace_back();
+            m_slots.back().denseIndex = k_invalidIndex;
+            m_freeHead = static_cast<uint32_t>(m_slots.size() - 1);
+        }
+        const uint32_t slotIndex = m_freeHead;
+        const uint32_t denseIndex = static_cast<uint32_t>(m_objects.size());
+        m_denseToSlot.push_back(slotIndex);
+        try
+        {
+            m_objects.emplace_back(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            m_denseToSlot.pop_back();
+            throw;
+        }
+
+        Slot& slot = m_slots[slotIndex];
+        m_freeHead = slot.denseIndex;
+        slot.denseIndex = denseIndex;
+
+        return handle_t(slotIndex, slot.generation);
+    }
+
+    ///@return false if the handle was already destroyed (or never belonged to this factory)
+    bool Destroy(handle_t handle)
+    {
+        if (!IsAlive(handle))
+        {
+            return false;
+        }
+
+        Slot& slot = m_slots[handle.GetIndex()];
+        const uint32_t denseIndex = slot.denseIndex;
+        const uint32_t lastIndex = static_cast<uint32_t>(m_objects.size() - 1);
+        if (denseIndex != lastIndex)
+        {
+            m_objects[denseIndex] = std::move(m_objects[lastIndex]);
+            m_denseToSlot[denseIndex] = m_denseToSlot[lastIndex];
+            m_slots[m_denseToSlot[denseIndex]].denseIndex = denseIndex;
+        }
+        m_objects.pop_back();
+        m_denseToSlot.pop_back();
+
+        // generation 0 is reserved for null handles; wrapping after 2^32 reuses of one slot is accepted
+        if (++slot.generation == 0)
+        {
+            slot.generation = 1;
+        }
+        slot.denseIndex = m_freeHead;
+        m_freeHead = handle.GetIndex();
+
+        return true;
+    }
+
+    void Clear()
+    {
+        for (uint32_t denseIndex = static_cast<uint32_t>(m_objects.size()); denseIndex > 0; --denseIndex)
+        {
+            Destroy(HandleAt(denseIndex - 1));
+        }
+    }
+
+    bool IsAlive(handle_t handle) const
+    {
+        return handle.GetIndex() < m_slots.size()
+            && m_slots[handle.GetIndex()].generation == handle.GetGeneration();
+    }
+
+    ///@return nullptr when the handle is stale (use-after-free) or null
+    T* Get(handle_t handle)
+    {
+        return IsAlive(handle) ? &m_objects[m_slots[handle.GetIndex()].denseIndex] : nullptr;
+    }
+    const T* Get(handle_t handle) const
+    {
+        return IsAlive(handle) ? &m_objects[m_slots[handle.GetIndex()].denseIndex] : nullptr;
+    }
+
+    ///@return handle of the object stored at position denseIndex of the packed array
+    handle_t HandleAt(size_t denseIndex) const
+    {
+        const uint32_t slotIndex = m_denseToSlot[denseIndex];
+        return handle_t(slotIndex, m_slots[slotIndex].generation);
+    }
+
+    size_t Size() const { return m_objects.size(); }
+    bool Empty() const { return m_objects.empty(); }
+
+    // iteration visits live objects only, in packed (not creation) order
+    iterator begin() { return m_objects.begin(); }
+    iterator end() { return m_objects.end(); }
+    const_iterator begin() const { return m_objects.begin(); }
+    const_iterator end() const { return m_objects.end(); }
+
+private:
+    container_t m_objects;
+    std::vector<uint32_t, index_allocator_t> m_denseToSlot;
+    std::vector<Slot, slot_allocator_t> m_slots;
+    uint32_t m_freeHead = k_invalidIndex;
+};
+
+///Bump allocator that can be shared by several threads (i.e. the workers of a parallel transform).
+///Each thread grabs a sub-chunk of the buffer with a single fetch_add and then bumps inside it without any
+///synchronisation; requests bigger than a chunk go straight to the shared cursor. Nothing is freed one by one,
+///reset() drops everything at the end of a batch and must not race with allocate().
+///A thread keeps a chunk for each of the last k_threadChunks arenas it used, so alternating between a few arenas
+///doesn't throw chunks away.
+template<size_t Alignment = alignof(std::max_align_t)>
+class arena_concurrent
+{
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment has to be a power of 2");
+
+    struct ThreadChunk
+    {
+        uint64_t arenaId = 0;
+        uint64_t epoch = 0;
+        char* next = nullptr;
+        char* end = nullptr;
+    };
+
+    static constexpr size_t k_threadChunks = 8;
+
+    struct ThreadChunks
+    {
+        std::array<ThreadChunk, k_threadChunks> chunks;
+        std::array<uint64_t, k_threadChunks> lastUse{};
+        uint64_t tick = 0;
+        size_t last = 0;
+    };
+
+    ///Chunk of this thread for arena id, the least recently used one is recycled for an arena not in the table
+    static ThreadChunk& thread_chunk(uint64_t id)
+    {
+        static thread_local ThreadChunks s_chunks;
+        size_t slot = s_chunks.last;
+        if (s_chunks.chunks[slot].arenaId != id)
+        {
+            slot = 0;
+            for (size_t i = 0; i < k_threadChunks; ++i)
+            {
+                if (s_chunks.chunks[i].arenaId == id)
+                {
+                    slot = i;
+                    break;
+                }
+                if (s_chunks.lastUse[i] < s_chunks.lastUse[slot])
+                {
+                    slot = i;
+                }
+            }
+            if (s_chunks.chunks[slot].arenaId != id)
+            {
+                s_chunks.chunks[slot] = ThreadChunk();
+            }
+            s_chunks.last = slot;
+        }
+        s_chunks.lastUse[slot] = ++s_chunks.tick;
+        return s_chunks.chunks[slot];
+    }
+
+    static uint64_t next_arena_id()
+    {
+        static std::atomic<uint64_t> s_nextId{1};
+        return s_nextId.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static inline uintptr_t align(uintptr_t n, size_t alignment)
+    {
+        return (n + (alignment - 1)) & ~uintptr_t(alignment - 1);
+    }
+
+public:
+    static constexpr size_t alignment = Alignment;
+
+public:
+    explicit arena_concurrent(size_t capacity, size_t chunkSize = 64 * 1024)
+        : m_buffer(static_cast<char*>(::operator new(capacity + Alignment)))
+        , m_alignedPtr0(reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(m_buffer), Alignment)))
+        , m_capacity(capacity)
+        , m_chunkSize(align(chunkSize, Alignment))
+        , m_id(next_arena_id())
+    {
+    }
+    ~arena_concurrent()
+    {
+        ::operator delete(m_buffer);
+    }
+    arena_concurrent(const arena_concurrent&) = delete;
+    arena_concurrent& operator=(const arena_concurrent&) = delete;
+
+    ///@return nullptr when the arena is exhausted
+    char* allocate(size_t n, size_t alignment = Alignment)
+    {
+        assert((alignment & (alignment - 1)) == 0);
+
+        ThreadChunk& chunk = thread_chunk(m_id);
+        const uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+        if (chunk.arenaId == m_id && chunk.epoch == epoch)
+        {
+            char* alloc = reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(chunk.next), alignment));
+            if (alloc + n <= chunk.end)
+            {
+                chunk.next = alloc + n;
+                return alloc;
+            }
+        }
+
+        // big request, don't throw away the current chunk; with less than a chunk left the request alone may still fit
+        char* block = n + alignment > m_chunkSize / 2 ? nullptr : grab(m_chunkSize);
+        if (block == nullptr)
+        {
+            block = grab(align(n + alignment, Alignment));
+            if (block == nullptr)
+            {
+                std::cerr << "No memory available in the concurrent arena" << std::endl;
+                return nullptr;
+            }
+            return reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(block), alignment));
+        }
+        char* alloc = reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(block), alignment));
+        chunk.arenaId = m_id;
+        chunk.epoch = epoch;
+        chunk.next = alloc + n;
+        chunk.end = block + m_chunkSize;
+        return alloc;
+    }
+
+    template<typename T>
+    T* allocate_array(size_t count)
+    {
+        return reinterpret_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    ///Releases every allocation at once, callers must make sure no thread is still allocating
+    void reset()
+    {
+        m_offset.store(0, std::memory_order_relaxed);
+        m_epoch.fetch_add(1, std::memory_order_release);
+    }
+
+    void deallocate(char*, size_t) {} // released in bulk by reset
+    void deallocate_all() { reset(); }
+    bool owns(const char* p) const { return m_alignedPtr0 <= p && p < m_alignedPtr0 + m_capacity; }
+
+    size_t capacity() const { return m_capacity; }
+    size_t used() const { return std::min(m_offset.load(std::memory_order_relaxed), m_capacity); }
+
+private:
+    char* grab(size_t bytes)
+    {
+        TRACE_SCOPE("arena_concurrent::grab");
+        // the cursor only moves when the block fits, a failed request leaves the space to smaller ones
+        size_t offset = m_offset.load(std::memory_order_relaxed);
+        do
+        {
+            if (bytes > m_capacity - offset)
+            {
+                return nullptr;
+            }
+        } while (!m_offset.compare_exchange_weak(offset, offset + bytes, std::memory_order_relaxed));
+        return m_alignedPtr0 + offset;
+    }
+
+    char* m_buffer;
+    char* m_alignedPtr0;
+    size_t m_capacity;
+    size_t m_chunkSize;
+    uint64_t m_id;
+
+    alignas(64) std::atomic<size_t> m_offset{0};
+    std::atomic<uint64_t> m_epoch{1};
+};
+
+///std compatible allocator over arena_concurrent so containers used as per-task temporaries skip malloc
+template<typename T, size_t Alignment = alignof(std::max_align_t)>
+class ConcurrentArenaAllocator
+{
+public:
+    using value_type = T;
+    template<typename U>
+    struct rebind { using other = ConcurrentArenaAllocator<U, Alignment>; };
+
+public:
+    ConcurrentArenaAllocator(arena_concurrent<Alignment>& arena) : m_arena(&arena) {}
+    template<typename U>
+    ConcurrentArenaAllocator(const ConcurrentArenaAllocator<U, Alignment>& other) : m_arena(other.arena()) {}
+
+    template<typename U>
+    bool operator==(const ConcurrentArenaAllocator<U, Alignment>& other) const { return m_arena == other.arena(); }
+    template<typename U>
+    bool operator!=(const ConcurrentArenaAllocator<U, Alignment>& other) const { return m_arena != other.arena(); }
+
+    T* allocate(size_t n)
+    {
+        T* alloc = m_arena->template allocate_array<T>(n);
+        if (alloc == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return alloc;
+    }
+    void deallocate(T*, size_t) {} // released in bulk by arena_concurrent::reset
+
+    arena_concurrent<Alignment>* arena() const { return m_arena; }
+
+private:
+    arena_concurrent<Alignment>* m_arena;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocator concept: byte allocators resolved at compile time, so a composition like
+//   segregator<256, free_list<mallocator, 256>, fallback<arena_naive<1 << 20, 16>, mallocator>>
+// inlines down to a size compare and a bump or a list pop. allocate returns nullptr when it can't serve the request
+// (that is what fallback<> reacts to). deallocate always gets the size of the allocation back, segregator routes on
+// it, allocators that don't need it ignore it.
+// The optional capabilities are checked with the concepts below, composites only offer the ones their parts have.
+
+template<typename A>
+concept Allocator = requires (A& allocator, char* p, size_t n) {
+    { A::alignment } -> std::convertible_to<size_t>;
+    { allocator.allocate(n) } -> std::same_as<char*>;
+    allocator.deallocate(p, n);
+};
+
+///Knows whether it handed out p, what fallback<> needs from its primary
+template<typename A>
+concept OwningAllocator = Allocator<A> && requires (const A& allocator, const char* p) {
+    { allocator.owns(p) } -> std::same_as<bool>;
+};
+
+///Can resize an allocation in place (p, oldSize, newSize), false when it can't
+template<typename A>
+concept ExpandingAllocator = Allocator<A> && requires (A& allocator, char* p, size_t n) {
+    { allocator.expand(p, n, n) } -> std::same_as<bool>;
+};
+
+///Releases everything at once
+template<typename A>
+concept BulkAllocator = Allocator<A> && requires (A& allocator) {
+    allocator.deallocate_all();
+};
+
+///malloc/free, the usual last resort of a composition
+struct mallocator
+{
+    static constexpr size_t alignment = alignof(std::max_align_t);
+
+    char* allocate(size_t n) { return static_cast<char*>(std::malloc(n)); }
+    void deallocate(char* p, size_t) { std::free(p); }
+};
+
+///LinearAllocator on bytes: bumps in a caller provided buffer, only the last allocation can be freed (or expanded)
+template<size_t Alignment = alignof(std::max_align_t)>
+class linear_allocator
+{
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment has to be a power of 2");
+
+    static inline uintptr_t align(uintptr_t n)
+    {
+        return (n + (Alignment - 1)) & ~uintptr_t(Alignment - 1);
+    }
+
+public:
+    static constexpr size_t alignment = Alignment;
+
+public:
+    linear_allocator(void* buffer, size_t bufferBytes)
+        : m_begin(reinterpret_cast<char*>(align(reinterpret_cast<uintptr_t>(buffer))))
+        , m_end(static_cast<char*>(buffer) + bufferBytes)
+        , m_next(m_begin)
+    {
+    }
+
+    char* allocate(size_t n)
+    {
+        const size_t alignedSize = align(n);
+        if (alignedSize > size_t(m_end - m_next))
+        {
+            return nullptr;
+        }
+        char* alloc = m_next;
+        m_next += alignedSize;
+        return alloc;
+    }
+    void deallocate(char* p, size_t n)
+    {
+        if (p + align(n) == m_next)
+        {
+            m_next = p;
+        }
+    }
+
+    bool owns(const char* p) const { return m_begin <= p && p < m_end; }
+    bool expand(char* p, size_t oldSize, size_t newSize)
+    {
+        if (p + align(oldSize) != m_next || align(newSize) > size_t(m_end - p))
+        {
+            return false;
+        }
+        m_next = p + align(newSize);
+        return true;
+    }
+    void deallocate_all() { m_next = m_begin; }
+
+    size_t used() const { return m_next - m_begin; }
+
+private:
+    char* m_begin;
+    char* m_end;
+    char* m_next;
+};
+
+///Keeps up to MaxCached freed blocks of BlockSize bytes in an intrusive list, requests up to BlockSize are served
+///from it (or get a whole block from Parent), bigger ones go straight to Parent
+template<Allocator Parent, size_t BlockSize, size_t MaxCached = 1024>
+class free_list
+{
+    static_assert(BlockSize >= sizeof(void*), "a free block holds the next pointer");
+
+    struct Node
+    {
+        Node* next;
+    };
+
+public:
+    static constexpr size_t alignment = Parent::alignment;
+
+public:
+    free_list() = default;
+    template<typename... Args>
+    explicit free_list(Args&&... parentArgs) : m_parent(std::forward<Args>(parentArgs)...) {}
+    ~free_list()
+    {
+        while (m_head != nullptr)
+        {
+            Node* next = m_head->next;
+            m_parent.deallocate(reinterpret_cast<char*>(m_head), BlockSize);
+            m_head = next;
+        }
+    }
+    free_list(const free_list&) = delete;
+    free_list& operator=(const free_list&) = delete;
+
+    char* allocate(size_t n)
+    {
+        if (n > BlockSize)
+        {
+            return m_parent.allocate(n);
+        }
+        if (m_head != nullptr)
+        {
+            Node* block = m_head;
+            m_head = block->next;
+            --m_count;
+            return reinterpret_cast<char*>(block);
+        }
+        return m_parent.allocate(BlockSize);
+    }
+    void deallocate(char* p, size_t n)
+    {
+        if (n > BlockSize || m_count == MaxCached)
+        {
+            m_parent.deallocate(p, std::max(n, BlockSize));
+            return;
+        }
+        Node* block = reinterpret_cast<Node*>(p);
+        block->next = m_head;
+        m_head = block;
+        ++m_count;
+    }
+
+    bool owns(const char* p) const requires OwningAllocator<Parent> { return m_parent.owns(p); }
+
+    ///Small allocations always have BlockSize bytes
+    bool expand(char* p, size_t oldSize, size_t newSize)
+    {
+        if (oldSize <= BlockSize)
+        {
+            return newSize <= BlockSize;
+        }
+        if constexpr (ExpandingAllocator<Parent>)
+        {
+            return newSize > BlockSize && m_parent.expand(p, oldSize, newSize);
+        }
+        return false;
+    }
+
+    void deallocate_all() requires BulkAllocator<Parent>
+    {
+        m_head = nullptr;
+        m_count = 0;
+        m_parent.deallocate_all();
+    }
+
+    Parent& parent() { return m_parent; }
+
+private:
+    Parent m_parent;
+    Node* m_head = nullptr;
+    size_t m_count = 0;
+};
+
+///Primary first, Fallback when Primary returns nullptr. Constructor arguments go to Primary.
+template<OwningAllocator Primary, Allocator Fallback>
+class fallback
+{
+public:
+    static constexpr size_t alignment = std::min<size_t>(Primary::alignment, Fallback::alignment);
+
+public:
+    fallback() = default;
+    template<typename... Args>
+    explicit fallback(Args&&... primaryArgs) : m_primary(std::forward<Args>(primaryArgs)...) {}
+    fallback(const fallback&) = delete;
+    fallback& operator=(const fallback&) = delete;
+
+    char* allocate(size_t n)
+    {
+        char* alloc = m_primary.allocate(n);
+        return alloc != nullptr ? alloc : m_fallback.allocate(n);
+    }
+    void deallocate(char* p, size_t n)
+    {
+        if (m_primary.owns(p))
+        {
+            m_primary.deallocate(p, n);
+        }
+        else
+        {
+            m_fallback.deallocate(p, n);
+        }
+    }
+
+    bool owns(const char* p) const requires OwningAllocator<Fallback> { return m_primary.owns(p) || m_fallback.owns(p); }
+
+    bool expand(char* p, size_t oldSize, size_t newSize) requires ExpandingAllocator<Primary> || ExpandingAllocator<Fallback>
+    {
+        if (m_primary.owns(p))
+        {
+            if constexpr (ExpandingAllocator<Primary>)
+            {
+                return m_primary.expand(p, oldSize, newSize);
+            }
+            return false;
+        }
+        if constexpr (ExpandingAllocator<Fallback>)
+        {
+            return m_fallback.expand(p, oldSize, newSize);
+        }
+        return false;
+    }
+
+    void deallocate_all() requires BulkAllocator<Primary> && BulkAllocator<Fallback>
+    {
+        m_primary.deallocate_all();
+        m_fallback.deallocate_all();
+    }
+
+    Primary& primary() { return m_primary; }
+    Fallback& secondary() { return m_fallback; }
+
+private:
+    Primary m_primary;
+    Fallback m_fallback;
+};
+
+///Requests up to Threshold bytes go to Small, bigger ones to Large
+template<size_t Threshold, Allocator Small, Allocator Large>
+class segregator
+{
+public:
+    static constexpr size_t alignment = std::min<size_t>(Small::alignment, Large::alignment);
+
+public:
+    segregator() = default;
+    segregator(const segregator&) = delete;
+    segregator& operator=(const segregator&) = delete;
+
+    char* allocate(size_t n) { return n <= Threshold ? m_small.allocate(n) : m_large.allocate(n); }
+    void deallocate(char* p, size_t n)
+    {
+        if (n <= Threshold)
+        {
+            m_small.deallocate(p, n);
+        }
+        else
+        {
+            m_large.deallocate(p, n);
+        }
+    }
+
+    bool owns(const char* p) const requires OwningAllocator<Small> && OwningAllocator<Large>
+    {
+        return m_small.owns(p) || m_large.owns(p);
+    }
+
+    ///Only within the side the allocation already is on
+    bool expand(char* p, size_t oldSize, size_t newSize) requires ExpandingAllocator<Small> || ExpandingAllocator<Large>
+    {
+        if (oldSize <= Threshold)
+        {
+            if constexpr (ExpandingAllocator<Small>)
+            {
+                return newSize <= Threshold && m_small.expand(p, oldSize, newSize);
+            }
+            return false;
+        }
+        if constexpr (ExpandingAllocator<Large>)
+        {
+            return newSize > Threshold && m_large.expand(p, oldSize, newSize);
+        }
+        return false;
+    }
+
+    void deallocate_all() requires BulkAllocator<Small> && BulkAllocator<Large>
+    {
+        m_small.deallocate_all();
+        m_large.deallocate_all();
+    }
+
+    Small& small() { return m_small; }
+    Large& large() { return m_large; }
+
+private:
+    Small m_small;
+    Large m_large;
+};
+
+///std compatible typed view of an Allocator, for containers (the Allocator must outlive them)
+template<typename T, Allocator A>
+class typed_allocator
+{
+    static_assert(alignof(T) <= A::alignment, "the allocator doesn't align enough for T");
+
+public:
+    using value_type = T;
+    template<typename U>
+    struct rebind { using other = typed_allocator<U, A>; };
+
+public:
+    typed_allocator(A& allocator) : m_allocator(&allocator) {}
+    template<typename U>
+    typed_allocator(const typed_allocator<U, A>& other) : m_allocator(other.allocator()) {}
+
+    template<typename U>
+    bool operator==(const typed_allocator<U, A>& other) const { return m_allocator == other.allocator(); }
+    template<typename U>
+    bool operator!=(const typed_allocator<U, A>& other) const { return m_allocator != other.allocator(); }
+
+    T* allocate(size_t n)
+    {
+        char* alloc = m_allocator->allocate(n * sizeof(T));
+        if (alloc == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return reinterpret_cast<T*>(alloc);
+    }
+    void deallocate(T* p, size_t n) { m_allocator->deallocate(reinterpret_cast<char*>(p), n * sizeof(T)); }
+
+    A* allocator() const { return m_allocator; }
+
+private:
+    A* m_allocator;
+};
+
+static_assert(Allocator<mallocator> && !OwningAllocator<mallocator>);
+static_assert(OwningAllocator<arena_naive<64, 16>> && ExpandingAllocator<arena_naive<64, 16>> && BulkAllocator<arena_naive<64, 16>>);
+static_assert(OwningAllocator<arena_reusing<64, 16>> && BulkAllocator<arena_reusing<64, 16>>);
+static_assert(OwningAllocator<arena_concurrent<>> && BulkAllocator<arena_concurrent<>>);
+static_assert(ExpandingAllocator<fallback<linear_allocator<>, mallocator>> && !OwningAllocator<fallback<linear_allocator<>, mallocator>>);
+static_assert(!BulkAllocator<segregator<256, free_list<mallocator, 256>, mallocator>>);
+static_assert(BulkAllocator<segregator<256, free_list<arena_naive<4096, 16>, 256>, arena_reusing<4096, 16>>>);
@@ -0,0 +1,406 @@
+/*
+NUMA aware placement for the parallel algorithms.
+
+  numa::node_pools pools;                          // one work_stealing_pool per node, workers pinned to its cpus
+  numa::array<float> in(pools, count, 1.f);        // node n owns the n-th slice of the pages
+  numa::array<float> out(pools, count);
+  numa::transform(pools, in, out, [](float v) { return v * 2.f; });
+
+The array is split in page aligned slices, one per node. Each slice is bound to its node (mbind) and initialized by
+the workers of that node, so the pages are first touched where they'll be used even when mbind isn't allowed.
+The algorithms run the chunks of slice n on the pool of node n. placement::remote shifts every slice to the next
+node, it only exists to measure what the interconnect costs.
+
+Topology comes from /sys/devices/system/node restricted to the cpus the process may run on; without it (or on a
+single node) everything degenerates to one pool and one slice. Raw syscalls, no libnuma dependency.
+*/
+#pragma once
+
+#include "parallel_algorithms.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace numa
+{
+
+enum class placement { local, remote };
+
+class topology
+{
+public:
+    static const topology& get()
+    {
+        static const topology s_topology;
+        return s_topology;
+    }
+
+    size_t node_count() const { return m_nodes.size(); }
+    ///@return os id of the node, the index is what the rest of the code uses
+    int node_id(size_t node) const { return m_nodes[node].id; }
+    const std::vector<int>& cpus(size_t node) const { return m_nodes[node].cpus; }
+
+    ///Parses the kernel's "0-3,8,10-11" lists
+    static std::vector<int> parse_list(const std::string& list)
+    {
+        std::vector<int> values;
+        std::istringstream istr(list);
+        std::string range;
+        while (std::getline(istr, range, ','))
+        {
+            const size_t dash = range.find('-');
+            const int first = std::atoi(range.c_str());
+            const int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+            for (int value = first; value <= last && !range.empty(); ++value)
+            {
+                values.push_back(value);
+            }
+        }
+        return values;
+    }
+
+private:
+    struct node
+    {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    topology()
+    {
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        const bool hasAffinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string nodeList;
+        if (online && std::getline(online, nodeList))
+        {
+            for (const int id : parse_list(nodeList))
+            {
+                std::ifstream cpuFile("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+                std::string cpuList;
+                std::getline(cpuFile, cpuList);
+
+                node entry{id, {}};
+                for (const int cpu : parse_list(cpuList))
+                {
+                    if (!hasAffinity || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                    {
+                        entry.cpus.push_back(cpu);
+                    }
+                }
+                if (!entry.cpus.empty())
+                {// memory only nodes, or nodes we may not run on, get no slice
+                    m_nodes.push_back(entry);
+                }
+            }
+        }
+#endif
+        if (m_nodes.empty())
+        {
+            node entry{0, {}};
+            for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            {
+                entry.cpus.push_back(static_cast<int>(cpu));
+            }
+            m_nodes.push_back(entry);
+        }
+    }
+
+    std::vector<node> m_nodes;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+template<typename F>
+class node_task : public pool_task
+{
+public:
+    void execute() override
+    {
+        (*m_f)(m_node, *m_pool);
+        m_remaining->fetch_sub(1, std::memory_order_release);
+    }
+
+    void setup(F* f, size_t node, work_stealing_pool* pool, std::atomic<size_t>* remaining)
+    {
+        m_f = f;
+        m_node = node;
+        m_pool = pool;
+        m_remaining = remaining;
+    }
+
+private:
+    F* m_f = nullptr;
+    size_t m_node = 0;
+    work_stealing_pool* m_pool = nullptr;
+    std::atomic<size_t>* m_remaining = nullptr;
+};
+}//detail
+
+class node_pools
+{
+public:
+    ///@param threadsPerNode 0 = one worker per cpu of the node
+    explicit node_pools(size_t threadsPerNode = 0)
+    {
+        const topology& topo = topology::get();
+        for (size_t node = 0; node < topo.node_count(); ++node)
+        {
+            std::vector<int> cpus = topo.cpus(node);
+            if (threadsPerNode > 0 && cpus.size() > threadsPerNode)
+            {
+                cpus.resize(threadsPerNode);
+            }
+            m_pools.emplace_back(new work_stealing_pool(cpus));
+        }
+    }
+
+    size_t node_count() const { return m_pools.size(); }
+    work_stealing_pool& pool(size_t node) { return *m_pools[node]; }
+    size_t thread_count() const
+    {
+        size_t count = 0;
+        for (const auto& pool : m_pools)
+        {
+            count += pool->thread_count();
+        }
+        return count;
+    }
+
+    ///Runs f(node, pool) on a worker of every node concurrently and returns when all of them are done.
+    ///With placement::remote node n runs on the pool of node n + 1.
+    template<typename F>
+    void run_on_nodes(F&& f, placement where = placement::local)
+    {
+        using body_t = typename std::remove_reference<F>::type;
+        const size_t count = m_pools.size();
+        const size_t shift = where == placement::remote ? 1 : 0;
+
+        std::atomic<size_t> remaining{count};
+        std::vector<detail::node_task<body_t>> tasks(count);
+        for (size_t node = 0; node < count; ++node)
+        {
+            tasks[node].setup(&f, node, m_pools[(node + shift) % count].get(), &remaining);
+            m_pools[(node + shift) % count]->submit(&tasks[node]);
+        }
+        while (remaining.load(std::memory_order_acquire) != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<work_stealing_pool>> m_pools;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Fixed size array whose pages are spread over the nodes of node_pools, slice n lives on node n
+template<typename T>
+class array
+{
+    static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "elements are initialized in place by the node workers");
+
+public:
+    array(node_pools& pools, size_t count, const T& value = T())
+        : m_count(count)
+    {
+        const size_t pageSize = page_size();
+        const size_t nodeCount = pools.node_count();
+
+        // slices are whole pages whenever a page holds a whole number of elements
+        size_t sliceCount = (count + nodeCount - 1) / std::max<size_t>(1, nodeCount);
+        if (pageSize % sizeof(T) == 0)
+        {
+            const size_t perPage = pageSize / sizeof(T);
+            sliceCount = (sliceCount + perPage - 1) / perPage * perPage;
+        }
+        for (size_t node = 0; node <= nodeCount; ++node)
+        {
+            m_sliceBegin.push_back(std::min(count, node * sliceCount));
+        }
+
+        m_bytes = std::max<size_t>(pageSize, (count * sizeof(T) + pageSize - 1) / pageSize * pageSize);
+#if defined(__linux__)
+        void* mapping = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        m_data = mapping == MAP_FAILED ? nullptr : static_cast<T*>(mapping);
+        if (m_data == nullptr)
+        {
+            std::cerr << "numa::array mmap failed: " << std::strerror(errno) << std::endl;
+            m_count = 0;
+            return;
+        }
+        m_isBound = nodeCount > 1 && bind(pools);
+#else
+        m_data = static_cast<T*>(::operator new(m_bytes));
+#endif
+
+        // first touch from the node's own workers
+        pools.run_on_nodes([this, &value](size_t node, work_stealing_pool& pool) {
+            const size_t begin = node_begin(node);
+            const size_t size = node_end(node) - begin;
+            parallel::for_each_chunk(pool, size, parallel::chunk_size(pool, size, 0), [this, begin, &value](size_t, size_t first, size_t last) {
+                std::fill(m_data + begin + first, m_data + begin + last, value);
+            });
+        });
+    }
+    ~array()
+    {
+#if defined(__linux__)
+        if (m_data != nullptr)
+        {
+            munmap(m_data, m_bytes);
+        }
+#else
+        ::operator delete(m_data);
+#endif
+    }
+    array(const array&) = delete;
+    array& operator=(const array&) = delete;
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+    size_t size() const { return m_count; }
+    T* begin() { return m_data; }
+    T* end() { return m_data + m_count; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_count; }
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+    size_t node_count() const { return m_sliceBegin.size() - 1; }
+    size_t node_begin(size_t node) const { return m_sliceBegin[node]; }
+    size_t node_end(size_t node) const { return m_sliceBegin[node + 1]; }
+    ///@return true if the slices are bound with mbind, otherwise only first touch placed them
+    bool is_bound() const { return m_isBound; }
+
+private:
+    static size_t page_size()
+    {
+#if defined(__linux__)
+        return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+        return 4096;
+#endif
+    }
+
+#if defined(__linux__)
+    bool bind(node_pools& pools)
+    {
+        const topology& topo = topology::get();
+        for (size_t node = 0; node < pools.node_count(); ++node)
+        {
+            const size_t begin = node_begin(node) * sizeof(T) / page_size() * page_size();
+            const size_t end = std::min(m_bytes, (node_end(node) * sizeof(T) + page_size() - 1) / page_size() * page_size());
+            if (end <= begin)
+            {
+                continue;
+            }
+            const int id = topo.node_id(node);
+            std::vector<unsigned long> mask(id / (8 * sizeof(unsigned long)) + 1, 0);
+            mask[id / (8 * sizeof(unsigned long))] |= 1ul << (id % (8 * sizeof(unsigned long)));
+            if (syscall(SYS_mbind, reinterpret_cast<char*>(m_data) + begin, end - begin, MPOL_BIND, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1, 0) != 0)
+            {
+                std::cerr << "numa::array mbind failed (" << std::strerror(errno) << "), relying on first touch" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+#endif
+
+    T* m_data = nullptr;
+    size_t m_count;
+    size_t m_bytes = 0;
+    std::vector<size_t> m_sliceBegin;
+    bool m_isBound = false;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///in and out have to come from the same node_pools (same slices)
+template<typename T, typename U, typename UnaryOp>
+void transform(node_pools& pools, const array<T>& in, array<U>& out, UnaryOp op, size_t grain = 0, placement where = placement::local)
+{
+    pools.run_on_nodes([&](size_t node, work_stealing_pool& pool) {
+        const size_t begin = in.node_begin(node);
+        const size_t size = in.node_end(node) - begin;
+        parallel::for_each_chunk(pool, size, parallel::chunk_size(pool, size, grain), [&](size_t, size_t first, size_t last) {
+            std::transform(in.data() + begin + first, in.data() + begin + last, out.data() + begin + first, op);
+        });
+    }, where);
+}
+
+///Node results are combined in node order, init is folded in once before them
+template<typename T, typename Acc, typename ReduceOp, typename TransformOp>
+Acc transform_reduce(node_pools& pools, const array<T>& in, Acc init, ReduceOp reduceOp, TransformOp transformOp, size_t grain = 0, placement where = placement::local)
+{
+    struct partial_t // one cache line each, nodes write them concurrently
+    {
+        alignas(64) Acc value;
+        bool isSet = false; // empty slices have nothing to add
+    };
+    std::vector<partial_t> partials(in.node_count(), partial_t{init, false});
+    pools.run_on_nodes([&](size_t node, work_stealing_pool& pool) {
+        const T* first = in.data() + in.node_begin(node);
+        const size_t size = in.node_end(node) - in.node_begin(node);
+        if (size == 0)
+        {
+            return;
+        }
+        // seeded from the first element of each chunk, not from init
+        const size_t chunkSize = parallel::chunk_size(pool, size, grain);
+        std::vector<Acc> chunkPartials(parallel::chunk_count(size, chunkSize), init);
+        parallel::for_each_chunk(pool, size, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+            Acc partial = transformOp(first[begin]);
+            for (size_t i = begin + 1; i < end; ++i)
+            {
+                partial = reduceOp(partial, transformOp(first[i]));
+            }
+            chunkPartials[chunk] = partial;
+        });
+        Acc value = chunkPartials[0];
+        for (size_t chunk = 1; chunk < chunkPartials.size(); ++chunk)
+        {
+            value = reduceOp(value, chunkPartials[chunk]);
+        }
+        partials[node].value = value;
+        partials[node].isSet = true;
+    }, where);
+
+    Acc result = init;
+    for (const partial_t& partial : partials)
+    {
+        if (partial.isSet)
+        {
+            result = reduceOp(result, partial.value);
+        }
+    }
+    return result;
+}
+
+}//numa
@@ -0,0 +1,265 @@
+/*
+Parallel algorithms on top of work_stealing_pool, with explicit thread count (the pool) and grain size (elements per
+chunk, 0 picks ~8 chunks per thread). Unlike std::execution::par they do not depend on the standard library backend
+(libstdc++ without TBB runs par sequentially).
+
+Functors must not throw, same as with the std execution policies (there an exception calls std::terminate).
+*/
+#pragma once
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional> // std::plus
+#include <iterator>
+#include <type_traits>
+#include <numeric>
+#include <vector>
+
+namespace parallel
+{
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename F>
+class chunk_task;
+
+template<typename F>
+struct chunk_context
+{
+    work_stealing_pool& pool;
+    F& body;
+    size_t count;
+    size_t chunkSize;
+    std::vector<chunk_task<F>> tasks; // one slot per chunk, a split range always starts at a different chunk
+    std::atomic<size_t> remaining;
+};
+
+///Lazy binary splitting of [lo, hi) chunks: the executing thread keeps the left half and pushes the right one into
+///its deque, so thieves take big ranges and the owner walks its chunks in order
+template<typename F>
+class chunk_task : public pool_task
+{
+public:
+    void execute() override
+    {
+        chunk_context<F>& context = *m_context;
+        while (m_hi - m_lo > 1)
+        {
+            const size_t mid = m_lo + (m_hi - m_lo) / 2;
+            chunk_task& right = context.tasks[mid];
+            right.setup(&context, mid, m_hi);
+            context.pool.submit(&right);
+            m_hi = mid;
+        }
+
+        const size_t begin = m_lo * context.chunkSize;
+        const size_t end = std::min(begin + context.chunkSize, context.count);
+        context.body(m_lo, begin, end);
+        context.remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void setup(chunk_context<F>* context, size_t lo, size_t hi)
+    {
+        m_context = context;
+        m_lo = lo;
+        m_hi = hi;
+    }
+
+private:
+    chunk_context<F>* m_context = nullptr;
+    size_t m_lo = 0;
+    size_t m_hi = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+inline size_t chunk_size(const work_stealing_pool& pool, size_t count, size_t grain)
+{
+    if (grain > 0)
+    {
+        return grain;
+    }
+    const size_t chunks = pool.thread_count() * 8;
+    return std::max<size_t>(4096, (count + chunks - 1) / chunks);
+}
+
+inline size_t chunk_count(size_t count, size_t chunkSize)
+{
+    return (count + chunkSize - 1) / chunkSize;
+}
+
+///Calls body(chunkIndex, begin, end) for every chunk of [0, count) and returns when all of them ran.
+///The calling thread takes part in the work instead of blocking.
+template<typename F>
+void for_each_chunk(work_stealing_pool& pool, size_t count, size_t chunkSize, F&& body)
+{
+    const size_t chunks = chunk_count(count, chunkSize);
+    if (chunks <= 1)
+    {
+        if (count > 0)
+        {
+            body(size_t(0), size_t(0), count);
+        }
+        return;
+    }
+
+    using body_t = typename std::remove_reference<F>::type;
+    detail::chunk_context<body_t> context{pool, body, count, chunkSize, std::vector<detail::chunk_task<body_t>>(chunks), {chunks}};
+    context.tasks[0].setup(&context, 0, chunks);
+    context.tasks[0].execute();
+    pool.run_until([&context]() { return context.remaining.load(std::memory_order_acquire) == 0; });
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename RandomIt, typename OutputIt, typename UnaryOp>
+OutputIt transform(work_stealing_pool& pool, RandomIt first, RandomIt last, OutputIt d_first, UnaryOp op, size_t grain = 0)
+{
+    const size_t count = std::distance(first, last);
+    for_each_chunk(pool, count, chunk_size(pool, count, grain), [&](size_t, size_t begin, size_t end) {
+        std::transform(first + begin, first + end, d_first + begin, op);
+    });
+    return d_first + count;
+}
+
+///Chunks are combined in order, for a fixed grain the result doesn't depend on the thread count
+template<typename RandomIt, typename T, typename ReduceOp, typename TransformOp>
+T transform_reduce(work_stealing_pool& pool, RandomIt first, RandomIt last, T init, ReduceOp reduceOp, TransformOp transformOp, size_t grain = 0)
+{
+    const size_t count = std::distance(first, last);
+    const size_t chunkSize = chunk_size(pool, count, grain);
+    std::vector<T> partials(chunk_count(count, chunkSize));
+
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        T partial = transformOp(first[begin]);
+        for (size_t i = begin + 1; i < end; ++i)
+        {
+            partial = reduceOp(partial, transformOp(first[i]));
+        }
+        partials[chunk] = partial;
+    });
+
+    return std::accumulate(std::begin(partials), std::end(partials), init, reduceOp);
+}
+
+template<typename RandomIt, typename T, typename ReduceOp = std::plus<>>
+T reduce(work_stealing_pool& pool, RandomIt first, RandomIt last, T init, ReduceOp reduceOp = ReduceOp(), size_t grain = 0)
+{
+    using value_t = typename std::iterator_traits<RandomIt>::value_type;
+    return transform_reduce(pool, first, last, init, reduceOp, [](const value_t& v) -> const value_t& { return v; }, grain);
+}
+
+///Two pass blocked scan: reduce every chunk, scan the chunk totals and then scan each chunk from its offset
+template<typename RandomIt, typename OutputIt, typename BinaryOp = std::plus<>>
+OutputIt inclusive_scan(work_stealing_pool& pool, RandomIt first, RandomIt last, OutputIt d_first, BinaryOp op = BinaryOp(), size_t grain = 0)
+{
+    using value_t = typename std::iterator_traits<RandomIt>::value_type;
+
+    const size_t count = std::distance(first, last);
+    const size_t chunkSize = chunk_size(pool, count, grain);
+    const size_t chunks = chunk_count(count, chunkSize);
+    if (chunks <= 1)
+    {
+        return std::inclusive_scan(first, last, d_first, op);
+    }
+
+    std::vector<value_t> offsets(chunks);
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        offsets[chunk] = std::accumulate(first + begin + 1, first + end, value_t(first[begin]), op);
+    });
+    std::inclusive_scan(std::begin(offsets), std::end(offsets), std::begin(offsets), op);
+
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        if (chunk == 0)
+        {
+            std::inclusive_scan(first + begin, first + end, d_first + begin, op);
+        }
+        else
+        {
+            std::inclusive_scan(first + begin, first + end, d_first + begin, op, offsets[chunk - 1]);
+        }
+    });
+    return d_first + count;
+}
+
+///Same two passes as inclusive_scan, d_first[i] = init op first[0] op ... op first[i - 1]
+template<typename RandomIt, typename OutputIt, typename T, typename BinaryOp = std::plus<>>
+OutputIt exclusive_scan(work_stealing_pool& pool, RandomIt first, RandomIt last, OutputIt d_first, T init, BinaryOp op = BinaryOp(), size_t grain = 0)
+{
+    const size_t count = std::distance(first, last);
+    const size_t chunkSize = chunk_size(pool, count, grain);
+    const size_t chunks = chunk_count(count, chunkSize);
+    if (chunks <= 1)
+    {
+        return std::exclusive_scan(first, last, d_first, init, op);
+    }
+
+    std::vector<T> offsets(chunks + 1);
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        offsets[chunk + 1] = std::accumulate(first + begin + 1, first + end, T(first[begin]), op);
+    });
+    offsets[0] = init;
+    std::inclusive_scan(std::begin(offsets), std::end(offsets) - 1, std::begin(offsets), op);
+
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        std::exclusive_scan(first + begin, first + end, d_first + begin, offsets[chunk], op);
+    });
+    return d_first + count;
+}
+
+///d_first[0] = first[0], d_first[i] = op(first[i], first[i - 1]). d_first == first is allowed, the values at chunk
+///boundaries are read before any chunk writes.
+template<typename RandomIt, typename OutputIt, typename BinaryOp = std::minus<>>
+OutputIt adjacent_difference(work_stealing_pool& pool, RandomIt first, RandomIt last, OutputIt d_first, BinaryOp op = BinaryOp(), size_t grain = 0)
+{
+    using value_t = typename std::iterator_traits<RandomIt>::value_type;
+
+    const size_t count = std::distance(first, last);
+    const size_t chunkSize = chunk_size(pool, count, grain);
+    const size_t chunks = chunk_count(count, chunkSize);
+    if (chunks <= 1)
+    {
+        return std::adjacent_difference(first, last, d_first, op);
+    }
+
+    std::vector<value_t> previous(chunks);
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+        previous[chunk] = first[chunk * chunkSize - 1];
+    }
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        // backwards so in place works inside the chunk too
+        for (size_t i = end - 1; i > begin; --i)
+        {
+            d_first[i] = op(first[i], first[i - 1]);
+        }
+        d_first[begin] = chunk == 0 ? value_t(first[begin]) : op(first[begin], previous[chunk]);
+    });
+    return d_first + count;
+}
+
+///Stream compaction: count the kept elements of every chunk, exclusive scan of the counts, then every chunk copies to
+///its offset. Keeps the input order.
+template<typename RandomIt, typename OutputIt, typename Predicate>
+OutputIt copy_if(work_stealing_pool& pool, RandomIt first, RandomIt last, OutputIt d_first, Predicate pred, size_t grain = 0)
+{
+    const size_t count = std::distance(first, last);
+    const size_t chunkSize = chunk_size(pool, count, grain);
+    std::vector<size_t> offsets(chunk_count(count, chunkSize) + 1, 0);
+
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        offsets[chunk + 1] = std::count_if(first + begin, first + end, pred);
+    });
+    std::inclusive_scan(std::begin(offsets), std::end(offsets), std::begin(offsets));
+
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        std::copy_if(first + begin, first + end, d_first + offsets[chunk], pred);
+    });
+    return d_first + offsets.back();
+}
+
+}//parallel
@@ -0,0 +1,318 @@
+/*
+Parallel sorting on top of work_stealing_pool, for the step that usually follows a map/reduce.
+
+  radix_sort / radix_sort_by_key: LSD radix sort on 8 bit digits for integer and floating point keys, stable.
+    Every pass builds one histogram per chunk, scans them digit major (so chunk c writes after chunk c-1 in every
+    bucket) and scatters. Passes where all the keys share the digit are skipped.
+  sample_sort: any comparator, not stable. Splitters are picked from a sorted sample, elements are classified into
+    buckets (plus one bucket per splitter for the elements equal to it, so duplicates don't pile up in one bucket),
+    scattered and every bucket is sorted on its own.
+  top_k: the k first elements in comp order, sorted. Every chunk keeps its own k best in a heap, the candidates are
+    merged at the end.
+
+Same grain convention as parallel_algorithms.h (elements per chunk, 0 = automatic).
+*/
+#pragma once
+
+#include "parallel_algorithms.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional> // std::less
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace parallel
+{
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Maps keys to unsigned integers with the same order
+template<typename Key, typename Enable = void>
+struct radix_traits;
+
+template<typename Key>
+struct radix_traits<Key, typename std::enable_if<std::is_integral<Key>::value>::type>
+{
+    using bits_t = typename std::make_unsigned<Key>::type;
+    static bits_t to_bits(Key key)
+    {
+        if constexpr (std::is_signed<Key>::value)
+        {
+            return static_cast<bits_t>(key) ^ (bits_t(1) << (sizeof(Key) * 8 - 1));
+        }
+        else
+        {
+            return key;
+        }
+    }
+};
+
+template<typename Key>
+struct radix_traits<Key, typename std::enable_if<std::is_floating_point<Key>::value>::type>
+{
+    static_assert(sizeof(Key) == 4 || sizeof(Key) == 8, "float and double only");
+    using bits_t = typename std::conditional<sizeof(Key) == 4, uint32_t, uint64_t>::type;
+    ///negatives get all their bits flipped (reverses their order), positives only the sign. -0 sorts before +0, NaNs at the ends
+    static bits_t to_bits(Key key)
+    {
+        const bits_t bits = std::bit_cast<bits_t>(key);
+        const bits_t signBit = bits_t(1) << (sizeof(Key) * 8 - 1);
+        return (bits & signBit) != 0 ? ~bits : bits | signBit;
+    }
+};
+
+constexpr size_t k_radixBits = 8;
+constexpr size_t k_radixBuckets = size_t(1) << k_radixBits;
+
+struct no_values
+{};
+
+///keys (and values when Value isn't no_values) end up sorted in keys/values, in/out are swapped after every pass
+template<typename Key, typename Value>
+void radix_sort_impl(work_stealing_pool& pool, Key* keys, Value* values, size_t count, size_t grain)
+{
+    using traits_t = radix_traits<Key>;
+    constexpr bool hasValues = !std::is_same<Value, no_values>::value;
+    if (count <= 1)
+    {
+        return;
+    }
+
+    const size_t chunkSize = chunk_size(pool, count, grain);
+    const size_t chunks = chunk_count(count, chunkSize);
+    std::vector<size_t> offsets(chunks * k_radixBuckets);
+
+    std::vector<Key> keyScratch(count);
+    std::vector<Value> valueScratch(hasValues ? count : 0);
+    Key* keysIn = keys;
+    Key* keysOut = keyScratch.data();
+    Value* valuesIn = values;
+    Value* valuesOut = valueScratch.data();
+
+    for (size_t shift = 0; shift < sizeof(Key) * 8; shift += k_radixBits)
+    {
+        const auto digit = [shift](Key key) { return static_cast<size_t>((traits_t::to_bits(key) >> shift) & (k_radixBuckets - 1)); };
+
+        for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+            size_t* histogram = offsets.data() + chunk * k_radixBuckets;
+            std::fill(histogram, histogram + k_radixBuckets, size_t(0));
+            for (size_t i = begin; i < end; ++i)
+            {
+                ++histogram[digit(keysIn[i])];
+            }
+        });
+
+        // digit major exclusive scan over [chunk][digit]
+        size_t sum = 0;
+        bool isSingleBucket = false;
+        for (size_t d = 0; d < k_radixBuckets; ++d)
+        {
+            const size_t bucketBegin = sum;
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+            {
+                size_t& slot = offsets[chunk * k_radixBuckets + d];
+                const size_t bucketCount = slot;
+                slot = sum;
+                sum += bucketCount;
+            }
+            isSingleBucket |= sum - bucketBegin == count;
+        }
+        if (isSingleBucket)
+        {// every key has the same digit, the pass wouldn't move anything
+            continue;
+        }
+
+        for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+            size_t* offset = offsets.data() + chunk * k_radixBuckets;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const size_t target = offset[digit(keysIn[i])]++;
+                keysOut[target] = keysIn[i];
+                if constexpr (hasValues)
+                {
+                    valuesOut[target] = std::move(valuesIn[i]);
+                }
+            }
+        });
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+    }
+
+    if (keysIn != keys)
+    {
+        for_each_chunk(pool, count, chunkSize, [&](size_t, size_t begin, size_t end) {
+            std::copy(keysIn + begin, keysIn + end, keys + begin);
+            if constexpr (hasValues)
+            {
+                std::move(valuesIn + begin, valuesIn + end, values + begin);
+            }
+        });
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Stable, keys have to be integers, float or double
+template<typename Key>
+void radix_sort(work_stealing_pool& pool, Key* keys, size_t count, size_t grain = 0)
+{
+    detail::radix_sort_impl(pool, keys, static_cast<detail::no_values*>(nullptr), count, grain);
+}
+
+///Sorts keys and moves values[i] along with keys[i]. Values have to be default constructible and movable.
+template<typename Key, typename Value>
+void radix_sort_by_key(work_stealing_pool& pool, Key* keys, Value* values, size_t count, size_t grain = 0)
+{
+    detail::radix_sort_impl(pool, keys, values, count, grain);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Not stable. Ranges smaller than a couple of chunks are handed to std::sort.
+template<typename RandomIt, typename Compare = std::less<>>
+void sample_sort(work_stealing_pool& pool, RandomIt first, RandomIt last, Compare comp = Compare(), size_t grain = 0)
+{
+    using value_t = typename std::iterator_traits<RandomIt>::value_type;
+    const size_t count = std::distance(first, last);
+    const size_t chunkSize = chunk_size(pool, count, grain);
+    const size_t chunks = chunk_count(count, chunkSize);
+    constexpr size_t k_oversampling = 16;
+    const size_t targetBuckets = std::min<size_t>(pool.thread_count() * 4, count / (2 * k_oversampling));
+    if (chunks <= 2 || targetBuckets < 2)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    // evenly spaced sample, oversampled so the buckets come out balanced
+    const size_t splitterCount = targetBuckets - 1;
+    std::vector<value_t> splitters;
+    {
+        const size_t sampleCount = (splitterCount + 1) * k_oversampling;
+        std::vector<value_t> sample;
+        sample.reserve(sampleCount);
+        for (size_t i = 0; i < sampleCount; ++i)
+        {
+            sample.push_back(first[i * count / sampleCount]);
+        }
+        std::sort(std::begin(sample), std::end(sample), comp);
+        for (size_t i = 1; i <= splitterCount; ++i)
+        {
+            const value_t& splitter = sample[i * k_oversampling];
+            if (splitters.empty() || comp(splitters.back(), splitter))
+            {
+                splitters.push_back(splitter);
+            }
+        }
+    }
+
+    // bucket 2i: between splitter i-1 and splitter i, bucket 2i+1: equal to splitter i (already sorted)
+    const size_t bucketCount = splitters.size() * 2 + 1;
+    const auto classify = [&](const value_t& value) -> uint32_t {
+        const size_t above = std::upper_bound(std::begin(splitters), std::end(splitters), value, comp) - std::begin(splitters);
+        const bool isEqual = above > 0 && !comp(splitters[above - 1], value);
+        return static_cast<uint32_t>(isEqual ? (above - 1) * 2 + 1 : above * 2);
+    };
+
+    std::vector<uint32_t> buckets(count);
+    std::vector<size_t> offsets(chunks * bucketCount);
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        size_t* histogram = offsets.data() + chunk * bucketCount;
+        std::fill(histogram, histogram + bucketCount, size_t(0));
+        for (size_t i = begin; i < end; ++i)
+        {
+            buckets[i] = classify(first[i]);
+            ++histogram[buckets[i]];
+        }
+    });
+
+    std::vector<size_t> bucketBegin(bucketCount + 1);
+    size_t sum = 0;
+    for (size_t b = 0; b < bucketCount; ++b)
+    {
+        bucketBegin[b] = sum;
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+            size_t& slot = offsets[chunk * bucketCount + b];
+            const size_t chunkBucketCount = slot;
+            slot = sum;
+            sum += chunkBucketCount;
+        }
+    }
+    bucketBegin[bucketCount] = count;
+
+    std::vector<value_t> scratch(count);
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        size_t* offset = offsets.data() + chunk * bucketCount;
+        for (size_t i = begin; i < end; ++i)
+        {
+            scratch[offset[buckets[i]]++] = std::move(first[i]);
+        }
+    });
+
+    // one chunk per bucket, the big ones get stolen while the owner goes through the small ones
+    for_each_chunk(pool, bucketCount, 1, [&](size_t, size_t bucket, size_t) {
+        auto bucketFirst = std::begin(scratch) + bucketBegin[bucket];
+        auto bucketLast = std::begin(scratch) + bucketBegin[bucket + 1];
+        if ((bucket & 1) == 0)
+        {
+            std::sort(bucketFirst, bucketLast, comp);
+        }
+        std::move(bucketFirst, bucketLast, first + bucketBegin[bucket]);
+    });
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Writes the min(k, count) first elements in comp order to d_first, sorted
+///@return end of the output
+template<typename RandomIt, typename OutputIt, typename Compare = std::less<>>
+OutputIt top_k(work_stealing_pool& pool, RandomIt first, RandomIt last, size_t k, OutputIt d_first, Compare comp = Compare(), size_t grain = 0)
+{
+    using value_t = typename std::iterator_traits<RandomIt>::value_type;
+    const size_t count = std::distance(first, last);
+    k = std::min(k, count);
+    if (k == 0)
+    {
+        return d_first;
+    }
+
+    // chunks much bigger than k, otherwise every chunk hands all its elements over to the merge
+    const size_t chunkSize = std::max(chunk_size(pool, count, grain), k * 8);
+    const size_t chunks = chunk_count(count, chunkSize);
+    std::vector<std::vector<value_t>> candidates(chunks);
+
+    for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        // max heap (in comp order) of the k best so far, the worst of them on top
+        std::vector<value_t>& heap = candidates[chunk];
+        const size_t chunkK = std::min(k, end - begin);
+        heap.assign(first + begin, first + begin + chunkK);
+        std::make_heap(std::begin(heap), std::end(heap), comp);
+        for (size_t i = begin + chunkK; i < end; ++i)
+        {
+            if (comp(first[i], heap.front()))
+            {
+                std::pop_heap(std::begin(heap), std::end(heap), comp);
+                heap.back() = first[i];
+                std::push_heap(std::begin(heap), std::end(heap), comp);
+            }
+        }
+    });
+
+    std::vector<value_t> merged;
+    merged.reserve(chunks * k);
+    for (std::vector<value_t>& chunkCandidates : candidates)
+    {
+        std::move(std::begin(chunkCandidates), std::end(chunkCandidates), std::back_inserter(merged));
+    }
+    std::partial_sort(std::begin(merged), std::begin(merged) + k, std::end(merged), comp);
+    return std::move(std::begin(merged), std::begin(merged) + k, d_first);
+}
+
+}//parallel
@@ -0,0 +1,259 @@
+/*
+Fused map/filter/reduce pipelines:
+
+  const int sum = pipeline::source(data)
+      | pipeline::map([](int v) { return v + 1; })
+      | pipeline::filter([](int v) { return v % 3 == 0; })
+      | pipeline::reduce(0, std::plus<>());
+
+Stages are composed into a single push chain, every element goes through map -> filter -> reduce while it is still in
+a register, so there is one pass over the input and no intermediate vectors. source(...).on(pool) runs the same chain
+per chunk on a work_stealing_pool and combines the chunk results in order (deterministic for a fixed grain).
+
+reduce(init, op) is a left fold from init, op(T, element) -> T. A flow on a pool needs to know how to merge the chunk
+results, so it only takes reduce(init, op, combine, identity = T()): every chunk is folded with op from identity and
+the chunk results are folded into init, in order, with combine(T, T) -> T. Counting is
+reduce(size_t(0), [](size_t n, auto&&) { return n + 1; }, std::plus<>()). The result matches the left fold as long
+as combine is associative, identity is neutral for it and combine(a, op(identity, x)) == op(a, x). Without a pool
+combine and identity are unused. A plain reduce(init, op) after on(pool) doesn't compile.
+
+source(container) keeps a reference to the container, which has to outlive the flow: temporaries are rejected.
+*/
+#pragma once
+
+#include "parallel_algorithms.h"
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pipeline
+{
+
+template<typename F>
+struct map_stage
+{
+    F f;
+
+    template<typename Sink>
+    auto wrap(Sink sink) const
+    {
+        return [f = f, sink](auto&& value) mutable { sink(f(std::forward<decltype(value)>(value))); };
+    }
+};
+
+template<typename P>
+struct filter_stage
+{
+    P p;
+
+    template<typename Sink>
+    auto wrap(Sink sink) const
+    {
+        return [p = p, sink](auto&& value) mutable {
+            if (p(value))
+            {
+                sink(std::forward<decltype(value)>(value));
+            }
+        };
+    }
+};
+
+///Combine = void for a fold that only runs on the calling thread
+template<typename T, typename Op, typename Combine = void>
+struct reduce_stage
+{
+    T init;
+    Op op;
+};
+
+template<typename T, typename Op, typename Combine>
+    requires (!std::is_void_v<Combine>)
+struct reduce_stage<T, Op, Combine>
+{
+    T init;
+    Op op;
+    Combine combine;
+    T identity;
+};
+
+template<typename F>
+struct for_each_stage
+{
+    F f;
+};
+
+template<typename F>
+map_stage<F> map(F f) { return {std::move(f)}; }
+
+template<typename P>
+filter_stage<P> filter(P p) { return {std::move(p)}; }
+
+template<typename T, typename Op = std::plus<>>
+reduce_stage<T, Op> reduce(T init, Op op = Op()) { return {std::move(init), std::move(op)}; }
+
+///Reduction that can also run on a pool: chunks fold from identity with op, combine merges the chunk results in order
+template<typename T, typename Op, typename Combine>
+reduce_stage<T, Op, Combine> reduce(T init, Op op, Combine combine, T identity = T())
+{
+    return {std::move(init), std::move(op), std::move(combine), std::move(identity)};
+}
+
+///Terminal stage calling f for every element reaching it. On a pool f runs concurrently from several threads.
+template<typename F>
+for_each_stage<F> for_each(F f) { return {std::move(f)}; }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///IsPooled flows run on m_pool (see on)
+template<typename RandomIt, bool IsPooled, typename... Stages>
+class flow
+{
+public:
+    flow(RandomIt first, RandomIt last, std::tuple<Stages...> stages, work_stealing_pool* pool = nullptr, size_t grain = 0)
+        : m_first(first)
+        , m_last(last)
+        , m_stages(std::move(stages))
+        , m_pool(pool)
+        , m_grain(grain)
+    {}
+
+    ///Runs the pipeline on the pool, grain = 0 lets parallel::chunk_size decide
+    flow<RandomIt, true, Stages...> on(work_stealing_pool& pool, size_t grain = 0) const
+    {
+        return {m_first, m_last, m_stages, &pool, grain};
+    }
+
+    template<typename F>
+    flow<RandomIt, IsPooled, Stages..., map_stage<F>> operator|(map_stage<F> stage) const
+    {
+        return {m_first, m_last, std::tuple_cat(m_stages, std::make_tuple(std::move(stage))), m_pool, m_grain};
+    }
+
+    template<typename P>
+    flow<RandomIt, IsPooled, Stages..., filter_stage<P>> operator|(filter_stage<P> stage) const
+    {
+        return {m_first, m_last, std::tuple_cat(m_stages, std::make_tuple(std::move(stage))), m_pool, m_grain};
+    }
+
+    template<typename T, typename Op, typename Combine>
+    T operator|(const reduce_stage<T, Op, Combine>& stage) const
+    {
+        static_assert(!IsPooled || !std::is_void_v<Combine>,
+            "a reduction on a pool has to say how chunk results merge: reduce(init, op, combine[, identity])");
+
+        const size_t count = std::distance(m_first, m_last);
+        if constexpr (IsPooled)
+        {
+            return reduce_chunks(stage, count);
+        }
+        else
+        {
+            T result = stage.init;
+            auto sink = compose<sizeof...(Stages)>([&stage, &result](auto&& value) {
+                result = stage.op(std::move(result), std::forward<decltype(value)>(value));
+            });
+            for (RandomIt it = m_first, last = m_last; it != last; ++it)
+            {
+                sink(*it);
+            }
+            return result;
+        }
+    }
+
+    template<typename F>
+    void operator|(const for_each_stage<F>& stage) const
+    {
+        auto run_range = [this, &stage](size_t begin, size_t end) {
+            auto sink = compose<sizeof...(Stages)>([&stage](auto&& value) { stage.f(std::forward<decltype(value)>(value)); });
+            for (RandomIt it = m_first + begin, last = m_first + end; it != last; ++it)
+            {
+                sink(*it);
+            }
+        };
+
+        const size_t count = std::distance(m_first, m_last);
+        if (m_pool == nullptr)
+        {
+            run_range(0, count);
+            return;
+        }
+        parallel::for_each_chunk(*m_pool, count, parallel::chunk_size(*m_pool, count, m_grain), [&run_range](size_t, size_t begin, size_t end) {
+            run_range(begin, end);
+        });
+    }
+
+private:
+    // every chunk is folded from identity, the chunk results are combined into init in order
+    template<typename T, typename Op, typename Combine>
+    T reduce_chunks(const reduce_stage<T, Op, Combine>& stage, size_t count) const
+    {
+        struct partial_t
+        {
+            T value; // wrapped so T = bool doesn't pick vector<bool>
+        };
+
+        auto reduce_range = [this, &stage](size_t begin, size_t end, T& partial) {
+            auto sink = compose<sizeof...(Stages)>([&stage, &partial](auto&& value) {
+                partial = stage.op(std::move(partial), std::forward<decltype(value)>(value));
+            });
+            for (RandomIt it = m_first + begin, last = m_first + end; it != last; ++it)
+            {
+                sink(*it);
+            }
+        };
+
+        const size_t chunkSize = parallel::chunk_size(*m_pool, count, m_grain);
+        std::vector<partial_t> partials(parallel::chunk_count(count, chunkSize), partial_t{stage.identity});
+        parallel::for_each_chunk(*m_pool, count, chunkSize, [&reduce_range, &partials](size_t chunk, size_t begin, size_t end) {
+            reduce_range(begin, end, partials[chunk].value);
+        });
+
+        T result = stage.init;
+        for (partial_t& partial : partials)
+        {
+            result = stage.combine(std::move(result), std::move(partial.value));
+        }
+        return result;
+    }
+
+    // wraps the sink with the stages from last to first so the first stage ends up outermost
+    template<size_t I, typename Sink>
+    auto compose(Sink sink) const
+    {
+        if constexpr (I == 0)
+        {
+            return sink;
+        }
+        else
+        {
+            return compose<I - 1>(std::get<I - 1>(m_stages).wrap(std::move(sink)));
+        }
+    }
+
+    RandomIt m_first;
+    RandomIt m_last;
+    std::tuple<Stages...> m_stages;
+    work_stealing_pool* m_pool;
+    size_t m_grain;
+};
+
+template<typename RandomIt>
+flow<RandomIt, false> source(RandomIt first, RandomIt last)
+{
+    return flow<RandomIt, false>(first, last, std::tuple<>());
+}
+
+template<typename Container>
+auto source(const Container& container)
+{
+    return source(std::begin(container), std::end(container));
+}
+
+///The flow would point into a destroyed container
+template<typename Container>
+auto source(const Container&& container) = delete;
+
+}//pipeline
@@ -0,0 +1,262 @@
+/*
+Parallel group-by: reduce_by_key folds all the values sharing a key.
+
+  1. every thread inserts its chunks into its own set of P open-addressing tables, the partition is picked by the
+     high bits of the key hash so no locking is needed
+  2. partitions are merged in parallel, partition p only looks at the p-th table of every thread
+  3. partitions are concatenated into the output (prefix sum of their sizes, copied in parallel)
+
+The partition sizes are returned in reduce_by_key_stats, skew = largest / mean partition, 1.0 is a perfect balance.
+*/
+#pragma once
+
+#include "parallel_algorithms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional> // std::hash
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct reduce_by_key_options
+{
+    size_t partitionCount = 0; // rounded to a power of 2, 0 = 4 per thread
+    size_t grain = 0; // elements per chunk, 0 = automatic
+};
+
+struct reduce_by_key_stats
+{
+    size_t partitionCount = 0;
+    size_t minPartitionSize = 0;
+    size_t maxPartitionSize = 0;
+    double meanPartitionSize = 0.0;
+    double stddevPartitionSize = 0.0;
+    double skew = 0.0;
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///murmur3 finalizer, std::hash of integers is the identity which would put every small key in partition 0
+inline uint64_t mix_hash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+template<typename Key, typename Hash>
+struct mixed_hash
+{
+    Hash hasher;
+    uint64_t operator()(const Key& key) const { return mix_hash(static_cast<uint64_t>(hasher(key))); }
+};
+
+///Linear probing table, only insert-or-fold is needed by reduce_by_key. Load factor is kept under 3/4.
+///A control byte per slot (0 = empty, otherwise 0x80 | 7 hash bits) filters most key compares without storing hashes.
+template<typename Key, typename Value, typename HashOp>
+class open_table
+{
+public:
+    using entry_t = std::pair<Key, Value>;
+
+public:
+    explicit open_table(HashOp hashOp = HashOp()) : m_hashOp(hashOp) {}
+
+    template<typename ReduceOp>
+    void fold(const Key& key, uint64_t hash, Value&& value, ReduceOp& reduceOp)
+    {
+        if ((m_size + 1) * 4 > m_entries.size() * 3)
+        {
+            grow();
+        }
+
+        const uint8_t tag = tag_of(hash);
+        const size_t mask = m_entries.size() - 1;
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+        {
+            if (m_control[slot] == 0)
+            {
+                m_control[slot] = tag;
+                m_entries[slot] = entry_t(key, std::move(value));
+                ++m_size;
+                return;
+            }
+            if (m_control[slot] == tag && m_entries[slot].first == key)
+            {
+                m_entries[slot].second = reduceOp(std::move(m_entries[slot].second), std::move(value));
+                return;
+            }
+        }
+    }
+
+    template<typename ReduceOp>
+    void merge(open_table&& other, ReduceOp& reduceOp)
+    {
+        for (size_t slot = 0; slot < other.m_entries.size(); ++slot)
+        {
+            if (other.m_control[slot] != 0)
+            {
+                entry_t& entry = other.m_entries[slot];
+                fold(entry.first, m_hashOp(entry.first), std::move(entry.second), reduceOp);
+            }
+        }
+        other = open_table(m_hashOp);
+    }
+
+    template<typename OutputIt>
+    OutputIt copy_to(OutputIt out) const
+    {
+        for (size_t slot = 0; slot < m_entries.size(); ++slot)
+        {
+            if (m_control[slot] != 0)
+            {
+                *out++ = m_entries[slot];
+            }
+        }
+        return out;
+    }
+
+    size_t size() const { return m_size; }
+
+private:
+    static uint8_t tag_of(uint64_t hash) { return static_cast<uint8_t>(0x80 | ((hash >> 32) & 0x7F)); }
+
+    void grow()
+    {
+        open_table bigger(m_hashOp);
+        const size_t capacity = std::max<size_t>(16, m_entries.size() * 2);
+        bigger.m_entries.resize(capacity);
+        bigger.m_control.assign(capacity, 0);
+
+        const size_t mask = capacity - 1;
+        for (size_t slot = 0; slot < m_entries.size(); ++slot)
+        {
+            if (m_control[slot] != 0)
+            {
+                size_t target = m_hashOp(m_entries[slot].first) & mask;
+                while (bigger.m_control[target] != 0)
+                {
+                    target = (target + 1) & mask;
+                }
+                bigger.m_control[target] = m_control[slot];
+                bigger.m_entries[target] = std::move(m_entries[slot]);
+            }
+        }
+        bigger.m_size = m_size;
+        *this = std::move(bigger);
+    }
+
+    HashOp m_hashOp;
+    std::vector<entry_t> m_entries;
+    std::vector<uint8_t> m_control;
+    size_t m_size = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///@return one (key, reduced value) per distinct keyOp(element), grouped by partition, order inside is unspecified
+template<typename RandomIt, typename KeyOp, typename ValueOp, typename ReduceOp,
+    typename Key = typename std::decay<typename std::invoke_result<KeyOp, typename std::iterator_traits<RandomIt>::reference>::type>::type,
+    typename Value = typename std::decay<typename std::invoke_result<ValueOp, typename std::iterator_traits<RandomIt>::reference>::type>::type,
+    typename Hash = std::hash<Key>>
+std::vector<std::pair<Key, Value>> reduce_by_key(work_stealing_pool& pool, RandomIt first, RandomIt last,
+    KeyOp keyOp, ValueOp valueOp, ReduceOp reduceOp,
+    reduce_by_key_stats* o_stats = nullptr, const reduce_by_key_options& options = reduce_by_key_options(), Hash hasher = Hash())
+{
+    const detail::mixed_hash<Key, Hash> hashOp{hasher};
+    using table_t = detail::open_table<Key, Value, detail::mixed_hash<Key, Hash>>;
+
+    size_t partitionCount = 1;
+    const size_t wantedPartitions = options.partitionCount > 0 ? options.partitionCount : pool.thread_count() * 4;
+    unsigned partitionBits = 0;
+    while (partitionCount < wantedPartitions)
+    {
+        partitionCount <<= 1;
+        ++partitionBits;
+    }
+    auto partition_of = [partitionBits](uint64_t hash) -> size_t {
+        return partitionBits == 0 ? 0 : static_cast<size_t>(hash >> (64 - partitionBits));
+    };
+
+    // one row of tables per worker plus one for the calling thread
+    const size_t threadSlots = pool.thread_count() + 1;
+    std::vector<std::vector<table_t>> localTables(threadSlots, std::vector<table_t>(partitionCount, table_t(hashOp)));
+
+    const size_t count = std::distance(first, last);
+    parallel::for_each_chunk(pool, count, parallel::chunk_size(pool, count, options.grain), [&](size_t, size_t begin, size_t end) {
+        const int worker = pool.current_worker();
+        std::vector<table_t>& tables = localTables[worker >= 0 ? static_cast<size_t>(worker) : threadSlots - 1];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const auto& element = first[i];
+            Key key = keyOp(element);
+            const uint64_t hash = hashOp(key);
+            tables[partition_of(hash)].fold(key, hash, Value(valueOp(element)), reduceOp);
+        }
+    });
+
+    // merge into the biggest local table of each partition, single threaded runs end up copying nothing
+    std::vector<table_t> partitions(partitionCount, table_t(hashOp));
+    parallel::for_each_chunk(pool, partitionCount, 1, [&](size_t partition, size_t, size_t) {
+        size_t biggest = 0;
+        for (size_t t = 1; t < threadSlots; ++t)
+        {
+            if (localTables[t][partition].size() > localTables[biggest][partition].size())
+            {
+                biggest = t;
+            }
+        }
+        table_t merged = std::move(localTables[biggest][partition]);
+        for (size_t t = 0; t < threadSlots; ++t)
+        {
+            if (t != biggest && localTables[t][partition].size() > 0)
+            {
+                merged.merge(std::move(localTables[t][partition]), reduceOp);
+            }
+        }
+        partitions[partition] = std::move(merged);
+    });
+    localTables.clear();
+
+    std::vector<size_t> offsets(partitionCount + 1, 0);
+    for (size_t p = 0; p < partitionCount; ++p)
+    {
+        offsets[p + 1] = offsets[p] + partitions[p].size();
+    }
+
+    std::vector<std::pair<Key, Value>> output(offsets.back());
+    parallel::for_each_chunk(pool, partitionCount, 1, [&](size_t partition, size_t, size_t) {
+        partitions[partition].copy_to(output.begin() + offsets[partition]);
+        partitions[partition] = table_t(hashOp);
+    });
+
+    if (o_stats != nullptr)
+    {
+        reduce_by_key_stats stats;
+        stats.partitionCount = partitionCount;
+        stats.minPartitionSize = output.size();
+        double sumSquares = 0.0;
+        for (size_t p = 0; p < partitionCount; ++p)
+        {
+            const size_t size = offsets[p + 1] - offsets[p];
+            stats.minPartitionSize = std::min(stats.minPartitionSize, size);
+            stats.maxPartitionSize = std::max(stats.maxPartitionSize, size);
+            sumSquares += double(size) * double(size);
+        }
+        stats.meanPartitionSize = double(output.size()) / double(partitionCount);
+        stats.stddevPartitionSize = std::sqrt(std::max(0.0, sumSquares / double(partitionCount) - stats.meanPartitionSize * stats.meanPartitionSize));
+        stats.skew = stats.meanPartitionSize > 0.0 ? double(stats.maxPartitionSize) / stats.meanPartitionSize : 0.0;
+        *o_stats = stats;
+    }
+
+    return output;
+}
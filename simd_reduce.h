@@ -0,0 +1,659 @@
+/*
+Explicit SIMD reductions (sum/min/max/dot over int32 and float) with runtime dispatch scalar / AVX2 / AVX-512.
+
+reduce_mode::fast uses as many accumulators as the ISA likes, the float result depends on the ISA that ran.
+reduce_mode::deterministic fixes the shape of the float computation:
+  - the input is cut in blocks of k_deterministicBlock elements
+  - inside a block, lane j (of 16) adds the elements i % 16 == j in order, then lanes are folded 8+8, 4+4, 2+2, 1+1
+  - block results are combined pairwise (neighbours first), a shape that only depends on the element count
+Every ISA and every thread count walks the same shape with no FMA contraction, so results are bit-identical.
+
+Integer reductions are exact (64-bit accumulation) so both modes are deterministic for them.
+NaN handling of min/max is unspecified.
+*/
+#pragma once
+
+#include "parallel_algorithms.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_REDUCE_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_REDUCE_X86 0
+#endif
+
+// the deterministic kernels rely on a*b+c being two roundings everywhere
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+// gcc's own avx512 intrinsics trip these (_mm512_undefined_*)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#elif defined(__clang__)
+#pragma clang fp contract(off)
+#endif
+
+namespace simd
+{
+
+enum class isa { scalar, avx2, avx512 };
+enum class reduce_mode { fast, deterministic };
+
+constexpr size_t k_lanes = 16;
+constexpr size_t k_deterministicBlock = 4096;
+
+inline const char* isa_name(isa value)
+{
+    switch (value)
+    {
+        case isa::scalar: return "scalar";
+        case isa::avx2: return "avx2";
+        case isa::avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+inline isa detected_isa()
+{
+#if SIMD_REDUCE_X86
+    static const isa s_detected = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        {
+            return isa::avx512;
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return isa::avx2;
+        }
+        return isa::scalar;
+    }();
+    return s_detected;
+#else
+    return isa::scalar;
+#endif
+}
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline isa& isa_override()
+{
+    static isa s_isa = detected_isa();
+    return s_isa;
+}
+
+inline float fold_lanes(float* lanes)
+{
+    for (size_t width = k_lanes / 2; width > 0; width /= 2)
+    {
+        for (size_t j = 0; j < width; ++j)
+        {
+            lanes[j] = lanes[j] + lanes[j + width];
+        }
+    }
+    return lanes[0];
+}
+
+///Neighbours first pairwise combination, only depends on values.size()
+inline float fold_pairwise(std::vector<float>& values)
+{
+    if (values.empty())
+    {
+        return 0.f;
+    }
+    size_t count = values.size();
+    while (count > 1)
+    {
+        const size_t half = count / 2;
+        for (size_t i = 0; i < half; ++i)
+        {
+            values[i] = values[2 * i] + values[2 * i + 1];
+        }
+        if (count % 2 != 0)
+        {
+            values[half] = values[count - 1];
+        }
+        count = half + count % 2;
+    }
+    return values[0];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// scalar
+
+struct kernels_scalar
+{
+    static int64_t sum(const int32_t* data, size_t count)
+    {
+        int64_t accum = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            accum += data[i];
+        }
+        return accum;
+    }
+    static int64_t dot(const int32_t* a, const int32_t* b, size_t count)
+    {
+        int64_t accum = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            accum += int64_t(a[i]) * int64_t(b[i]);
+        }
+        return accum;
+    }
+    static int32_t min(const int32_t* data, size_t count)
+    {
+        int32_t accum = std::numeric_limits<int32_t>::max();
+        for (size_t i = 0; i < count; ++i)
+        {
+            accum = data[i] < accum ? data[i] : accum;
+        }
+        return accum;
+    }
+    static int32_t max(const int32_t* data, size_t count)
+    {
+        int32_t accum = std::numeric_limits<int32_t>::lowest();
+        for (size_t i = 0; i < count; ++i)
+        {
+            accum = data[i] > accum ? data[i] : accum;
+        }
+        return accum;
+    }
+    static float min(const float* data, size_t count)
+    {
+        float accum = std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < count; ++i)
+        {
+            accum = data[i] < accum ? data[i] : accum;
+        }
+        return accum;
+    }
+    static float max(const float* data, size_t count)
+    {
+        float accum = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < count; ++i)
+        {
+            accum = data[i] > accum ? data[i] : accum;
+        }
+        return accum;
+    }
+    // deterministic shape is also the fast one here
+    static float sum(const float* data, size_t count)
+    {
+        float lanes[k_lanes] = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            lanes[i % k_lanes] = lanes[i % k_lanes] + data[i];
+        }
+        return fold_lanes(lanes);
+    }
+    static float dot(const float* a, const float* b, size_t count)
+    {
+        float lanes[k_lanes] = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float product = a[i] * b[i];
+            lanes[i % k_lanes] = lanes[i % k_lanes] + product;
+        }
+        return fold_lanes(lanes);
+    }
+    static float sum_fast(const float* data, size_t count) { return sum(data, count); }
+    static float dot_fast(const float* a, const float* b, size_t count) { return dot(a, b, count); }
+};
+
+#if SIMD_REDUCE_X86
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2, two 8 wide registers make the 16 canonical lanes
+
+#define SIMD_REDUCE_AVX2 __attribute__((target("avx2")))
+
+struct kernels_avx2
+{
+    SIMD_REDUCE_AVX2 static int64_t hsum_epi64(__m256i v)
+    {
+        alignas(32) int64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    SIMD_REDUCE_AVX2 static int64_t sum(const int32_t* data, size_t count)
+    {
+        __m256i accum0 = _mm256_setzero_si256();
+        __m256i accum1 = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            accum0 = _mm256_add_epi64(accum0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+            accum1 = _mm256_add_epi64(accum1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+        }
+        return hsum_epi64(_mm256_add_epi64(accum0, accum1)) + kernels_scalar::sum(data + i, count - i);
+    }
+
+    SIMD_REDUCE_AVX2 static int64_t dot(const int32_t* a, const int32_t* b, size_t count)
+    {
+        __m256i accum = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            // mul_epi32 multiplies the even 32 bit lanes into 64 bits, shift the odd ones down for a second pass
+            accum = _mm256_add_epi64(accum, _mm256_mul_epi32(va, vb));
+            accum = _mm256_add_epi64(accum, _mm256_mul_epi32(_mm256_srli_epi64(va, 32), _mm256_srli_epi64(vb, 32)));
+        }
+        return hsum_epi64(accum) + kernels_scalar::dot(a + i, b + i, count - i);
+    }
+
+    SIMD_REDUCE_AVX2 static int32_t min(const int32_t* data, size_t count)
+    {
+        __m256i accum = _mm256_set1_epi32(std::numeric_limits<int32_t>::max());
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            accum = _mm256_min_epi32(accum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+        }
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), accum);
+        return std::min(*std::min_element(lanes, lanes + 8), kernels_scalar::min(data + i, count - i));
+    }
+
+    SIMD_REDUCE_AVX2 static int32_t max(const int32_t* data, size_t count)
+    {
+        __m256i accum = _mm256_set1_epi32(std::numeric_limits<int32_t>::lowest());
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            accum = _mm256_max_epi32(accum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+        }
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), accum);
+        return std::max(*std::max_element(lanes, lanes + 8), kernels_scalar::max(data + i, count - i));
+    }
+
+    SIMD_REDUCE_AVX2 static float min(const float* data, size_t count)
+    {
+        __m256 accum = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            accum = _mm256_min_ps(_mm256_loadu_ps(data + i), accum);
+        }
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, accum);
+        return std::min(*std::min_element(lanes, lanes + 8), kernels_scalar::min(data + i, count - i));
+    }
+
+    SIMD_REDUCE_AVX2 static float max(const float* data, size_t count)
+    {
+        __m256 accum = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            accum = _mm256_max_ps(_mm256_loadu_ps(data + i), accum);
+        }
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, accum);
+        return std::max(*std::max_element(lanes, lanes + 8), kernels_scalar::max(data + i, count - i));
+    }
+
+    ///canonical 16 lane shape, the tail is zero padded (x + 0.f == x for every x the lanes can hold)
+    SIMD_REDUCE_AVX2 static float sum(const float* data, size_t count)
+    {
+        __m256 lanesLo = _mm256_setzero_ps();
+        __m256 lanesHi = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + k_lanes <= count; i += k_lanes)
+        {
+            lanesLo = _mm256_add_ps(lanesLo, _mm256_loadu_ps(data + i));
+            lanesHi = _mm256_add_ps(lanesHi, _mm256_loadu_ps(data + i + 8));
+        }
+        alignas(32) float lanes[k_lanes];
+        _mm256_store_ps(lanes, lanesLo);
+        _mm256_store_ps(lanes + 8, lanesHi);
+        for (size_t j = 0; i + j < count; ++j)
+        {
+            lanes[j] = lanes[j] + data[i + j];
+        }
+        return fold_lanes(lanes);
+    }
+
+    SIMD_REDUCE_AVX2 static float dot(const float* a, const float* b, size_t count)
+    {
+        __m256 lanesLo = _mm256_setzero_ps();
+        __m256 lanesHi = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + k_lanes <= count; i += k_lanes)
+        {
+            lanesLo = _mm256_add_ps(lanesLo, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+            lanesHi = _mm256_add_ps(lanesHi, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+        }
+        alignas(32) float lanes[k_lanes];
+        _mm256_store_ps(lanes, lanesLo);
+        _mm256_store_ps(lanes + 8, lanesHi);
+        for (size_t j = 0; i + j < count; ++j)
+        {
+            const float product = a[i + j] * b[i + j];
+            lanes[j] = lanes[j] + product;
+        }
+        return fold_lanes(lanes);
+    }
+
+    ///4 independent 16 lane groups to hide the add latency
+    SIMD_REDUCE_AVX2 static float sum_fast(const float* data, size_t count)
+    {
+        __m256 accum[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            accum[0] = _mm256_add_ps(accum[0], _mm256_loadu_ps(data + i));
+            accum[1] = _mm256_add_ps(accum[1], _mm256_loadu_ps(data + i + 8));
+            accum[2] = _mm256_add_ps(accum[2], _mm256_loadu_ps(data + i + 16));
+            accum[3] = _mm256_add_ps(accum[3], _mm256_loadu_ps(data + i + 24));
+        }
+        alignas(32) float lanes[k_lanes];
+        _mm256_store_ps(lanes, _mm256_add_ps(accum[0], accum[2]));
+        _mm256_store_ps(lanes + 8, _mm256_add_ps(accum[1], accum[3]));
+        return fold_lanes(lanes) + sum(data + i, count - i);
+    }
+
+    SIMD_REDUCE_AVX2 static float dot_fast(const float* a, const float* b, size_t count)
+    {
+        __m256 accum[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            for (size_t k = 0; k < 4; ++k)
+            {
+                accum[k] = _mm256_add_ps(accum[k], _mm256_mul_ps(_mm256_loadu_ps(a + i + 8 * k), _mm256_loadu_ps(b + i + 8 * k)));
+            }
+        }
+        alignas(32) float lanes[k_lanes];
+        _mm256_store_ps(lanes, _mm256_add_ps(accum[0], accum[2]));
+        _mm256_store_ps(lanes + 8, _mm256_add_ps(accum[1], accum[3]));
+        return fold_lanes(lanes) + dot(a + i, b + i, count - i);
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX-512, one register is exactly the 16 canonical lanes, tails use masked loads
+
+#define SIMD_REDUCE_AVX512 __attribute__((target("avx512f,avx512dq")))
+
+struct kernels_avx512
+{
+    SIMD_REDUCE_AVX512 static __mmask16 tail_mask(size_t remaining)
+    {
+        return static_cast<__mmask16>((1u << remaining) - 1);
+    }
+
+    SIMD_REDUCE_AVX512 static int64_t sum(const int32_t* data, size_t count)
+    {
+        __m512i accum0 = _mm512_setzero_si512();
+        __m512i accum1 = _mm512_setzero_si512();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512i v = _mm512_loadu_si512(data + i);
+            accum0 = _mm512_add_epi64(accum0, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+            accum1 = _mm512_add_epi64(accum1, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+        }
+        return _mm512_reduce_add_epi64(_mm512_add_epi64(accum0, accum1)) + kernels_scalar::sum(data + i, count - i);
+    }
+
+    SIMD_REDUCE_AVX512 static int64_t dot(const int32_t* a, const int32_t* b, size_t count)
+    {
+        __m512i accum = _mm512_setzero_si512();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512i va = _mm512_loadu_si512(a + i);
+            const __m512i vb = _mm512_loadu_si512(b + i);
+            accum = _mm512_add_epi64(accum, _mm512_mul_epi32(va, vb));
+            accum = _mm512_add_epi64(accum, _mm512_mul_epi32(_mm512_srli_epi64(va, 32), _mm512_srli_epi64(vb, 32)));
+        }
+        return _mm512_reduce_add_epi64(accum) + kernels_scalar::dot(a + i, b + i, count - i);
+    }
+
+    SIMD_REDUCE_AVX512 static int32_t min(const int32_t* data, size_t count)
+    {
+        __m512i accum = _mm512_set1_epi32(std::numeric_limits<int32_t>::max());
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            accum = _mm512_min_epi32(accum, _mm512_loadu_si512(data + i));
+        }
+        return std::min(_mm512_reduce_min_epi32(accum), kernels_scalar::min(data + i, count - i));
+    }
+
+    SIMD_REDUCE_AVX512 static int32_t max(const int32_t* data, size_t count)
+    {
+        __m512i accum = _mm512_set1_epi32(std::numeric_limits<int32_t>::lowest());
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            accum = _mm512_max_epi32(accum, _mm512_loadu_si512(data + i));
+        }
+        return std::max(_mm512_reduce_max_epi32(accum), kernels_scalar::max(data + i, count - i));
+    }
+
+    SIMD_REDUCE_AVX512 static float min(const float* data, size_t count)
+    {
+        __m512 accum = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            accum = _mm512_min_ps(_mm512_loadu_ps(data + i), accum);
+        }
+        return std::min(_mm512_reduce_min_ps(accum), kernels_scalar::min(data + i, count - i));
+    }
+
+    SIMD_REDUCE_AVX512 static float max(const float* data, size_t count)
+    {
+        __m512 accum = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            accum = _mm512_max_ps(_mm512_loadu_ps(data + i), accum);
+        }
+        return std::max(_mm512_reduce_max_ps(accum), kernels_scalar::max(data + i, count - i));
+    }
+
+    SIMD_REDUCE_AVX512 static float sum(const float* data, size_t count)
+    {
+        __m512 accum = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + k_lanes <= count; i += k_lanes)
+        {
+            accum = _mm512_add_ps(accum, _mm512_loadu_ps(data + i));
+        }
+        if (i < count)
+        {
+            accum = _mm512_add_ps(accum, _mm512_maskz_loadu_ps(tail_mask(count - i), data + i));
+        }
+        alignas(64) float lanes[k_lanes];
+        _mm512_store_ps(lanes, accum);
+        return fold_lanes(lanes);
+    }
+
+    SIMD_REDUCE_AVX512 static float dot(const float* a, const float* b, size_t count)
+    {
+        __m512 accum = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + k_lanes <= count; i += k_lanes)
+        {
+            accum = _mm512_add_ps(accum, _mm512_mul_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+        }
+        if (i < count)
+        {
+            const __mmask16 mask = tail_mask(count - i);
+            accum = _mm512_add_ps(accum, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i)));
+        }
+        alignas(64) float lanes[k_lanes];
+        _mm512_store_ps(lanes, accum);
+        return fold_lanes(lanes);
+    }
+
+    SIMD_REDUCE_AVX512 static float sum_fast(const float* data, size_t count)
+    {
+        __m512 accum[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        size_t i = 0;
+        for (; i + 64 <= count; i += 64)
+        {
+            for (size_t k = 0; k < 4; ++k)
+            {
+                accum[k] = _mm512_add_ps(accum[k], _mm512_loadu_ps(data + i + 16 * k));
+            }
+        }
+        const __m512 total = _mm512_add_ps(_mm512_add_ps(accum[0], accum[1]), _mm512_add_ps(accum[2], accum[3]));
+        return _mm512_reduce_add_ps(total) + sum(data + i, count - i);
+    }
+
+    SIMD_REDUCE_AVX512 static float dot_fast(const float* a, const float* b, size_t count)
+    {
+        __m512 accum[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        size_t i = 0;
+        for (; i + 64 <= count; i += 64)
+        {
+            for (size_t k = 0; k < 4; ++k)
+            {
+                accum[k] = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16 * k), _mm512_loadu_ps(b + i + 16 * k), accum[k]);
+            }
+        }
+        const __m512 total = _mm512_add_ps(_mm512_add_ps(accum[0], accum[1]), _mm512_add_ps(accum[2], accum[3]));
+        return _mm512_reduce_add_ps(total) + dot(a + i, b + i, count - i);
+    }
+};
+
+#undef SIMD_REDUCE_AVX2
+#undef SIMD_REDUCE_AVX512
+#endif // SIMD_REDUCE_X86
+
+///Calls kernels_<isa>::f(args...) for the active ISA
+#if SIMD_REDUCE_X86
+#define SIMD_REDUCE_DISPATCH(f, ...) \
+    switch (detail::isa_override()) \
+    { \
+        case isa::avx512: return detail::kernels_avx512::f(__VA_ARGS__); \
+        case isa::avx2: return detail::kernels_avx2::f(__VA_ARGS__); \
+        case isa::scalar: break; \
+    } \
+    return detail::kernels_scalar::f(__VA_ARGS__)
+#else
+#define SIMD_REDUCE_DISPATCH(f, ...) return detail::kernels_scalar::f(__VA_ARGS__)
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Restricts dispatch to a narrower ISA (benchmarks, reproducing results of older hosts). Can't go above detected_isa().
+inline void set_isa(isa value)
+{
+    detail::isa_override() = std::min(value, detected_isa());
+}
+inline isa active_isa() { return detail::isa_override(); }
+
+inline int64_t sum(const int32_t* data, size_t count) { SIMD_REDUCE_DISPATCH(sum, data, count); }
+inline int64_t dot(const int32_t* a, const int32_t* b, size_t count) { SIMD_REDUCE_DISPATCH(dot, a, b, count); }
+inline int32_t min(const int32_t* data, size_t count) { SIMD_REDUCE_DISPATCH(min, data, count); }
+inline int32_t max(const int32_t* data, size_t count) { SIMD_REDUCE_DISPATCH(max, data, count); }
+inline float min(const float* data, size_t count) { SIMD_REDUCE_DISPATCH(min, data, count); }
+inline float max(const float* data, size_t count) { SIMD_REDUCE_DISPATCH(max, data, count); }
+
+namespace detail
+{
+inline float sum_block(const float* data, size_t count) { SIMD_REDUCE_DISPATCH(sum, data, count); }
+inline float dot_block(const float* a, const float* b, size_t count) { SIMD_REDUCE_DISPATCH(dot, a, b, count); }
+inline float sum_fast(const float* data, size_t count) { SIMD_REDUCE_DISPATCH(sum_fast, data, count); }
+inline float dot_fast(const float* a, const float* b, size_t count) { SIMD_REDUCE_DISPATCH(dot_fast, a, b, count); }
+}//detail
+
+#undef SIMD_REDUCE_DISPATCH
+
+inline float sum(const float* data, size_t count, reduce_mode mode = reduce_mode::fast)
+{
+    if (mode == reduce_mode::fast)
+    {
+        return detail::sum_fast(data, count);
+    }
+    std::vector<float> blocks((count + k_deterministicBlock - 1) / k_deterministicBlock);
+    for (size_t block = 0; block < blocks.size(); ++block)
+    {
+        const size_t begin = block * k_deterministicBlock;
+        blocks[block] = detail::sum_block(data + begin, std::min(k_deterministicBlock, count - begin));
+    }
+    return detail::fold_pairwise(blocks);
+}
+
+inline float dot(const float* a, const float* b, size_t count, reduce_mode mode = reduce_mode::fast)
+{
+    if (mode == reduce_mode::fast)
+    {
+        return detail::dot_fast(a, b, count);
+    }
+    std::vector<float> blocks((count + k_deterministicBlock - 1) / k_deterministicBlock);
+    for (size_t block = 0; block < blocks.size(); ++block)
+    {
+        const size_t begin = block * k_deterministicBlock;
+        blocks[block] = detail::dot_block(a + begin, b + begin, std::min(k_deterministicBlock, count - begin));
+    }
+    return detail::fold_pairwise(blocks);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parallel versions, chunks are made of whole deterministic blocks so the shape doesn't change with the thread count
+
+inline float sum(work_stealing_pool& pool, const float* data, size_t count, reduce_mode mode = reduce_mode::deterministic)
+{
+    std::vector<float> blocks((count + k_deterministicBlock - 1) / k_deterministicBlock);
+    parallel::for_each_chunk(pool, blocks.size(), parallel::chunk_size(pool, blocks.size(), 16), [&](size_t, size_t first, size_t last) {
+        for (size_t block = first; block < last; ++block)
+        {
+            const size_t begin = block * k_deterministicBlock;
+            const size_t size = std::min(k_deterministicBlock, count - begin);
+            blocks[block] = mode == reduce_mode::fast ? detail::sum_fast(data + begin, size) : detail::sum_block(data + begin, size);
+        }
+    });
+    return detail::fold_pairwise(blocks);
+}
+
+inline float dot(work_stealing_pool& pool, const float* a, const float* b, size_t count, reduce_mode mode = reduce_mode::deterministic)
+{
+    std::vector<float> blocks((count + k_deterministicBlock - 1) / k_deterministicBlock);
+    parallel::for_each_chunk(pool, blocks.size(), parallel::chunk_size(pool, blocks.size(), 16), [&](size_t, size_t first, size_t last) {
+        for (size_t block = first; block < last; ++block)
+        {
+            const size_t begin = block * k_deterministicBlock;
+            const size_t size = std::min(k_deterministicBlock, count - begin);
+            blocks[block] = mode == reduce_mode::fast ? detail::dot_fast(a + begin, b + begin, size) : detail::dot_block(a + begin, b + begin, size);
+        }
+    });
+    return detail::fold_pairwise(blocks);
+}
+
+inline int64_t sum(work_stealing_pool& pool, const int32_t* data, size_t count)
+{
+    const size_t chunkSize = parallel::chunk_size(pool, count, 0);
+    std::vector<int64_t> partials(parallel::chunk_count(count, chunkSize));
+    parallel::for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        partials[chunk] = sum(data + begin, end - begin);
+    });
+    return std::accumulate(std::begin(partials), std::end(partials), int64_t(0));
+}
+
+}//simd
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
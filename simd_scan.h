@@ -0,0 +1,382 @@
+/*
+Prefix sums and adjacent differences of int32 and float with in-register SIMD scans, same runtime dispatch as
+simd_reduce.h (simd::set_isa applies to both).
+
+A register of W lanes is scanned in log2(W) shift+add steps (x += x << 1 lane, x += x << 2 lanes, ...), then the
+running total of the previous registers is broadcast and added. The pool versions are the two-pass blocked scan of
+parallel::inclusive_scan: reduce every chunk with simd::sum, scan the chunk totals, then every chunk scans from its
+offset. Outputs are written in place of pre-sized buffers (out == in is allowed).
+
+int32 results wrap like the sequential loop, float results differ from std::inclusive_scan in the last bits since the
+additions are associated differently.
+*/
+#pragma once
+
+#include "simd_reduce.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace simd
+{
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct scan_scalar
+{
+    template<typename T>
+    static T inclusive_scan(const T* in, size_t count, T* out, T carry)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            carry = wrapping_add(carry, in[i]);
+            out[i] = carry;
+        }
+        return carry;
+    }
+    template<typename T>
+    static T exclusive_scan(const T* in, size_t count, T* out, T carry)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const T value = in[i];
+            out[i] = carry;
+            carry = wrapping_add(carry, value);
+        }
+        return carry;
+    }
+    ///out[i] = in[i] - in[i - 1], in[-1] = previous. Walks backwards so out == in works.
+    template<typename T>
+    static void adjacent_difference(const T* in, size_t count, T* out, T previous)
+    {
+        for (size_t i = count; i > 1; --i)
+        {
+            out[i - 1] = wrapping_sub(in[i - 1], in[i - 2]);
+        }
+        if (count > 0)
+        {
+            out[0] = wrapping_sub(in[0], previous);
+        }
+    }
+
+    static int32_t wrapping_add(int32_t a, int32_t b) { return static_cast<int32_t>(uint32_t(a) + uint32_t(b)); }
+    static int32_t wrapping_sub(int32_t a, int32_t b) { return static_cast<int32_t>(uint32_t(a) - uint32_t(b)); }
+    static float wrapping_add(float a, float b) { return a + b; }
+    static float wrapping_sub(float a, float b) { return a - b; }
+};
+
+#if SIMD_REDUCE_X86
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2: the byte shifts only work inside 128 bit lanes, the low lane total is then added to the high lane
+
+#define SIMD_SCAN_AVX2 __attribute__((target("avx2")))
+
+struct scan_avx2
+{
+    SIMD_SCAN_AVX2 static __m256i scan_register(__m256i x)
+    {
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+        const __m256i lowTotal = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+        return _mm256_add_epi32(x, _mm256_permute2x128_si256(lowTotal, lowTotal, 0x08)); // 0x08: zero low, low to high
+    }
+    SIMD_SCAN_AVX2 static __m256 scan_register(__m256 x)
+    {
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+        const __m256 lowTotal = _mm256_permute_ps(x, _MM_SHUFFLE(3, 3, 3, 3));
+        return _mm256_add_ps(x, _mm256_permute2f128_ps(lowTotal, lowTotal, 0x08));
+    }
+
+    SIMD_SCAN_AVX2 static int32_t inclusive_scan(const int32_t* in, size_t count, int32_t* out, int32_t carry)
+    {
+        __m256i carryV = _mm256_set1_epi32(carry);
+        const __m256i last = _mm256_set1_epi32(7);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i x = _mm256_add_epi32(scan_register(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))), carryV);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+            carryV = _mm256_permutevar8x32_epi32(x, last);
+        }
+        return scan_scalar::inclusive_scan(in + i, count - i, out + i, _mm256_cvtsi256_si32(carryV));
+    }
+    SIMD_SCAN_AVX2 static float inclusive_scan(const float* in, size_t count, float* out, float carry)
+    {
+        __m256 carryV = _mm256_set1_ps(carry);
+        const __m256i last = _mm256_set1_epi32(7);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 x = _mm256_add_ps(scan_register(_mm256_loadu_ps(in + i)), carryV);
+            _mm256_storeu_ps(out + i, x);
+            carryV = _mm256_permutevar8x32_ps(x, last);
+        }
+        return scan_scalar::inclusive_scan(in + i, count - i, out + i, _mm256_cvtss_f32(carryV));
+    }
+
+    ///exclusive = inclusive moved up one lane, the previous carry enters lane 0
+    SIMD_SCAN_AVX2 static int32_t exclusive_scan(const int32_t* in, size_t count, int32_t* out, int32_t carry)
+    {
+        __m256i carryV = _mm256_set1_epi32(carry);
+        const __m256i last = _mm256_set1_epi32(7);
+        const __m256i rotate = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i x = _mm256_add_epi32(scan_register(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))), carryV);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_blend_epi32(_mm256_permutevar8x32_epi32(x, rotate), carryV, 1));
+            carryV = _mm256_permutevar8x32_epi32(x, last);
+        }
+        return scan_scalar::exclusive_scan(in + i, count - i, out + i, _mm256_cvtsi256_si32(carryV));
+    }
+    SIMD_SCAN_AVX2 static float exclusive_scan(const float* in, size_t count, float* out, float carry)
+    {
+        __m256 carryV = _mm256_set1_ps(carry);
+        const __m256i last = _mm256_set1_epi32(7);
+        const __m256i rotate = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 x = _mm256_add_ps(scan_register(_mm256_loadu_ps(in + i)), carryV);
+            _mm256_storeu_ps(out + i, _mm256_blend_ps(_mm256_permutevar8x32_ps(x, rotate), carryV, 1));
+            carryV = _mm256_permutevar8x32_ps(x, last);
+        }
+        return scan_scalar::exclusive_scan(in + i, count - i, out + i, _mm256_cvtss_f32(carryV));
+    }
+
+    SIMD_SCAN_AVX2 static void adjacent_difference(const int32_t* in, size_t count, int32_t* out, int32_t previous)
+    {
+        size_t i = count;
+        for (; i >= 9; i -= 8)
+        {
+            const __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i - 8));
+            const __m256i before = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i - 9));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i - 8), _mm256_sub_epi32(current, before));
+        }
+        scan_scalar::adjacent_difference(in, i, out, previous);
+    }
+    SIMD_SCAN_AVX2 static void adjacent_difference(const float* in, size_t count, float* out, float previous)
+    {
+        size_t i = count;
+        for (; i >= 9; i -= 8)
+        {
+            _mm256_storeu_ps(out + i - 8, _mm256_sub_ps(_mm256_loadu_ps(in + i - 8), _mm256_loadu_ps(in + i - 9)));
+        }
+        scan_scalar::adjacent_difference(in, i, out, previous);
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX-512: valignd against zero shifts the whole register by k lanes
+
+#define SIMD_SCAN_AVX512 __attribute__((target("avx512f")))
+
+struct scan_avx512
+{
+    SIMD_SCAN_AVX512 static __m512i scan_register(__m512i x)
+    {
+        const __m512i zero = _mm512_setzero_si512();
+        x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 15));
+        x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 14));
+        x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 12));
+        return _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 8));
+    }
+    SIMD_SCAN_AVX512 static __m512 scan_register(__m512 x)
+    {
+        const __m512i zero = _mm512_setzero_si512();
+        x = _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 15)));
+        x = _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 14)));
+        x = _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 12)));
+        return _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 8)));
+    }
+
+    SIMD_SCAN_AVX512 static int32_t inclusive_scan(const int32_t* in, size_t count, int32_t* out, int32_t carry)
+    {
+        __m512i carryV = _mm512_set1_epi32(carry);
+        const __m512i last = _mm512_set1_epi32(15);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512i x = _mm512_add_epi32(scan_register(_mm512_loadu_si512(in + i)), carryV);
+            _mm512_storeu_si512(out + i, x);
+            carryV = _mm512_permutexvar_epi32(last, x);
+        }
+        return scan_scalar::inclusive_scan(in + i, count - i, out + i, _mm512_cvtsi512_si32(carryV));
+    }
+    SIMD_SCAN_AVX512 static float inclusive_scan(const float* in, size_t count, float* out, float carry)
+    {
+        __m512 carryV = _mm512_set1_ps(carry);
+        const __m512i last = _mm512_set1_epi32(15);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512 x = _mm512_add_ps(scan_register(_mm512_loadu_ps(in + i)), carryV);
+            _mm512_storeu_ps(out + i, x);
+            carryV = _mm512_permutexvar_ps(last, x);
+        }
+        return scan_scalar::inclusive_scan(in + i, count - i, out + i, _mm512_cvtss_f32(carryV));
+    }
+
+    ///valignd(x, carry, 15) = {carry[15], x[0], ..., x[14]}
+    SIMD_SCAN_AVX512 static int32_t exclusive_scan(const int32_t* in, size_t count, int32_t* out, int32_t carry)
+    {
+        __m512i carryV = _mm512_set1_epi32(carry);
+        const __m512i last = _mm512_set1_epi32(15);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512i x = _mm512_add_epi32(scan_register(_mm512_loadu_si512(in + i)), carryV);
+            _mm512_storeu_si512(out + i, _mm512_alignr_epi32(x, carryV, 15));
+            carryV = _mm512_permutexvar_epi32(last, x);
+        }
+        return scan_scalar::exclusive_scan(in + i, count - i, out + i, _mm512_cvtsi512_si32(carryV));
+    }
+    SIMD_SCAN_AVX512 static float exclusive_scan(const float* in, size_t count, float* out, float carry)
+    {
+        __m512 carryV = _mm512_set1_ps(carry);
+        const __m512i last = _mm512_set1_epi32(15);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512 x = _mm512_add_ps(scan_register(_mm512_loadu_ps(in + i)), carryV);
+            _mm512_storeu_ps(out + i, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), _mm512_castps_si512(carryV), 15)));
+            carryV = _mm512_permutexvar_ps(last, x);
+        }
+        return scan_scalar::exclusive_scan(in + i, count - i, out + i, _mm512_cvtss_f32(carryV));
+    }
+
+    SIMD_SCAN_AVX512 static void adjacent_difference(const int32_t* in, size_t count, int32_t* out, int32_t previous)
+    {
+        size_t i = count;
+        for (; i >= 17; i -= 16)
+        {
+            _mm512_storeu_si512(out + i - 16, _mm512_sub_epi32(_mm512_loadu_si512(in + i - 16), _mm512_loadu_si512(in + i - 17)));
+        }
+        scan_scalar::adjacent_difference(in, i, out, previous);
+    }
+    SIMD_SCAN_AVX512 static void adjacent_difference(const float* in, size_t count, float* out, float previous)
+    {
+        size_t i = count;
+        for (; i >= 17; i -= 16)
+        {
+            _mm512_storeu_ps(out + i - 16, _mm512_sub_ps(_mm512_loadu_ps(in + i - 16), _mm512_loadu_ps(in + i - 17)));
+        }
+        scan_scalar::adjacent_difference(in, i, out, previous);
+    }
+};
+
+#undef SIMD_SCAN_AVX2
+#undef SIMD_SCAN_AVX512
+#endif // SIMD_REDUCE_X86
+
+#if SIMD_REDUCE_X86
+#define SIMD_SCAN_DISPATCH(f, ...) \
+    switch (detail::isa_override()) \
+    { \
+        case isa::avx512: return detail::scan_avx512::f(__VA_ARGS__); \
+        case isa::avx2: return detail::scan_avx2::f(__VA_ARGS__); \
+        case isa::scalar: break; \
+    } \
+    return detail::scan_scalar::f(__VA_ARGS__)
+#else
+#define SIMD_SCAN_DISPATCH(f, ...) return detail::scan_scalar::f(__VA_ARGS__)
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///out[i] = carry + in[0] + ... + in[i], @return the carry for the next block
+inline int32_t inclusive_scan(const int32_t* in, size_t count, int32_t* out, int32_t carry = 0) { SIMD_SCAN_DISPATCH(inclusive_scan, in, count, out, carry); }
+inline float inclusive_scan(const float* in, size_t count, float* out, float carry = 0.f) { SIMD_SCAN_DISPATCH(inclusive_scan, in, count, out, carry); }
+
+///out[i] = carry + in[0] + ... + in[i - 1], @return the carry for the next block
+inline int32_t exclusive_scan(const int32_t* in, size_t count, int32_t* out, int32_t carry = 0) { SIMD_SCAN_DISPATCH(exclusive_scan, in, count, out, carry); }
+inline float exclusive_scan(const float* in, size_t count, float* out, float carry = 0.f) { SIMD_SCAN_DISPATCH(exclusive_scan, in, count, out, carry); }
+
+///out[0] = in[0] - previous, out[i] = in[i] - in[i - 1]. previous = 0 matches std::adjacent_difference.
+inline void adjacent_difference(const int32_t* in, size_t count, int32_t* out, int32_t previous = 0) { SIMD_SCAN_DISPATCH(adjacent_difference, in, count, out, previous); }
+inline void adjacent_difference(const float* in, size_t count, float* out, float previous = 0.f) { SIMD_SCAN_DISPATCH(adjacent_difference, in, count, out, previous); }
+
+#undef SIMD_SCAN_DISPATCH
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parallel versions
+
+namespace detail
+{
+inline int32_t chunk_total(const int32_t* data, size_t count) { return static_cast<int32_t>(static_cast<uint32_t>(sum(data, count))); }
+inline float chunk_total(const float* data, size_t count) { return sum(data, count, reduce_mode::fast); }
+
+template<typename T, typename ScanOp>
+void parallel_scan(work_stealing_pool& pool, const T* in, size_t count, T* out, T init, size_t grain, ScanOp scanOp)
+{
+    const size_t chunkSize = parallel::chunk_size(pool, count, grain);
+    const size_t chunks = parallel::chunk_count(count, chunkSize);
+    std::vector<T> offsets(chunks + 1, T(0));
+    parallel::for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        offsets[chunk + 1] = chunk_total(in + begin, end - begin);
+    });
+    offsets[0] = init;
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+        offsets[chunk] = detail::scan_scalar::wrapping_add(offsets[chunk - 1], offsets[chunk]);
+    }
+    parallel::for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        scanOp(in + begin, end - begin, out + begin, offsets[chunk]);
+    });
+}
+
+template<typename T>
+void parallel_adjacent_difference(work_stealing_pool& pool, const T* in, size_t count, T* out, size_t grain)
+{
+    const size_t chunkSize = parallel::chunk_size(pool, count, grain);
+    std::vector<T> previous(parallel::chunk_count(count, chunkSize), T(0));
+    for (size_t chunk = 1; chunk < previous.size(); ++chunk)
+    {
+        previous[chunk] = in[chunk * chunkSize - 1]; // before any chunk writes, out == in has to work
+    }
+    parallel::for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+        adjacent_difference(in + begin, end - begin, out + begin, previous[chunk]);
+    });
+}
+}//detail
+
+inline void inclusive_scan(work_stealing_pool& pool, const int32_t* in, size_t count, int32_t* out, int32_t init = 0, size_t grain = 0)
+{
+    detail::parallel_scan(pool, in, count, out, init, grain, [](const int32_t* i, size_t n, int32_t* o, int32_t c) { inclusive_scan(i, n, o, c); });
+}
+inline void inclusive_scan(work_stealing_pool& pool, const float* in, size_t count, float* out, float init = 0.f, size_t grain = 0)
+{
+    detail::parallel_scan(pool, in, count, out, init, grain, [](const float* i, size_t n, float* o, float c) { inclusive_scan(i, n, o, c); });
+}
+inline void exclusive_scan(work_stealing_pool& pool, const int32_t* in, size_t count, int32_t* out, int32_t init = 0, size_t grain = 0)
+{
+    detail::parallel_scan(pool, in, count, out, init, grain, [](const int32_t* i, size_t n, int32_t* o, int32_t c) { exclusive_scan(i, n, o, c); });
+}
+inline void exclusive_scan(work_stealing_pool& pool, const float* in, size_t count, float* out, float init = 0.f, size_t grain = 0)
+{
+    detail::parallel_scan(pool, in, count, out, init, grain, [](const float* i, size_t n, float* o, float c) { exclusive_scan(i, n, o, c); });
+}
+inline void adjacent_difference(work_stealing_pool& pool, const int32_t* in, size_t count, int32_t* out, size_t grain = 0)
+{
+    detail::parallel_adjacent_difference(pool, in, count, out, grain);
+}
+inline void adjacent_difference(work_stealing_pool& pool, const float* in, size_t count, float* out, size_t grain = 0)
+{
+    detail::parallel_adjacent_difference(pool, in, count, out, grain);
+}
+
+}//simd
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,265 @@
+/*
+Square roots for distance kernels, same runtime dispatch as simd_reduce.h (simd::set_isa applies here too).
+
+  - simd::sqrt(x): one sqrtsd / sqrtss, correctly rounded, no errno branch (std::sqrt keeps one for negative inputs
+    unless -fno-math-errno)
+  - simd::sqrt(in, count, out): vsqrtps / vsqrtpd over arrays, correctly rounded, bit identical on every ISA
+  - simd::rsqrt(x) and simd::rsqrt(in, count, out): 1/sqrt(x) from the hardware estimate (rsqrtps, 12 bits, or
+    vrsqrt14ps, 14 bits) refined by one Newton step y' = y * (1.5 - 0.5 * x * y * y). Within 4 ULP (avx2) or 2 ULP
+    (avx512) of the rounded 1/sqrt, no division. The scalar ISA divides (correctly rounded, 1 ULP).
+    0 gives +inf, +inf gives 0, negative and NaN give NaN; denormal inputs give +inf on avx2 (rsqrtps
+    flushes them).
+  - simd::isqrt(n): floor(sqrt(n)) for every uint64_t, exact (the double estimate is corrected by one step)
+
+https://en.wikipedia.org/wiki/Fast_inverse_square_root#Newton's_method
+*/
+#pragma once
+
+#include "simd_reduce.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace simd
+{
+
+inline double sqrt(double x)
+{
+#if SIMD_REDUCE_X86
+    return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+#else
+    return std::sqrt(x);
+#endif
+}
+
+inline float sqrt(float x)
+{
+#if SIMD_REDUCE_X86
+    return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(x)));
+#else
+    return std::sqrt(x);
+#endif
+}
+
+///floor(sqrt(n)), exact for the whole range
+inline uint64_t isqrt(uint64_t n)
+{
+    // the double rounding of n and of its root leave the estimate at most one off
+    uint64_t root = static_cast<uint64_t>(sqrt(static_cast<double>(n)));
+    if (root > 0xFFFFFFFFull)
+    {
+        root = 0xFFFFFFFFull;
+    }
+    if (root * root > n)
+    {
+        --root;
+    }
+    else if (root < 0xFFFFFFFFull && (root + 1) * (root + 1) <= n)
+    {
+        ++root;
+    }
+    return root;
+}
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct sqrt_scalar
+{
+    static void sqrt(const float* in, size_t count, float* out)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = simd::sqrt(in[i]);
+        }
+    }
+    static void sqrt(const double* in, size_t count, double* out)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = simd::sqrt(in[i]);
+        }
+    }
+    static void rsqrt(const float* in, size_t count, float* out)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = 1.f / simd::sqrt(in[i]);
+        }
+    }
+};
+
+#if SIMD_REDUCE_X86
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2
+
+#define SIMD_SQRT_AVX2 __attribute__((target("avx2")))
+
+struct sqrt_avx2
+{
+    ///One Newton step where x and the estimate are finite, the estimate elsewhere (inf, 0 and NaN already are the
+    ///answer, a flushed denormal would turn inf into -inf)
+    SIMD_SQRT_AVX2 static __m256 refine(__m256 x, __m256 y)
+    {
+        // (x * y) * y, y * y overflows for the smallest x
+        const __m256 halfX = _mm256_mul_ps(_mm256_set1_ps(0.5f), x);
+        const __m256 refined = _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(_mm256_mul_ps(halfX, y), y)));
+        const __m256 infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        const __m256 isRegular = _mm256_and_ps(_mm256_cmp_ps(x, infinity, _CMP_LT_OQ), _mm256_cmp_ps(y, infinity, _CMP_LT_OQ));
+        return _mm256_blendv_ps(y, refined, isRegular);
+    }
+
+    SIMD_SQRT_AVX2 static void sqrt(const float* in, size_t count, float* out)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(out + i, _mm256_sqrt_ps(_mm256_loadu_ps(in + i)));
+        }
+        sqrt_scalar::sqrt(in + i, count - i, out + i);
+    }
+    SIMD_SQRT_AVX2 static void sqrt(const double* in, size_t count, double* out)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_loadu_pd(in + i)));
+        }
+        sqrt_scalar::sqrt(in + i, count - i, out + i);
+    }
+    SIMD_SQRT_AVX2 static void rsqrt(const float* in, size_t count, float* out)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(in + i);
+            _mm256_storeu_ps(out + i, refine(x, _mm256_rsqrt_ps(x)));
+        }
+        if (i < count)
+        {// same approximation for the tail so results don't depend on the position
+            alignas(32) float tail[8] = {};
+            for (size_t j = i; j < count; ++j)
+            {
+                tail[j - i] = in[j];
+            }
+            const __m256 x = _mm256_load_ps(tail);
+            _mm256_store_ps(tail, refine(x, _mm256_rsqrt_ps(x)));
+            for (size_t j = i; j < count; ++j)
+            {
+                out[j] = tail[j - i];
+            }
+        }
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX-512, masked tails
+
+#define SIMD_SQRT_AVX512 __attribute__((target("avx512f")))
+
+struct sqrt_avx512
+{
+    SIMD_SQRT_AVX512 static __mmask16 tail_mask(size_t remaining) { return static_cast<__mmask16>((1u << remaining) - 1); }
+
+    SIMD_SQRT_AVX512 static __m512 refine(__m512 x, __m512 y)
+    {
+        const __m512 halfX = _mm512_mul_ps(_mm512_set1_ps(0.5f), x);
+        const __m512 refined = _mm512_mul_ps(y, _mm512_sub_ps(_mm512_set1_ps(1.5f), _mm512_mul_ps(_mm512_mul_ps(halfX, y), y)));
+        const __m512 infinity = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+        const __mmask16 isRegular = _mm512_cmp_ps_mask(x, infinity, _CMP_LT_OQ) & _mm512_cmp_ps_mask(y, infinity, _CMP_LT_OQ);
+        return _mm512_mask_blend_ps(isRegular, y, refined);
+    }
+
+    SIMD_SQRT_AVX512 static void sqrt(const float* in, size_t count, float* out)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm512_storeu_ps(out + i, _mm512_sqrt_ps(_mm512_loadu_ps(in + i)));
+        }
+        if (i < count)
+        {
+            const __mmask16 mask = tail_mask(count - i);
+            _mm512_mask_storeu_ps(out + i, mask, _mm512_sqrt_ps(_mm512_maskz_loadu_ps(mask, in + i)));
+        }
+    }
+    SIMD_SQRT_AVX512 static void sqrt(const double* in, size_t count, double* out)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm512_storeu_pd(out + i, _mm512_sqrt_pd(_mm512_loadu_pd(in + i)));
+        }
+        if (i < count)
+        {
+            const __mmask8 mask = static_cast<__mmask8>((1u << (count - i)) - 1);
+            _mm512_mask_storeu_pd(out + i, mask, _mm512_sqrt_pd(_mm512_maskz_loadu_pd(mask, in + i)));
+        }
+    }
+    SIMD_SQRT_AVX512 static void rsqrt(const float* in, size_t count, float* out)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512 x = _mm512_loadu_ps(in + i);
+            _mm512_storeu_ps(out + i, refine(x, _mm512_rsqrt14_ps(x)));
+        }
+        if (i < count)
+        {
+            const __mmask16 mask = tail_mask(count - i);
+            const __m512 x = _mm512_maskz_loadu_ps(mask, in + i);
+            _mm512_mask_storeu_ps(out + i, mask, refine(x, _mm512_rsqrt14_ps(x)));
+        }
+    }
+};
+
+#undef SIMD_SQRT_AVX2
+#undef SIMD_SQRT_AVX512
+#endif // SIMD_REDUCE_X86
+
+#if SIMD_REDUCE_X86
+#define SIMD_SQRT_DISPATCH(f, ...) \
+    switch (detail::isa_override()) \
+    { \
+        case isa::avx512: return detail::sqrt_avx512::f(__VA_ARGS__); \
+        case isa::avx2: return detail::sqrt_avx2::f(__VA_ARGS__); \
+        case isa::scalar: break; \
+    } \
+    return detail::sqrt_scalar::f(__VA_ARGS__)
+#else
+#define SIMD_SQRT_DISPATCH(f, ...) return detail::sqrt_scalar::f(__VA_ARGS__)
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///out[i] = sqrt(in[i]), correctly rounded (out == in is allowed)
+inline void sqrt(const float* in, size_t count, float* out) { SIMD_SQRT_DISPATCH(sqrt, in, count, out); }
+inline void sqrt(const double* in, size_t count, double* out) { SIMD_SQRT_DISPATCH(sqrt, in, count, out); }
+
+///out[i] ~ 1 / sqrt(in[i]), estimate + one Newton step (out == in is allowed)
+inline void rsqrt(const float* in, size_t count, float* out) { SIMD_SQRT_DISPATCH(rsqrt, in, count, out); }
+
+#undef SIMD_SQRT_DISPATCH
+
+inline float rsqrt(float x)
+{
+    float result;
+    rsqrt(&x, 1, &result);
+    return result;
+}
+
+}//simd
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,419 @@
+/*
+Structure of arrays container: soa_vector<Fields...> keeps one contiguous array per field and hands out proxies that
+look like the struct, so AoS code keeps working while scans touch only the columns they read.
+
+  soa_vector<float, float> points;             // columns for vec2 {x, y}
+  points.push_back(vec2{1.f, 2.f});            // any aggregate made of exactly the fields, in order
+  vec2 p = points[0];                          // proxies convert back
+  points[0] = vec2{3.f, 4.f};
+  for (auto [x, y] : points) { x *= 2.f; }     // structured bindings are references into the columns
+  std::span<float> xs = points.column<0>();    // raw column for SIMD kernels (simd::sum(xs.data(), xs.size()))
+
+Fields must be trivially copyable (columns grow with memcpy and are never destroyed element by element). Each column
+starts on a 64 byte boundary and is padded to a whole number of 64 byte lines, so a kernel may load full vectors
+past size() without leaving the allocation (the padding is uninitialized).
+
+Field access is checked at compile time: get<I>() / column<I>() with I >= the field count don't compile, and records
+are only accepted when the aggregate has exactly the fields (soa_record). Proxies are like vector<bool>::reference:
+assigning one proxy to another copies values, and auto x = points[0] is a proxy, not a copy.
+*/
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+///What a column can hold
+template<typename T>
+concept soa_field = std::is_trivially_copyable_v<T> && std::default_initializable<T>;
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Converts to anything, used to count the members of an aggregate
+struct any_field
+{
+    template<typename T>
+    operator T() const;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///An aggregate whose members are exactly Fields, in order (vec2 for soa_vector<float, float>)
+template<typename R, typename... Fields>
+concept soa_record = std::is_aggregate_v<R> && sizeof...(Fields) <= 6
+    && requires (Fields... fields) { R{fields...}; }
+    && !requires (Fields... fields) { R{fields..., detail::any_field{}}; };
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///The members of an aggregate with N of them, copied into a tuple
+template<size_t N, typename R>
+auto record_values(const R& record)
+{
+    if constexpr (N == 1)
+    {
+        const auto& [a] = record;
+        return std::tuple(a);
+    }
+    else if constexpr (N == 2)
+    {
+        const auto& [a, b] = record;
+        return std::tuple(a, b);
+    }
+    else if constexpr (N == 3)
+    {
+        const auto& [a, b, c] = record;
+        return std::tuple(a, b, c);
+    }
+    else if constexpr (N == 4)
+    {
+        const auto& [a, b, c, d] = record;
+        return std::tuple(a, b, c, d);
+    }
+    else if constexpr (N == 5)
+    {
+        const auto& [a, b, c, d, e] = record;
+        return std::tuple(a, b, c, d, e);
+    }
+    else
+    {
+        static_assert(N == 6, "records of up to 6 fields");
+        const auto& [a, b, c, d, e, f] = record;
+        return std::tuple(a, b, c, d, e, f);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+template<soa_field... Fields>
+    requires (sizeof...(Fields) > 0)
+class soa_vector;
+
+///Proxy for element i, Owner is soa_vector<...> or const soa_vector<...>
+template<typename Owner>
+class soa_reference
+{
+    using container = std::remove_const_t<Owner>;
+    static constexpr bool k_isConst = std::is_const_v<Owner>;
+
+public:
+    static constexpr size_t field_count = container::field_count;
+    using value_type = typename container::value_type;
+
+    soa_reference(Owner* i_owner, size_t i_index)
+        : m_owner(i_owner)
+        , m_index(i_index)
+    {
+    }
+    soa_reference(const soa_reference&) = default;
+
+    operator soa_reference<const container>() const requires (!k_isConst)
+    {
+        return {m_owner, m_index};
+    }
+
+    template<size_t I>
+        requires (I < field_count)
+    auto& get() const
+    {
+        return m_owner->template data<I>()[m_index];
+    }
+
+    value_type value() const
+    {
+        return values(std::make_index_sequence<field_count>());
+    }
+    operator value_type() const { return value(); }
+
+    template<typename R>
+        requires container::template is_record<R>
+    operator R() const
+    {
+        return std::apply([](const auto&... fields) { return R{fields...}; }, value());
+    }
+
+    ///Assigns the values, not the proxy
+    soa_reference& operator=(const soa_reference& other) requires (!k_isConst)
+    {
+        return *this = other.value();
+    }
+    soa_reference& operator=(const value_type& values) requires (!k_isConst)
+    {
+        assign(values, std::make_index_sequence<field_count>());
+        return *this;
+    }
+    template<typename R>
+        requires (!k_isConst) && container::template is_record<R>
+    soa_reference& operator=(const R& record)
+    {
+        return *this = value_type(detail::record_values<field_count>(record));
+    }
+
+    friend bool operator==(const soa_reference& lhs, const soa_reference& rhs) { return lhs.value() == rhs.value(); }
+
+private:
+    template<size_t... Is>
+    value_type values(std::index_sequence<Is...>) const
+    {
+        return value_type(get<Is>()...);
+    }
+    template<size_t... Is>
+    void assign(const value_type& values, std::index_sequence<Is...>)
+    {
+        ((get<Is>() = std::get<Is>(values)), ...);
+    }
+
+    Owner* m_owner;
+    size_t m_index;
+};
+
+///Random access iterator over proxies
+template<typename Owner>
+class soa_iterator
+{
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename std::remove_const_t<Owner>::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = soa_reference<Owner>;
+    using pointer = void;
+
+    soa_iterator() = default;
+    soa_iterator(Owner* i_owner, size_t i_index)
+        : m_owner(i_owner)
+        , m_index(i_index)
+    {
+    }
+    operator soa_iterator<const Owner>() const requires (!std::is_const_v<Owner>)
+    {
+        return {m_owner, m_index};
+    }
+
+    reference operator*() const { return {m_owner, m_index}; }
+    reference operator[](difference_type n) const { return {m_owner, m_index + n}; }
+
+    soa_iterator& operator++() { ++m_index; return *this; }
+    soa_iterator operator++(int) { soa_iterator copy = *this; ++m_index; return copy; }
+    soa_iterator& operator--() { --m_index; return *this; }
+    soa_iterator operator--(int) { soa_iterator copy = *this; --m_index; return copy; }
+    soa_iterator& operator+=(difference_type n) { m_index += n; return *this; }
+    soa_iterator& operator-=(difference_type n) { m_index -= n; return *this; }
+    friend soa_iterator operator+(soa_iterator it, difference_type n) { return it += n; }
+    friend soa_iterator operator+(difference_type n, soa_iterator it) { return it += n; }
+    friend soa_iterator operator-(soa_iterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const soa_iterator& lhs, const soa_iterator& rhs)
+    {
+        return static_cast<difference_type>(lhs.m_index) - static_cast<difference_type>(rhs.m_index);
+    }
+    friend bool operator==(const soa_iterator& lhs, const soa_iterator& rhs) { return lhs.m_index == rhs.m_index; }
+    friend auto operator<=>(const soa_iterator& lhs, const soa_iterator& rhs) { return lhs.m_index <=> rhs.m_index; }
+
+private:
+    Owner* m_owner = nullptr;
+    size_t m_index = 0;
+};
+
+template<soa_field... Fields>
+    requires (sizeof...(Fields) > 0)
+class soa_vector
+{
+public:
+    static constexpr size_t field_count = sizeof...(Fields);
+    static constexpr size_t alignment = 64;
+
+    template<size_t I>
+    using field_type = std::tuple_element_t<I, std::tuple<Fields...>>;
+    using value_type = std::tuple<Fields...>;
+    using reference = soa_reference<soa_vector>;
+    using const_reference = soa_reference<const soa_vector>;
+    using iterator = soa_iterator<soa_vector>;
+    using const_iterator = soa_iterator<const soa_vector>;
+
+    template<typename R>
+    static constexpr bool is_record = soa_record<R, Fields...>;
+
+    soa_vector() = default;
+    explicit soa_vector(size_t count)
+    {
+        resize(count);
+    }
+    soa_vector(const soa_vector& other)
+    {
+        reserve(other.m_size);
+        copy_columns(other.m_columns, m_columns, other.m_size);
+        m_size = other.m_size;
+    }
+    soa_vector(soa_vector&& other) noexcept
+        : m_columns(std::exchange(other.m_columns, {}))
+        , m_size(std::exchange(other.m_size, 0))
+        , m_capacity(std::exchange(other.m_capacity, 0))
+    {
+    }
+    soa_vector& operator=(soa_vector other) noexcept
+    {
+        std::swap(m_columns, other.m_columns);
+        std::swap(m_size, other.m_size);
+        std::swap(m_capacity, other.m_capacity);
+        return *this;
+    }
+    ~soa_vector()
+    {
+        release(m_columns);
+    }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    void reserve(size_t count)
+    {
+        if (count <= m_capacity)
+        {
+            return;
+        }
+        std::tuple<Fields*...> columns = allocate(count);
+        copy_columns(m_columns, columns, m_size);
+        release(m_columns);
+        m_columns = columns;
+        m_capacity = count;
+    }
+    ///New elements are value initialized
+    void resize(size_t count)
+    {
+        reserve(count);
+        if (count > m_size)
+        {
+            std::apply([this, count](Fields*... columns) { (std::fill(columns + m_size, columns + count, Fields{}), ...); }, m_columns);
+        }
+        m_size = count;
+    }
+    void clear() { m_size = 0; }
+
+    void push_back(const Fields&... values)
+    {
+        if (m_size == m_capacity)
+        {
+            // values may live in this container (v.push_back(v.data<0>()[0], ...)), copy them before the columns move
+            const std::tuple<Fields...> copies(values...);
+            reserve(std::max<size_t>(2 * m_capacity, alignment));
+            std::apply([this](const Fields&... fields) { store(m_size, fields...); }, copies);
+        }
+        else
+        {
+            store(m_size, values...);
+        }
+        ++m_size;
+    }
+    void push_back(const value_type& values)
+    {
+        std::apply([this](const Fields&... fields) { push_back(fields...); }, values);
+    }
+    template<soa_record<Fields...> R>
+    void push_back(const R& record)
+    {
+        push_back(value_type(detail::record_values<field_count>(record)));
+    }
+    void pop_back() { --m_size; }
+
+    reference operator[](size_t i) { return {this, i}; }
+    const_reference operator[](size_t i) const { return {this, i}; }
+    reference back() { return {this, m_size - 1}; }
+    const_reference back() const { return {this, m_size - 1}; }
+
+    template<size_t I>
+        requires (I < field_count)
+    field_type<I>* data() { return std::get<I>(m_columns); }
+    template<size_t I>
+        requires (I < field_count)
+    const field_type<I>* data() const { return std::get<I>(m_columns); }
+
+    ///Field I of every element, 64 byte aligned
+    template<size_t I>
+        requires (I < field_count)
+    std::span<field_type<I>> column() { return {data<I>(), m_size}; }
+    template<size_t I>
+        requires (I < field_count)
+    std::span<const field_type<I>> column() const { return {data<I>(), m_size}; }
+
+    iterator begin() { return {this, 0}; }
+    iterator end() { return {this, m_size}; }
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, m_size}; }
+
+private:
+    static size_t padded_bytes(size_t count, size_t fieldSize)
+    {
+        return (count * fieldSize + alignment - 1) / alignment * alignment;
+    }
+
+    void store(size_t i, const Fields&... values)
+    {
+        std::apply([i, &values...](Fields*... columns) { ((columns[i] = values), ...); }, m_columns);
+    }
+
+    ///One column after the other, the ones already allocated are released if a later one throws
+    static std::tuple<Fields*...> allocate(size_t count)
+    {
+        std::tuple<Fields*...> columns{};
+        try
+        {
+            std::apply([count](Fields*&... pointers) {
+                ((pointers = static_cast<Fields*>(::operator new(padded_bytes(count, sizeof(Fields)), std::align_val_t(alignment)))), ...);
+            }, columns);
+        }
+        catch (...)
+        {
+            release(columns);
+            throw;
+        }
+        return columns;
+    }
+    static void release(std::tuple<Fields*...>& columns)
+    {
+        std::apply([](Fields*... pointers) { (::operator delete(pointers, std::align_val_t(alignment)), ...); }, columns);
+        columns = {};
+    }
+    static void copy_columns(const std::tuple<Fields*...>& from, std::tuple<Fields*...>& to, size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        copy_columns(from, to, count, std::index_sequence_for<Fields...>());
+    }
+    template<size_t... Is>
+    static void copy_columns(const std::tuple<Fields*...>& from, std::tuple<Fields*...>& to, size_t count, std::index_sequence<Is...>)
+    {
+        (std::memcpy(std::get<Is>(to), std::get<Is>(from), count * sizeof(Fields)), ...);
+    }
+
+    std::tuple<Fields*...> m_columns{};
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+};
+
+// structured bindings on proxies: auto [x, y] = points[i] binds references into the columns
+template<typename Owner>
+struct std::tuple_size<soa_reference<Owner>> : std::integral_constant<size_t, soa_reference<Owner>::field_count>
+{
+};
+
+template<size_t I, typename Owner>
+struct std::tuple_element<I, soa_reference<Owner>>
+{
+    using type = decltype(std::declval<const soa_reference<Owner>&>().template get<I>());
+};
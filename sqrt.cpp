@@ -1,16 +1,311 @@
-double root(double n){
-  // Max and min are used to take into account numbers less than 1
-  double lo = min(1, n), hi = max(1, n), mid;
-
-  // Update the bounds to be off the target by a factor of 10
-  while(100 * lo * lo < n) lo *= 10;
-  while(0.01 * hi * hi > n) hi *= 0.1;
-
-  for(int i = 0 ; i < 100 ; i++){
-      mid = (lo+hi)/2;
-      if(mid*mid == n) return mid;
-      if(mid*mid > n) hi = mid;
-      else lo = mid;
-  }
-  return mid;
+/*
+Accuracy and throughput of simd_sqrt.h against the bisection root it replaces. constexpr_math::sqrt (the compile
+time version, for tables) is checked against the same reference.
+
+ULP distances are measured against the correctly rounded result (float: computed in double then rounded, double:
+std::sqrt, which IEEE 754 requires to be correctly rounded), over random values spread across the whole exponent
+range plus the special values. Throughput is measured in cache (compute bound) and over arrays bigger than the
+caches, where every version ends up waiting on memory.
+
+compile with -std=c++20 -O2
+*/
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "constexpr_math.h"
+#include "simd_sqrt.h"
+
+////////////////////////////////////////////////////////////
+
+// the original 100 step bisection, kept as the baseline (n >= 0)
+double root(double n)
+{
+    // Max and min are used to take into account numbers less than 1
+    double lo = std::min(1.0, n), hi = std::max(1.0, n), mid = lo;
+
+    // Update the bounds to be off the target by a factor of 10
+    while (100 * lo * lo < n) lo *= 10;
+    while (0.01 * hi * hi > n) hi *= 0.1;
+
+    for (int i = 0; i < 100; i++)
+    {
+        mid = (lo + hi) / 2;
+        if (mid * mid == n) return mid;
+        if (mid * mid > n) hi = mid;
+        else lo = mid;
+    }
+    return mid;
+}
+
+////////////////////////////////////////////////////////////
+
+// distance in representable floats, same sign only (0 when both are the same NaN/inf)
+uint64_t ulp_distance(float a, float b)
+{
+    if (std::isnan(a) || std::isnan(b))
+    {
+        return std::isnan(a) && std::isnan(b) ? 0 : std::numeric_limits<uint64_t>::max();
+    }
+    const int64_t ia = std::bit_cast<int32_t>(a);
+    const int64_t ib = std::bit_cast<int32_t>(b);
+    return static_cast<uint64_t>(ia > ib ? ia - ib : ib - ia);
+}
+
+uint64_t ulp_distance(double a, double b)
+{
+    if (std::isnan(a) || std::isnan(b))
+    {
+        return std::isnan(a) && std::isnan(b) ? 0 : std::numeric_limits<uint64_t>::max();
+    }
+    const int64_t ia = std::bit_cast<int64_t>(a);
+    const int64_t ib = std::bit_cast<int64_t>(b);
+    return static_cast<uint64_t>(ia > ib ? ia - ib : ib - ia);
+}
+
+struct ulp_report
+{
+    uint64_t max = 0;
+    double mean = 0.0;
+    size_t exact = 0;
+    size_t count = 0;
+};
+
+template<typename T>
+ulp_report compare(const std::vector<T>& i_values, const std::vector<T>& i_reference)
+{
+    ulp_report report;
+    uint64_t total = 0;
+    for (size_t i = 0; i < i_values.size(); ++i)
+    {
+        const uint64_t distance = ulp_distance(i_values[i], i_reference[i]);
+        report.max = std::max(report.max, distance);
+        total += distance;
+        report.exact += distance == 0;
+    }
+    report.count = i_values.size();
+    report.mean = report.count ? double(total) / report.count : 0.0;
+    return report;
+}
+
+void print(const std::string& i_name, const ulp_report& i_report)
+{
+    std::cout << i_name << ": max " << i_report.max << " ulp, mean " << i_report.mean << " ulp, "
+              << 100.0 * i_report.exact / i_report.count << "% exact" << std::endl;
+}
+
+// positive floats with a uniform exponent (2^-126 .. 2^127) then the special values
+std::vector<float> make_floats(size_t i_count)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> bits(0x00800000u, 0x7f7fffffu);
+    std::vector<float> values(i_count);
+    std::generate(values.begin(), values.end(), [&]() { return std::bit_cast<float>(bits(gen)); });
+    values.insert(values.end(), {0.f, 1.f, 4.f, std::numeric_limits<float>::infinity(), std::numeric_limits<float>::min(), std::numeric_limits<float>::max()});
+    return values;
+}
+
+std::vector<double> make_doubles(size_t i_count)
+{
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<uint64_t> bits(0x0010000000000000ull, 0x7fefffffffffffffull);
+    std::vector<double> values(i_count);
+    std::generate(values.begin(), values.end(), [&]() { return std::bit_cast<double>(bits(gen)); });
+    values.insert(values.end(), {0.0, 1.0, 4.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::min(), std::numeric_limits<double>::max()});
+    return values;
+}
+
+void test_accuracy(size_t i_count)
+{
+    const std::vector<float> floats = make_floats(i_count);
+    const std::vector<double> doubles = make_doubles(i_count);
+
+    std::vector<float> sqrtReference(floats.size());
+    std::vector<float> rsqrtReference(floats.size());
+    for (size_t i = 0; i < floats.size(); ++i)
+    {// double has more than twice the bits, rounding its result to float is correctly rounded
+        sqrtReference[i] = static_cast<float>(std::sqrt(double(floats[i])));
+        rsqrtReference[i] = static_cast<float>(1.0 / std::sqrt(double(floats[i])));
+    }
+    std::vector<double> sqrtReferenceDouble(doubles.size());
+    std::vector<double> roots(doubles.size());
+    for (size_t i = 0; i < doubles.size(); ++i)
+    {
+        sqrtReferenceDouble[i] = std::sqrt(doubles[i]);
+        roots[i] = root(doubles[i]);
+    }
+    print("bisection root (double)", compare(roots, sqrtReferenceDouble));
+
+    std::vector<double> constexprRoots(doubles.size());
+    std::transform(doubles.begin(), doubles.end(), constexprRoots.begin(), [](double x) { return constexpr_math::sqrt(x); });
+    print("constexpr sqrt (double)", compare(constexprRoots, sqrtReferenceDouble));
+
+    std::vector<float> rsqrtNaive(floats.size());
+    for (size_t i = 0; i < floats.size(); ++i)
+    {
+        rsqrtNaive[i] = 1.f / std::sqrt(floats[i]);
+    }
+    print("1.f / std::sqrt (float)", compare(rsqrtNaive, rsqrtReference));
+
+    for (const simd::isa isa : {simd::isa::scalar, simd::isa::avx2, simd::isa::avx512})
+    {
+        if (isa > simd::detected_isa())
+        {
+            continue;
+        }
+        simd::set_isa(isa);
+        const std::string name = simd::isa_name(isa);
+
+        std::vector<float> out(floats.size());
+        simd::sqrt(floats.data(), floats.size(), out.data());
+        print(name + " sqrt (float)", compare(out, sqrtReference));
+        simd::rsqrt(floats.data(), floats.size(), out.data());
+        print(name + " rsqrt (float)", compare(out, rsqrtReference));
+
+        std::vector<double> outDouble(doubles.size());
+        simd::sqrt(doubles.data(), doubles.size(), outDouble.data());
+        print(name + " sqrt (double)", compare(outDouble, sqrtReferenceDouble));
+    }
+    simd::set_isa(simd::detected_isa());
+}
+
+void test_isqrt(size_t i_count)
+{
+    std::vector<uint64_t> values = {0, 1, 2, 3, 4, 15, 16, 17, 0xFFFFFFFFull, 0xFFFFFFFFull * 0xFFFFFFFFull,
+        0xFFFFFFFFull * 0xFFFFFFFFull - 1, 0xFFFFFFFFull * 0xFFFFFFFFull + 1, std::numeric_limits<uint64_t>::max()};
+    for (uint64_t r = (uint64_t(1) << 26) - 100; r < (uint64_t(1) << 26) + 100; ++r)
+    {// around the perfect squares where the double estimate rounds up
+        values.push_back(r * r - 1);
+        values.push_back(r * r);
+    }
+    std::mt19937_64 gen(7);
+    for (size_t i = 0; i < i_count; ++i)
+    {
+        values.push_back(gen() >> (gen() % 64));
+    }
+
+    size_t failures = 0;
+    for (const uint64_t n : values)
+    {
+        const uint64_t r = simd::isqrt(n);
+        // r * r <= n < (r + 1)^2, in 128 bits
+        const bool isFloor = static_cast<unsigned __int128>(r) * r <= n && static_cast<unsigned __int128>(r + 1) * (r + 1) > n;
+        if (!isFloor)
+        {
+            std::cerr << "isqrt(" << n << ") = " << r << std::endl;
+            ++failures;
+        }
+    }
+    std::cout << "isqrt: " << values.size() << " values, " << failures << " failures" << std::endl;
+}
+
+////////////////////////////////////////////////////////////
+
+void test_throughput(bench::runner& runner, size_t i_count)
+{
+    std::vector<float> floats(i_count);
+    std::vector<double> doubles(i_count);
+    {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<float> dist(0.f, 1000.f);
+        std::generate(floats.begin(), floats.end(), [&]() { return dist(gen); });
+        std::copy(floats.begin(), floats.end(), doubles.begin());
+    }
+    std::vector<float> out(i_count);
+    std::vector<double> outDouble(i_count);
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.iterations = std::max<size_t>(1, (size_t(1) << 22) / i_count);
+    setup.bytes = i_count * sizeof(float);
+    std::cout << i_count << " values" << std::endl;
+
+    {
+        bench::settings bisection = setup;
+        bisection.bytes = i_count / 100 * sizeof(double);
+        runner.run("bisection root, 1% of the doubles", bisection, [&]() {
+            for (size_t i = 0; i < i_count / 100; ++i)
+            {
+                outDouble[i] = root(doubles[i]);
+            }
+            bench::do_not_optimize(outDouble.data());
+        });
+    }
+    runner.run("std::sqrt loop (float)", setup, [&]() {
+        for (size_t i = 0; i < i_count; ++i)
+        {
+            out[i] = std::sqrt(floats[i]);
+        }
+        bench::do_not_optimize(out.data());
+    });
+    runner.run("1.f / std::sqrt loop (float)", setup, [&]() {
+        for (size_t i = 0; i < i_count; ++i)
+        {
+            out[i] = 1.f / std::sqrt(floats[i]);
+        }
+        bench::do_not_optimize(out.data());
+    });
+
+    for (const simd::isa isa : {simd::isa::scalar, simd::isa::avx2, simd::isa::avx512})
+    {
+        if (isa > simd::detected_isa())
+        {
+            continue;
+        }
+        simd::set_isa(isa);
+        const std::string name = simd::isa_name(isa);
+
+        runner.run(name + " sqrt (float)", setup, [&]() {
+            simd::sqrt(floats.data(), i_count, out.data());
+            bench::do_not_optimize(out.data());
+        });
+        runner.run(name + " rsqrt (float)", setup, [&]() {
+            simd::rsqrt(floats.data(), i_count, out.data());
+            bench::do_not_optimize(out.data());
+        });
+        bench::settings doubleSetup = setup;
+        doubleSetup.bytes = i_count * sizeof(double);
+        runner.run(name + " sqrt (double)", doubleSetup, [&]() {
+            simd::sqrt(doubles.data(), i_count, outDouble.data());
+            bench::do_not_optimize(outDouble.data());
+        });
+    }
+    simd::set_isa(simd::detected_isa());
+
+    std::vector<uint64_t> integers(i_count);
+    {
+        std::mt19937_64 gen(3);
+        std::generate(integers.begin(), integers.end(), [&]() { return gen(); });
+    }
+    bench::settings integerSetup = setup;
+    integerSetup.bytes = i_count * sizeof(uint64_t);
+    runner.run("isqrt (uint64)", integerSetup, [&]() {
+        uint64_t sum = 0;
+        for (const uint64_t n : integers)
+        {
+            sum += simd::isqrt(n);
+        }
+        bench::do_not_optimize(sum);
+    });
+}
+
+////////////////////////////////////////////////////////////
+
+// benchmark.h options: --samples N --warmup N --pin CPU --perf --json PATH --csv PATH
+int main(int argc, char** argv)
+{
+    test_accuracy(1000000);
+    test_isqrt(1000000);
+
+    bench::runner runner(bench::config::from_args(argc, argv));
+    test_throughput(runner, 4096);
+    test_throughput(runner, 10000000);
+    return 0;
 }
@@ -20,79 +20,27 @@ map reduce can be efficiently implemented as:
 #include <algorithm>
 #include <vector>
 #include <string>
-#include <chrono>
 #include <iostream>
-
-template<typename TCHRONO = std::chrono::high_resolution_clock>
-std::ostream& operator<< (std::ostream& os, typename TCHRONO::duration d)
-{
-    const std::chrono::microseconds micros = std::chrono::duration_cast<std::chrono::microseconds>(d);
-    if (micros.count() < 1000)
-    {
-        os << micros.count() <<"us";
-        return os;
-    }
- 
-    const std::chrono::milliseconds millis = std::chrono::duration_cast<std::chrono::milliseconds>(d);
-    if (millis.count() < 1000)
-    {
-        os << d.count() << "ms";
-        return os;
-    }
-
-    const std::chrono::seconds seconds = std::chrono::duration_cast<std::chrono::seconds>(d);
-    if (seconds.count() < 60)
-    {
-        os << d.count() << "s";
-        return os;
-    }
-
-    const std::chrono::minutes minutes = std::chrono::duration_cast<std::chrono::minutes>(d);
-    if (minutes.count() < 60)
-    {
-        os << d.count() << "min";
-        return os;
-    }
-
-    const std::chrono::hours hours = std::chrono::duration_cast<std::chrono::hours>(d);
-    if (hours.count() < 24)
-    {
-        os << d.count() << "h";
-        return os;
-    }
-
-    os << d.count() / 24 << "days";
-
-    return os;
-}
-
-template<typename TCHRONO = std::chrono::high_resolution_clock>
-class Timer
-{
-public:
-    using chrono_t = TCHRONO;
-    using  timepoint_t = typename chrono_t::time_point;
-    using duration_t = typename chrono_t::duration;
-
-public:
-    Timer(const std::string& tag = "") : m_tag(tag), m_t0() { Tick(); }
-    ~Timer() { if (!m_tag.empty()) Print(std::cerr); }
-    
-    void Print(std::ostream& os = std::cout) const
-    {
-        os << "Duration(" << GetTag() << "): " << Tock() << std::endl;
-    }
-
-    void SetTag(const std::string& tag) { m_tag = tag;}
-    const std::string& GetTag() const { return m_tag; }
-
-    void Tick() { m_t0 = chrono_t::now(); }
-    duration_t Tock() const { return  chrono_t::now() - m_t0; } 
-
-private:
-    timepoint_t m_t0;
-    std::string m_tag;
-};
+#include <cstring> // std::memcmp
+#include <random>
+#include <unordered_map>
+#include <fstream>
+#include <filesystem>
+#include <array>
+#include <bit> // std::bit_ceil
+
+#include "benchmark.h"
+#include "memory_allocators.h" // arena_concurrent
+#include "numa_array.h"
+#include "parallel_algorithms.h"
+#include "parallel_sort.h"
+#include "pipeline.h"
+#include "file_map_reduce.h"
+#include "flat_hash_map.h"
+#include "reduce_by_key.h"
+#include "simd_reduce.h"
+#include "simd_scan.h"
+#include "trace.h"
 
 template<typename T>
 std::ostream& operator<< (std::ostream& os, const std::vector<T>& c)
@@ -127,9 +75,28 @@ C fibonacci(size_t i_count)
     return result;
 }
 
+// the recurrence above is inherently sequential, but {F(n+1), F(n); F(n), F(n-1)} = M^n with M = {1, 1; 1, 0}:
+// the prefix products of M are a scan with an associative (not commutative) op, which runs in parallel
+template<typename C>
+C fibonacci(work_stealing_pool& pool, size_t i_count)
+{
+    using num_t = typename C::value_type;
+    using matrix_t = std::array<num_t, 4>;
+
+    const std::vector<matrix_t> steps(i_count, matrix_t{1, 1, 1, 0});
+    std::vector<matrix_t> powers(i_count);
+    parallel::inclusive_scan(pool, std::begin(steps), std::end(steps), std::begin(powers), [](const matrix_t& a, const matrix_t& b) {
+        return matrix_t{a[0] * b[0] + a[1] * b[2], a[0] * b[1] + a[1] * b[3], a[2] * b[0] + a[3] * b[2], a[2] * b[1] + a[3] * b[3]};
+    });
+
+    C result(i_count);
+    parallel::transform(pool, std::begin(powers), std::end(powers), std::begin(result), [](const matrix_t& power) { return power[2]; });
+    return result;
+}
+
 ////////////////////////////////////////////////////////////
 
-void test_adjacent(size_t i_count)
+void test_adjacent(work_stealing_pool& pool, size_t i_count)
 {
     using num_t = int;
     using container_t = std::vector<num_t>;
@@ -138,8 +105,8 @@ void test_adjacent(size_t i_count)
     num_t acc = 0;
     std::generate(std::begin(nums), std::end(nums), [&acc](){return acc+=acc+1; } );
 
-    container_t nums2;
-    std::adjacent_difference(std::begin(nums), std::end(nums), std::back_inserter(nums2));
+    container_t nums2(nums.size());
+    parallel::adjacent_difference(pool, std::begin(nums), std::end(nums), std::begin(nums2));
 
     std::cout << "nums: " << nums << std::endl;
     std::cout << "adj_diff: " << nums2 << std::endl;
@@ -148,7 +115,7 @@ void test_adjacent(size_t i_count)
 
 ////////////////////////////////////////////////////////////
 
-void test_map_reduce(size_t i_count)
+void test_map_reduce(bench::runner& runner, size_t i_count)
 {
     using num_t = int;
     std::vector<num_t> data0;
@@ -161,74 +128,817 @@ void test_map_reduce(size_t i_count)
     std::generate(begin(data0), end(data0), [&count](){ return count++; });
     std::generate(begin(data1), end(data1), [&count](){ return count++ % 2 == 0; });
 
-    Timer timer;
-
     std::vector<num_t> transformed;
     transformed.resize(data0.size());
 
-    {
-        Timer timer("seq map/transform");
+    runner.run("seq map/transform", [&]() {
         std::transform(std::execution::seq,
             begin(data0), end(data0),
             begin(transformed),
                 [](const num_t& a) -> num_t {
                     return a + 1;
         });
-    }    
-    {
-        Timer timer("par map/transform");
+    });
+    runner.run("par map/transform", [&]() {
         std::transform(std::execution::par,
             begin(data0), end(data0),
             begin(transformed),
                 [](const num_t& a) -> num_t {
                     return a + 1;
         });
-    }    
-    {
-        Timer timer("par_unseq map/transform");
+    });
+    runner.run("par_unseq map/transform", [&]() {
         std::transform(std::execution::par_unseq,
             begin(data0), end(data0),
             begin(transformed),
                 [](const num_t& a) -> num_t {
                     return a + 1;
         });
-    }
+    });
 
     //////////////////////////////////////////
 
     num_t reduceResult = -1;
-    {
-        Timer timer("seq reduce");
+    runner.run("seq reduce", [&]() {
         reduceResult = std::reduce(
             std::execution::seq,
             begin(data0), end(data0), 0);
-    }
-    {
-        Timer timer("par reduce");
+        bench::do_not_optimize(reduceResult);
+    });
+    runner.run("par reduce", [&]() {
         reduceResult = std::reduce(
             std::execution::par,
             begin(data0), end(data0), 0);
-    }
-    {
-        Timer timer("par_unseq reduce");
+        bench::do_not_optimize(reduceResult);
+    });
+    runner.run("par_unseq reduce", [&]() {
         reduceResult = std::reduce(
             std::execution::par_unseq,
             begin(data0), end(data0), 0);
-    }
+        bench::do_not_optimize(reduceResult);
+    });
     std::cout << "reduce: " << reduceResult << std::endl;
 }
 
 ////////////////////////////////////////////////////////////
+
+// every item needs some scratch memory: compare going through malloc against a shared arena_concurrent
+void test_parallel_temporaries(bench::runner& runner, size_t i_count, size_t i_scratchCount = 64)
+{
+    using num_t = int;
+    std::vector<num_t> data(i_count);
+    std::iota(begin(data), end(data), 0);
+    std::vector<num_t> result(i_count);
+
+    auto work = [i_scratchCount](num_t value, num_t* scratch) -> num_t {
+        for (size_t i = 0; i < i_scratchCount; ++i)
+        {
+            scratch[i] = value ^ static_cast<num_t>(i);
+        }
+        return std::accumulate(scratch, scratch + i_scratchCount, num_t(0));
+    };
+
+    runner.run("par transform, malloc temporaries", [&]() {
+        std::transform(std::execution::par,
+            begin(data), end(data),
+            begin(result),
+                [&work, i_scratchCount](const num_t& a) -> num_t {
+                    std::vector<num_t> scratch(i_scratchCount);
+                    return work(a, scratch.data());
+        });
+    });
+
+    arena_concurrent<> arena(i_count * i_scratchCount * sizeof(num_t) * 2);
+    auto arenaBatch = [&]() {
+        std::transform(std::execution::par,
+            begin(data), end(data),
+            begin(result),
+                [&work, &arena, i_scratchCount](const num_t& a) -> num_t {
+                    return work(a, arena.allocate_array<num_t>(i_scratchCount));
+        });
+        arena.reset(); // end of batch, the next one reuses the same pages
+    };
+    {// first touch of the arena pages only happens once
+        bench::scoped_timer timer("par transform, arena temporaries (cold pages)");
+        arenaBatch();
+    }
+    runner.run("par transform, arena temporaries", arenaBatch);
+    std::cout << "temporaries: " << result.back() << std::endl;
+}
+
+////////////////////////////////////////////////////////////
+
+// same operations test_map_reduce times with the std execution policies, on the work stealing pool
+void test_work_stealing(bench::runner& runner, size_t i_count, size_t i_threadCount = 0, size_t i_grain = 0)
+{
+    using num_t = long long;
+    std::vector<num_t> data0(i_count);
+    std::iota(begin(data0), end(data0), 0);
+    std::vector<num_t> transformed(i_count);
+
+    work_stealing_pool pool(i_threadCount);
+    std::cout << "work stealing pool: " << pool.thread_count() << " threads, grain "
+        << parallel::chunk_size(pool, i_count, i_grain) << std::endl;
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = i_count * sizeof(num_t);
+
+    auto increment = [](const num_t& a) -> num_t { return a + 1; };
+    runner.run("par_unseq map/transform", setup, [&]() {
+        std::transform(std::execution::par_unseq, begin(data0), end(data0), begin(transformed), increment);
+    });
+    runner.run("pool map/transform", setup, [&]() {
+        parallel::transform(pool, begin(data0), end(data0), begin(transformed), increment, i_grain);
+    });
+
+    num_t stdResult = 0;
+    num_t poolResult = 0;
+    runner.run("par_unseq reduce", setup, [&]() {
+        stdResult = std::reduce(std::execution::par_unseq, begin(data0), end(data0), num_t(0));
+        bench::do_not_optimize(stdResult);
+    });
+    runner.run("pool reduce", setup, [&]() {
+        poolResult = parallel::reduce(pool, begin(data0), end(data0), num_t(0), std::plus<>(), i_grain);
+        bench::do_not_optimize(poolResult);
+    });
+    std::cout << "reduce: " << poolResult << (poolResult == stdResult ? " (match)" : " (MISMATCH)") << std::endl;
+
+    runner.run("par_unseq transform_reduce", setup, [&]() {
+        stdResult = std::transform_reduce(std::execution::par_unseq, begin(data0), end(data0), num_t(0), std::plus<>(), increment);
+        bench::do_not_optimize(stdResult);
+    });
+    runner.run("pool transform_reduce", setup, [&]() {
+        poolResult = parallel::transform_reduce(pool, begin(data0), end(data0), num_t(0), std::plus<>(), increment, i_grain);
+        bench::do_not_optimize(poolResult);
+    });
+    std::cout << "transform_reduce: " << poolResult << (poolResult == stdResult ? " (match)" : " (MISMATCH)") << std::endl;
+
+    std::vector<num_t> scanned(i_count);
+    runner.run("par_unseq inclusive_scan", setup, [&]() {
+        std::inclusive_scan(std::execution::par_unseq, begin(data0), end(data0), begin(transformed));
+    });
+    runner.run("pool inclusive_scan", setup, [&]() {
+        parallel::inclusive_scan(pool, begin(data0), end(data0), begin(scanned), std::plus<>(), i_grain);
+    });
+    std::cout << "inclusive_scan: " << (scanned == transformed ? "match" : "MISMATCH") << std::endl;
+}
+
+////////////////////////////////////////////////////////////
+
+// map -> filter -> reduce, materializing every stage (what test_map_reduce does) vs a fused pipeline
+void test_fused_pipeline(bench::runner& runner, size_t i_count)
+{
+    using num_t = int;
+    std::vector<num_t> data0(i_count);
+    std::iota(begin(data0), end(data0), 0);
+
+    auto increment = [](const num_t& a) -> num_t { return a + 1; };
+    auto isEven = [](const num_t& a) { return a % 2 == 0; };
+    const long long inputBytes = static_cast<long long>(i_count * sizeof(num_t));
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = static_cast<uint64_t>(inputBytes);
+
+    long long unfusedResult = 0;
+    runner.run("unfused transform + copy_if + reduce", setup, [&]() {
+        std::vector<num_t> transformed(i_count);
+        std::transform(begin(data0), end(data0), begin(transformed), increment);
+        std::vector<num_t> filtered;
+        filtered.reserve(i_count);
+        std::copy_if(begin(transformed), end(transformed), std::back_inserter(filtered), isEven);
+        unfusedResult = std::reduce(begin(filtered), end(filtered), 0LL);
+        bench::do_not_optimize(unfusedResult);
+    });
+    // read input + write/read transformed + write/read filtered (half of them pass)
+    std::cout << "unfused memory traffic: " << (inputBytes * 4) / (1024 * 1024) << "MB" << std::endl;
+
+    long long fusedResult = 0;
+    runner.run("fused pipeline seq", setup, [&]() {
+        fusedResult = pipeline::source(data0)
+            | pipeline::map(increment)
+            | pipeline::filter(isEven)
+            | pipeline::reduce(0LL, std::plus<>());
+        bench::do_not_optimize(fusedResult);
+    });
+    std::cout << "fused memory traffic: " << inputBytes / (1024 * 1024) << "MB" << std::endl;
+
+    work_stealing_pool pool;
+    long long fusedParallelResult = 0;
+    runner.run("fused pipeline pool", setup, [&]() {
+        fusedParallelResult = pipeline::source(data0).on(pool)
+            | pipeline::map(increment)
+            | pipeline::filter(isEven)
+            | pipeline::reduce(0LL, std::plus<>(), std::plus<>());
+        bench::do_not_optimize(fusedParallelResult);
+    });
+
+    const bool isMatch = unfusedResult == fusedResult && fusedResult == fusedParallelResult;
+    std::cout << "pipeline: " << fusedResult << (isMatch ? " (match)" : " (MISMATCH)") << std::endl;
+}
+
+////////////////////////////////////////////////////////////
+
+struct sample_record
+{
+    uint32_t key;
+    float value;
+};
+
+// writes i_recordCount records to a temporary file and map/reduces it with a window much smaller than the file,
+// the same driver runs over files that don't fit in RAM
+void test_file_map_reduce(bench::runner& runner, size_t i_recordCount, size_t i_windowBytes = size_t(16) << 20)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "std_map_reduce_records.bin").string();
+    double expected = 0.0;
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        std::vector<sample_record> batch(1 << 16);
+        for (size_t written = 0; written < i_recordCount; written += batch.size())
+        {
+            const size_t count = std::min(batch.size(), i_recordCount - written);
+            for (size_t i = 0; i < count; ++i)
+            {
+                batch[i] = sample_record{static_cast<uint32_t>(written + i), static_cast<float>((written + i) % 100)};
+                expected += batch[i].key % 2 == 0 ? batch[i].value : 0.0;
+            }
+            file.write(reinterpret_cast<const char*>(batch.data()), count * sizeof(sample_record));
+        }
+    }
+    std::cout << "file map/reduce: " << i_recordCount * sizeof(sample_record) / (1024 * 1024) << "MB file, "
+        << i_windowBytes / (1024 * 1024) << "MB windows" << std::endl;
+
+    work_stealing_pool pool;
+    auto mapOp = [](const sample_record& record) -> double { return record.key % 2 == 0 ? record.value : 0.0; };
+    auto combineOp = [](double accum, double value) { return accum + value; };
+
+    // every run streams the whole file, a few samples are enough
+    bench::settings setup = runner.get_config().defaults;
+    setup.warmup = 1;
+    setup.samples = std::min<size_t>(setup.samples, 5);
+    setup.bytes = i_recordCount * sizeof(sample_record);
+
+    for (const bool useMmap : {false, true})
+    {
+        file_map_reduce_options options;
+        options.windowBytes = i_windowBytes;
+        options.useMmap = useMmap;
+
+        double result = 0.0;
+        bool isOk = true;
+        runner.run(useMmap ? "file map/reduce mmap" : "file map/reduce pread", setup, [&]() {
+            isOk = map_reduce_file<sample_record>(pool, path, 0.0, mapOp, combineOp, combineOp, result, options) && isOk;
+        });
+        std::cout << "file map/reduce: " << result << (isOk && result == expected ? " (match)" : " (MISMATCH)") << std::endl;
+    }
+
+    std::filesystem::remove(path);
+}
+
+////////////////////////////////////////////////////////////
+
+// count occurrences of uniformly drawn keys, i_count = 0 uses max(cardinality, 20M) elements
+void test_reduce_by_key(bench::runner& runner, size_t i_cardinality, size_t i_count = 0)
+{
+    using key_t = uint32_t;
+    const size_t count = i_count > 0 ? i_count : std::max<size_t>(i_cardinality, 20000000);
+
+    std::vector<key_t> keys(count);
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<key_t> dist(0, static_cast<key_t>(i_cardinality - 1));
+        // every key shows up at least once so the cardinality is exact
+        for (size_t i = 0; i < count; ++i)
+        {
+            keys[i] = i < i_cardinality ? static_cast<key_t>(i) : dist(gen);
+        }
+    }
+    std::cout << "reduce_by_key: " << count << " elements, " << i_cardinality << " distinct keys" << std::endl;
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.warmup = 1;
+    setup.samples = std::min<size_t>(setup.samples, 5);
+
+    size_t stdGroups = 0;
+    if (i_cardinality <= 10000000)
+    {
+        runner.run("unordered_map group by, " + std::to_string(i_cardinality) + " keys", setup, [&]() {
+            std::unordered_map<key_t, uint32_t> counts;
+            for (const key_t key : keys)
+            {
+                ++counts[key];
+            }
+            stdGroups = counts.size();
+        });
+        runner.run("flat_hash_map group by, " + std::to_string(i_cardinality) + " keys", setup, [&]() {
+            flat_hash_map<key_t, uint32_t> counts;
+            for (const key_t key : keys)
+            {
+                ++counts[key];
+            }
+            bench::do_not_optimize(counts.size());
+        });
+    }
+
+    work_stealing_pool pool;
+    reduce_by_key_stats stats;
+    std::vector<std::pair<key_t, uint32_t>> groups;
+    auto groupBy = [&]() {
+        groups = reduce_by_key(pool, begin(keys), end(keys),
+            [](key_t key) { return key; },
+            [](key_t) { return uint32_t(1); },
+            std::plus<>(),
+            &stats);
+    };
+    if (count < 100000000)
+    {
+        runner.run("pool reduce_by_key, " + std::to_string(i_cardinality) + " keys", setup, groupBy);
+    }
+    else
+    {// too long to repeat, and the hash tables don't fit in any cache anyway
+        bench::scoped_timer timer("pool reduce_by_key, " + std::to_string(i_cardinality) + " keys");
+        groupBy();
+    }
+
+    const size_t total = std::accumulate(begin(groups), end(groups), size_t(0),
+        [](size_t accum, const std::pair<key_t, uint32_t>& group) { return accum + group.second; });
+    const bool isOk = groups.size() == i_cardinality && total == count && (stdGroups == 0 || stdGroups == groups.size());
+    std::cout << "reduce_by_key: " << groups.size() << " groups" << (isOk ? " (match)" : " (MISMATCH)")
+        << ", partitions " << stats.partitionCount
+        << " min/max/mean/stddev " << stats.minPartitionSize << "/" << stats.maxPartitionSize
+        << "/" << stats.meanPartitionSize << "/" << stats.stddevPartitionSize
+        << " skew " << stats.skew << std::endl;
+}
+
+////////////////////////////////////////////////////////////
+
+uint64_t* find_value(std::unordered_map<uint64_t, uint64_t>& map, uint64_t key)
+{
+    const auto it = map.find(key);
+    return it == map.end() ? nullptr : &it->second;
+}
+
+template<typename Hash, typename Allocator>
+uint64_t* find_value(flat_hash_map<uint64_t, uint64_t, Hash, Allocator>& map, uint64_t key)
+{
+    return map.find(key);
+}
+
+// insert / find / erase mixes on random 64 bit ids (what base36 decoding produces), i_count keys
+template<typename Map, typename MakeMap>
+void run_hash_map_mixes(bench::runner& runner, const std::string& i_name, const bench::settings& setup, MakeMap makeMap,
+    const std::vector<uint64_t>& keys, const std::vector<uint64_t>& missingKeys, const std::vector<std::pair<uint8_t, uint64_t>>& operations)
+{
+    runner.run(i_name + " insert", setup, [&]() {
+        Map map = makeMap();
+        for (const uint64_t key : keys)
+        {
+            map.try_emplace(key, key);
+        }
+        bench::do_not_optimize(map.size());
+    });
+
+    Map map = makeMap();
+    for (const uint64_t key : keys)
+    {
+        map.try_emplace(key, key);
+    }
+    runner.run(i_name + " find hit", setup, [&]() {
+        uint64_t sum = 0;
+        for (const uint64_t key : keys)
+        {
+            sum += *find_value(map, key);
+        }
+        bench::do_not_optimize(sum);
+    });
+    runner.run(i_name + " find miss", setup, [&]() {
+        size_t found = 0;
+        for (const uint64_t key : missingKeys)
+        {
+            found += find_value(map, key) != nullptr;
+        }
+        bench::do_not_optimize(found);
+    });
+
+    // half of the key space present, inserts and erases keep it there
+    for (size_t i = 0; i < keys.size(); i += 2)
+    {
+        map.erase(keys[i]);
+    }
+    runner.run(i_name + " find/insert/erase 50/25/25", setup, [&]() {
+        size_t found = 0;
+        for (const auto& [operation, key] : operations)
+        {
+            switch (operation)
+            {
+            case 0: found += find_value(map, key) != nullptr; break;
+            case 1: map.try_emplace(key, key); break;
+            default: map.erase(key); break;
+            }
+        }
+        bench::do_not_optimize(found);
+    });
+    std::cout << i_name << ": " << map.size() << " keys after the mix" << std::endl;
+}
+
+void test_hash_maps(bench::runner& runner, size_t i_count)
+{
+    std::mt19937_64 gen(42);
+    std::vector<uint64_t> keys(i_count);
+    std::generate(begin(keys), end(keys), [&]() { return gen(); });
+    std::vector<uint64_t> missingKeys(i_count);
+    std::generate(begin(missingKeys), end(missingKeys), [&]() { return gen(); });
+    std::vector<std::pair<uint8_t, uint64_t>> operations(i_count);
+    for (auto& [operation, key] : operations)
+    {
+        const uint64_t draw = gen();
+        operation = draw % 4 < 2 ? 0 : static_cast<uint8_t>(draw % 4 - 1);
+        key = keys[(draw >> 8) % i_count];
+    }
+    std::cout << "hash maps: " << i_count << " keys" << std::endl;
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.warmup = 1;
+    setup.samples = std::min<size_t>(setup.samples, 5);
+
+    using std_map_t = std::unordered_map<uint64_t, uint64_t>;
+    run_hash_map_mixes<std_map_t>(runner, "unordered_map", setup, []() { return std_map_t(); }, keys, missingKeys, operations);
+
+    using flat_map_t = flat_hash_map<uint64_t, uint64_t>;
+    run_hash_map_mixes<flat_map_t>(runner, "flat_hash_map", setup, []() { return flat_map_t(); }, keys, missingKeys, operations);
+
+    // rehashes bump allocate from an arena, dropped at once when the map goes away
+    using slot_t = flat_map_t::slot_type;
+    using arena_map_t = flat_hash_map<uint64_t, uint64_t, flat_hash<uint64_t>, ConcurrentArenaAllocator<slot_t>>;
+    arena_concurrent<> arena(8 * std::bit_ceil(i_count) * sizeof(slot_t) + (size_t(1) << 20));
+    ConcurrentArenaAllocator<slot_t> arenaAllocator(arena);
+    runner.run("flat_hash_map arena insert", setup, [&]() {
+        {
+            arena_map_t map(arenaAllocator);
+            for (const uint64_t key : keys)
+            {
+                map.try_emplace(key, key);
+            }
+            bench::do_not_optimize(map.size());
+        }
+        arena.reset();
+    });
+}
+
+////////////////////////////////////////////////////////////
+
+void test_simd_reduce(bench::runner& runner, size_t i_count)
+{
+    std::vector<float> data(i_count);
+    std::vector<int32_t> ints(i_count);
+    {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        std::generate(begin(data), end(data), [&]() { return dist(gen); });
+        std::uniform_int_distribution<int32_t> intDist(-1000, 1000);
+        std::generate(begin(ints), end(ints), [&]() { return intDist(gen); });
+    }
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = i_count * sizeof(float);
+
+    float stdSum = 0.f;
+    runner.run("par_unseq float reduce", setup, [&]() {
+        stdSum = std::reduce(std::execution::par_unseq, begin(data), end(data), 0.f);
+        bench::do_not_optimize(stdSum);
+    });
+    std::cout << "par_unseq float reduce: " << stdSum << std::endl;
+
+    for (const simd::isa isa : {simd::isa::scalar, simd::isa::avx2, simd::isa::avx512})
+    {
+        if (isa > simd::detected_isa())
+        {
+            continue;
+        }
+        simd::set_isa(isa);
+        const std::string name = simd::isa_name(isa);
+
+        float fastSum = 0.f;
+        float deterministicSum = 0.f;
+        int64_t intSum = 0;
+        runner.run(name + " float sum fast", setup, [&]() {
+            fastSum = simd::sum(data.data(), data.size(), simd::reduce_mode::fast);
+            bench::do_not_optimize(fastSum);
+        });
+        runner.run(name + " float sum deterministic", setup, [&]() {
+            deterministicSum = simd::sum(data.data(), data.size(), simd::reduce_mode::deterministic);
+            bench::do_not_optimize(deterministicSum);
+        });
+        runner.run(name + " int sum", setup, [&]() {
+            intSum = simd::sum(ints.data(), ints.size());
+            bench::do_not_optimize(intSum);
+        });
+        std::cout << name << " sums: fast " << fastSum << ", deterministic " << deterministicSum << ", int " << intSum
+            << ", min/max " << simd::min(data.data(), data.size()) << "/" << simd::max(data.data(), data.size())
+            << ", dot " << simd::dot(data.data(), data.data(), data.size(), simd::reduce_mode::deterministic) << std::endl;
+    }
+    simd::set_isa(simd::detected_isa());
+
+    // the deterministic sum has to be bit-identical whatever the thread count
+    const float reference = simd::sum(data.data(), data.size(), simd::reduce_mode::deterministic);
+    for (const size_t threadCount : {size_t(1), size_t(2), size_t(4), size_t(8)})
+    {
+        work_stealing_pool pool(threadCount);
+        float result = 0.f;
+        runner.run("pool deterministic sum, " + std::to_string(threadCount) + " threads", setup, [&]() {
+            result = simd::sum(pool, data.data(), data.size(), simd::reduce_mode::deterministic);
+            bench::do_not_optimize(result);
+        });
+        const bool isIdentical = std::memcmp(&result, &reference, sizeof(float)) == 0;
+        std::cout << "deterministic sum: " << result << (isIdentical ? " (bit-identical)" : " (DIFFERENT)") << std::endl;
+    }
+}
+
+////////////////////////////////////////////////////////////
+
+// std scans (sequential, par_unseq) against the blocked scans of parallel:: and the in-register SIMD ones
+void test_scan(bench::runner& runner, size_t i_count)
+{
+    using num_t = int32_t;
+    std::vector<num_t> data(i_count);
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<num_t> dist(-1000, 1000);
+        std::generate(begin(data), end(data), [&]() { return dist(gen); });
+    }
+    std::vector<num_t> expected(i_count);
+    std::vector<num_t> scanned(i_count);
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = i_count * sizeof(num_t) * 2;
+
+    work_stealing_pool pool;
+    runner.run("seq inclusive_scan", setup, [&]() {
+        std::inclusive_scan(begin(data), end(data), begin(expected));
+    });
+    runner.run("par_unseq inclusive_scan", setup, [&]() {
+        std::inclusive_scan(std::execution::par_unseq, begin(data), end(data), begin(scanned));
+    });
+    runner.run("pool inclusive_scan", setup, [&]() {
+        parallel::inclusive_scan(pool, begin(data), end(data), begin(scanned));
+    });
+    runner.run(std::string(simd::isa_name(simd::active_isa())) + " inclusive_scan", setup, [&]() {
+        simd::inclusive_scan(data.data(), data.size(), scanned.data());
+    });
+    runner.run(std::string("pool ") + simd::isa_name(simd::active_isa()) + " inclusive_scan", setup, [&]() {
+        simd::inclusive_scan(pool, data.data(), data.size(), scanned.data());
+    });
+    std::cout << "inclusive_scan: " << (scanned == expected ? "match" : "MISMATCH") << std::endl;
+
+    std::exclusive_scan(begin(data), end(data), begin(expected), num_t(0));
+    runner.run(std::string("pool ") + simd::isa_name(simd::active_isa()) + " exclusive_scan", setup, [&]() {
+        simd::exclusive_scan(pool, data.data(), data.size(), scanned.data());
+    });
+    std::cout << "exclusive_scan: " << (scanned == expected ? "match" : "MISMATCH") << std::endl;
+
+    runner.run("seq adjacent_difference", setup, [&]() {
+        std::adjacent_difference(begin(data), end(data), begin(expected));
+    });
+    runner.run("pool adjacent_difference", setup, [&]() {
+        parallel::adjacent_difference(pool, begin(data), end(data), begin(scanned));
+    });
+    runner.run(std::string("pool ") + simd::isa_name(simd::active_isa()) + " adjacent_difference", setup, [&]() {
+        simd::adjacent_difference(pool, data.data(), data.size(), scanned.data());
+    });
+    std::cout << "adjacent_difference: " << (scanned == expected ? "match" : "MISMATCH") << std::endl;
+
+    std::vector<num_t> kept(i_count);
+    size_t keptCount = 0;
+    runner.run("pool copy_if", setup, [&]() {
+        keptCount = parallel::copy_if(pool, begin(data), end(data), begin(kept), [](num_t v) { return v > 0; }) - begin(kept);
+    });
+    const size_t expectedCount = std::copy_if(begin(data), end(data), begin(expected), [](num_t v) { return v > 0; }) - begin(expected);
+    const bool isMatch = keptCount == expectedCount && std::equal(begin(kept), begin(kept) + keptCount, begin(expected));
+    std::cout << "copy_if: " << keptCount << (isMatch ? " (match)" : " (MISMATCH)") << std::endl;
+}
+
+////////////////////////////////////////////////////////////
+
+enum class key_distribution { uniform, few_unique, sorted, skewed };
+
+const char* to_string(key_distribution i_distribution)
+{
+    switch (i_distribution)
+    {
+    case key_distribution::uniform: return "uniform";
+    case key_distribution::few_unique: return "16 unique";
+    case key_distribution::sorted: return "sorted";
+    case key_distribution::skewed: return "skewed";
+    }
+    return "";
+}
+
+// std::sort (seq, par) against radix, sample sort and top-k. Sorting is in place so every call sorts a fresh copy,
+// the "copy" run is that baseline.
+void test_sort(bench::runner& runner, size_t i_count, key_distribution i_distribution)
+{
+    using key_t = uint32_t;
+    std::vector<key_t> keys(i_count);
+    {
+        std::mt19937 gen(42);
+        std::exponential_distribution<double> exponential(1e-4);
+        for (size_t i = 0; i < i_count; ++i)
+        {
+            switch (i_distribution)
+            {
+            case key_distribution::uniform: keys[i] = static_cast<key_t>(gen()); break;
+            case key_distribution::few_unique: keys[i] = static_cast<key_t>(gen() % 16); break;
+            case key_distribution::sorted: keys[i] = static_cast<key_t>(i); break;
+            case key_distribution::skewed: keys[i] = static_cast<key_t>(exponential(gen)); break;
+            }
+        }
+    }
+    std::vector<key_t> expected(keys);
+    std::sort(begin(expected), end(expected));
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = i_count * sizeof(key_t);
+    const std::string suffix = std::string(", ") + to_string(i_distribution) + " " + std::to_string(i_count);
+
+    work_stealing_pool pool;
+    std::vector<key_t> sorted(i_count);
+    runner.run("copy" + suffix, setup, [&]() {
+        std::copy(begin(keys), end(keys), begin(sorted));
+        bench::clobber_memory();
+    });
+    runner.run("seq sort" + suffix, setup, [&]() {
+        sorted = keys;
+        std::sort(begin(sorted), end(sorted));
+    });
+    runner.run("par sort" + suffix, setup, [&]() {
+        sorted = keys;
+        std::sort(std::execution::par, begin(sorted), end(sorted));
+    });
+    runner.run("pool radix_sort" + suffix, setup, [&]() {
+        sorted = keys;
+        parallel::radix_sort(pool, sorted.data(), sorted.size());
+    });
+    bool isMatch = sorted == expected;
+    runner.run("pool sample_sort" + suffix, setup, [&]() {
+        sorted = keys;
+        parallel::sample_sort(pool, begin(sorted), end(sorted));
+    });
+    isMatch &= sorted == expected;
+
+    // key/value: sort record indices by key
+    std::vector<key_t> sortedKeys(i_count);
+    std::vector<uint32_t> indices(i_count);
+    runner.run("pool radix_sort_by_key" + suffix, setup, [&]() {
+        sortedKeys = keys;
+        std::iota(begin(indices), end(indices), uint32_t(0));
+        parallel::radix_sort_by_key(pool, sortedKeys.data(), indices.data(), i_count);
+    });
+    isMatch &= sortedKeys == expected;
+    for (size_t i = 0; i < i_count && isMatch; ++i)
+    {
+        isMatch = keys[indices[i]] == sortedKeys[i] && (i == 0 || sortedKeys[i - 1] != sortedKeys[i] || indices[i - 1] < indices[i]);
+    }
+    std::cout << "sorts" << suffix << ": " << (isMatch ? "match" : "MISMATCH") << std::endl;
+
+    const size_t k = std::min<size_t>(100, i_count);
+    std::vector<key_t> top(k);
+    runner.run("seq partial_sort_copy top 100" + suffix, setup, [&]() {
+        std::partial_sort_copy(begin(keys), end(keys), begin(top), end(top));
+    });
+    runner.run("pool top_k 100" + suffix, setup, [&]() {
+        parallel::top_k(pool, begin(keys), end(keys), k, begin(top));
+    });
+    std::cout << "top_k" << suffix << ": " << (std::equal(begin(top), end(top), begin(expected)) ? "match" : "MISMATCH") << std::endl;
+}
+
 ////////////////////////////////////////////////////////////
+
+// streaming transform over memory placed by a single thread vs numa::array slices processed by their own node (local)
+// and by the next node (remote). The bandwidth column is read + write.
+void test_numa(bench::runner& runner, size_t i_count)
+{
+    using num_t = float;
+    const auto op = [](num_t v) { return v * 1.5f + 1.f; };
+
+    bench::settings setup = runner.get_config().defaults;
+    setup.bytes = i_count * sizeof(num_t) * 2;
+
+    numa::node_pools pools;
+    std::cout << "numa: " << pools.node_count() << " node(s), " << pools.thread_count() << " threads" << std::endl;
+
+    {// every page first touched by the main thread, so they all sit on its node
+        std::vector<num_t> in(i_count, 1.f);
+        std::vector<num_t> out(i_count);
+        runner.run("par transform, single thread init", setup, [&]() {
+            std::transform(std::execution::par, begin(in), end(in), begin(out), op);
+        });
+    }
+
+    numa::array<num_t> in(pools, i_count, 1.f);
+    numa::array<num_t> out(pools, i_count);
+    std::cout << "numa slices " << (in.is_bound() ? "bound" : "first touch only") << std::endl;
+    runner.run("numa transform, local", setup, [&]() {
+        numa::transform(pools, in, out, op);
+    });
+    const bool isLocalCorrect = std::all_of(out.begin(), out.end(), [&](num_t v) { return v == op(1.f); });
+    if (pools.node_count() > 1)
+    {
+        runner.run("numa transform, remote", setup, [&]() {
+            numa::transform(pools, in, out, op, 0, numa::placement::remote);
+        });
+    }
+    else
+    {
+        std::cout << "numa transform, remote: single node, same as local" << std::endl;
+    }
+
+    bench::settings reduceSetup = setup;
+    reduceSetup.bytes = i_count * sizeof(num_t);
+    const auto toDouble = [](num_t v) { return double(v); };
+    double sum = 0;
+    runner.run("numa transform_reduce, local", reduceSetup, [&]() {
+        sum = numa::transform_reduce(pools, out, 10.0, std::plus<>(), toDouble);
+        bench::do_not_optimize(sum);
+    });
+    // a nonzero init shows up once, not once per node; the values are exact in double so the order doesn't matter
+    const bool isSumCorrect = sum == std::transform_reduce(out.begin(), out.end(), 10.0, std::plus<>(), toDouble)
+        && sum == 10.0 + double(op(1.f)) * double(i_count);
+    std::cout << "numa transform: " << (isLocalCorrect && isSumCorrect ? "match" : "MISMATCH") << std::endl;
+}
+
 ////////////////////////////////////////////////////////////
 
-int main(int, char**)
+// cost of a TRACE_SCOPE with tracing off and with a collector draining to a file
+void test_trace_overhead(bench::runner& runner)
 {
+    bench::settings setup = runner.get_config().defaults;
+    setup.iterations = 1000; // stays under the ring capacity between two collector passes
+
+    runner.run("trace span disabled", setup, []() {
+        TRACE_SCOPE("span");
+        bench::clobber_memory();
+    });
+
+    const std::string path = (std::filesystem::temp_directory_path() / "std_map_reduce_trace.json").string();
+    trace::collector collector(path, std::chrono::milliseconds(1));
+    runner.run("trace span enabled", setup, []() {
+        TRACE_SCOPE("span");
+        bench::clobber_memory();
+    });
+    collector.stop();
+    std::cout << "trace: " << collector.event_count() << " events, " << collector.dropped_count() << " dropped" << std::endl;
+    std::filesystem::remove(path);
+}
+
+////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////
+
+// benchmark.h options: --samples N --warmup N --pin CPU --perf --json PATH --csv PATH
+int main(int argc, char** argv)
+{
+    bench::runner runner(bench::config::from_args(argc, argv));
+
+    work_stealing_pool pool;
     std::cout << "fib: " << fibonacci<std::vector<int>>(10) << std::endl;
+    std::cout << "fib (parallel scan): " << fibonacci<std::vector<int>>(pool, 10) << std::endl;
+
+    test_adjacent(pool, 5);
+
+    test_map_reduce(runner, 5000);
+
+    test_parallel_temporaries(runner, 100000);
+
+    test_work_stealing(runner, 10000000);
+
+    test_fused_pipeline(runner, 100000000);
 
-    test_adjacent(5);
+    test_file_map_reduce(runner, 32 * 1024 * 1024);
+
+    for (const size_t cardinality : {size_t(10), size_t(1000), size_t(100000), size_t(10000000), size_t(100000000)})
+    {
+        test_reduce_by_key(runner, cardinality);
+    }
+
+    for (const size_t count : {size_t(100000), size_t(1000000)})
+    {
+        test_hash_maps(runner, count);
+    }
+
+    test_simd_reduce(runner, 100000000);
+
+    test_scan(runner, 100000000);
+
+    test_numa(runner, 100000000);
+
+    for (const size_t count : {size_t(100000), size_t(10000000)})
+    {
+        for (const key_distribution distribution : {key_distribution::uniform, key_distribution::few_unique, key_distribution::sorted, key_distribution::skewed})
+        {
+            test_sort(runner, count, distribution);
+        }
+    }
 
-    test_map_reduce(5000);
+    test_trace_overhead(runner);
 
     return 0;
 }
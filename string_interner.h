@@ -0,0 +1,264 @@
+/*
+String interning: every distinct string is stored once and named by a 32-bit symbol, so a token repeated millions
+of times costs 4 bytes per occurrence instead of a std::string (32 bytes, plus a heap block past 15 characters) and
+comparing two of them is an integer compare.
+
+  string_interner names(size_t(64) << 20);      // bytes of the arena holding the strings
+  const string_interner::symbol id = names.intern("user_42");
+  if (names.find("user_42") == id) { ... }
+  std::string_view text = names.view(id);       // valid as long as the interner
+
+Symbols are dense (0, 1, 2 ... in insertion order) and never change, so they can index plain arrays. The strings are
+packed in a linear_allocator (memory_allocators.h) over one buffer as [uint32 length][bytes]['\0'], views and c_str()
+stay valid until the interner goes away. Only inserts allocate and they hold the mutex, a plain bump pointer is enough.
+
+The index is an open addressing table of 64-bit slots, linear probing, under half full: the high 32 bits of the
+string hash and symbol + 1 (0 is empty). A probe compares bytes only when the 32 hash bits match. The full hash of
+every symbol is kept next to its string, growing the index rehashes from those precomputed hashes without reading a
+single string, and callers that already have the hash (hash_of) can pass it in.
+
+Concurrency: find, view and intern of a string already present never lock. An insert takes a mutex, writes the
+string and its symbol entry, then publishes the slot with a release store, so a reader that sees the slot sees the
+string. Growing builds a new index and publishes its pointer; the old ones are kept (they add up to less than the
+current one) because a reader may still be probing them. A find racing with the intern of the same string may miss
+it, like any lookup ordered before the insert.
+*/
+#pragma once
+
+#include "flat_hash_map.h" // flat_hash
+#include "memory_allocators.h" // linear_allocator
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+class string_interner
+{
+public:
+    using symbol = uint32_t;
+    static constexpr symbol k_noSymbol = ~symbol(0);
+
+private:
+    struct entry
+    {
+        const char* data = nullptr;
+        uint64_t hash = 0;
+    };
+
+    struct index
+    {
+        explicit index(size_t capacity)
+            : mask(capacity - 1)
+            , slots(std::make_unique<std::atomic<uint64_t>[]>(capacity))
+        {
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots; // value initialized: all empty
+    };
+
+    // symbol entries live in chunks of 1K, 2K, 4K ... entries that never move
+    static constexpr size_t k_firstChunkBits = 10;
+    static constexpr size_t k_chunkCount = 33 - k_firstChunkBits;
+
+    static uint64_t make_slot(uint64_t hash, symbol id) { return (hash & 0xFFFFFFFF00000000ull) | (uint64_t(id) + 1); }
+
+public:
+    ///byteCapacity bounds the arena holding the strings (5 bytes of overhead each)
+    explicit string_interner(size_t byteCapacity, size_t expectedSymbols = 1024)
+        : m_bytes(new char[byteCapacity])
+        , m_arena(m_bytes.get(), byteCapacity)
+    {
+        m_indices.push_back(std::make_unique<index>(std::bit_ceil(std::max<size_t>(2 * expectedSymbols, 16))));
+        m_index.store(m_indices.back().get(), std::memory_order_release);
+    }
+    string_interner(const string_interner&) = delete;
+    string_interner& operator=(const string_interner&) = delete;
+
+    static uint64_t hash_of(std::string_view text) { return flat_hash<std::string_view>()(text); }
+
+    ///Symbol of text, added if it's new
+    ///@return k_noSymbol when the arena is full
+    symbol intern(std::string_view text) { return intern(text, hash_of(text)); }
+    symbol intern(std::string_view text, uint64_t hash)
+    {
+        const symbol found = find(text, hash);
+        if (found != k_noSymbol)
+        {
+            return found;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const symbol raced = find(text, hash); // another thread may have added it while we waited
+        if (raced != k_noSymbol)
+        {
+            return raced;
+        }
+        const symbol id = m_size.load(std::memory_order_relaxed);
+        if (id == k_noSymbol - 1)
+        {
+            std::cerr << "string_interner: no symbol left" << std::endl;
+            return k_noSymbol;
+        }
+        if (text.size() > UINT32_MAX)
+        {
+            std::cerr << "string_interner: strings are limited to 4 GiB" << std::endl;
+            return k_noSymbol;
+        }
+        char* block = m_arena.allocate(sizeof(uint32_t) + text.size() + 1);
+        if (block == nullptr)
+        {
+            std::cerr << "string_interner: the string arena is full" << std::endl;
+            return k_noSymbol;
+        }
+        if (!ensure_chunk(id))
+        {
+            m_arena.deallocate(block, sizeof(uint32_t) + text.size() + 1);
+            return k_noSymbol;
+        }
+        const uint32_t length = static_cast<uint32_t>(text.size());
+        std::memcpy(block, &length, sizeof(length));
+        std::memcpy(block + sizeof(length), text.data(), text.size());
+        block[sizeof(length) + text.size()] = '\0';
+
+        entry& symbolEntry = entry_at(id);
+        symbolEntry.data = block + sizeof(length);
+        symbolEntry.hash = hash;
+
+        index* table = m_index.load(std::memory_order_relaxed);
+        if (2 * (size_t(id) + 1) > table->mask + 1)
+        {
+            table = grow(*table, id);
+        }
+        place(*table, make_slot(hash, id), hash, std::memory_order_release);
+        m_size.store(id + 1, std::memory_order_release);
+        return id;
+    }
+
+    ///@return k_noSymbol if text was never interned
+    symbol find(std::string_view text) const { return find(text, hash_of(text)); }
+    symbol find(std::string_view text, uint64_t hash) const
+    {
+        const index* table = m_index.load(std::memory_order_acquire);
+        const uint64_t tag = hash & 0xFFFFFFFF00000000ull;
+        for (size_t bucket = hash & table->mask;; bucket = (bucket + 1) & table->mask)
+        {
+            const uint64_t slot = table->slots[bucket].load(std::memory_order_acquire);
+            if (slot == 0)
+            {
+                return k_noSymbol;
+            }
+            if ((slot & 0xFFFFFFFF00000000ull) == tag)
+            {
+                const symbol id = static_cast<symbol>(slot) - 1;
+                if (view(id) == text)
+                {
+                    return id;
+                }
+            }
+        }
+    }
+
+    ///id has to come from this interner
+    std::string_view view(symbol id) const
+    {
+        const char* data = entry_at(id).data;
+        uint32_t length;
+        std::memcpy(&length, data - sizeof(length), sizeof(length));
+        return std::string_view(data, length);
+    }
+    ///Interned strings are '\0' terminated
+    const char* c_str(symbol id) const { return entry_at(id).data; }
+    uint64_t symbol_hash(symbol id) const { return entry_at(id).hash; }
+
+    size_t size() const { return m_size.load(std::memory_order_acquire); }
+    ///Arena, index and symbol entries; retired indices included
+    size_t memory_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t bytes = m_arena.used();
+        for (const std::unique_ptr<index>& table : m_indices)
+        {
+            bytes += (table->mask + 1) * sizeof(uint64_t);
+        }
+        for (size_t chunk = 0; chunk < k_chunkCount && m_chunks[chunk]; ++chunk)
+        {
+            bytes += (size_t(1) << (chunk + k_firstChunkBits)) * sizeof(entry);
+        }
+        return bytes;
+    }
+
+private:
+    static size_t chunk_of(symbol id, size_t& o_offset)
+    {
+        const uint64_t position = uint64_t(id) + (uint64_t(1) << k_firstChunkBits);
+        const size_t chunk = std::bit_width(position) - 1 - k_firstChunkBits;
+        o_offset = static_cast<size_t>(position - (uint64_t(1) << (chunk + k_firstChunkBits)));
+        return chunk;
+    }
+
+    entry& entry_at(symbol id) const
+    {
+        size_t offset;
+        const size_t chunk = chunk_of(id, offset);
+        return m_directory[chunk].load(std::memory_order_acquire)[offset];
+    }
+
+    bool ensure_chunk(symbol id)
+    {
+        size_t offset;
+        const size_t chunk = chunk_of(id, offset);
+        if (!m_chunks[chunk])
+        {
+            m_chunks[chunk].reset(new (std::nothrow) entry[size_t(1) << (chunk + k_firstChunkBits)]);
+            if (!m_chunks[chunk])
+            {
+                std::cerr << "string_interner: symbol entries allocation failed" << std::endl;
+                return false;
+            }
+            m_directory[chunk].store(m_chunks[chunk].get(), std::memory_order_release);
+        }
+        return true;
+    }
+
+    static void place(index& table, uint64_t slot, uint64_t hash, std::memory_order order)
+    {
+        size_t bucket = hash & table.mask;
+        while (table.slots[bucket].load(std::memory_order_relaxed) != 0)
+        {
+            bucket = (bucket + 1) & table.mask;
+        }
+        table.slots[bucket].store(slot, order);
+    }
+
+    // rehash symbols [0, count) from their stored hashes into an index twice as big, called with the mutex held
+    index* grow(const index& current, symbol count)
+    {
+        auto table = std::make_unique<index>(2 * (current.mask + 1));
+        for (symbol id = 0; id < count; ++id)
+        {
+            const uint64_t hash = entry_at(id).hash;
+            place(*table, make_slot(hash, id), hash, std::memory_order_relaxed);
+        }
+        m_indices.push_back(std::move(table));
+        m_index.store(m_indices.back().get(), std::memory_order_release);
+        return m_indices.back().get();
+    }
+
+    std::unique_ptr<char[]> m_bytes;
+    linear_allocator<alignof(uint32_t)> m_arena; // over m_bytes, used with the mutex held
+    mutable std::mutex m_mutex;
+    std::atomic<index*> m_index{nullptr};
+    std::vector<std::unique_ptr<index>> m_indices; // the current one last, the others kept for readers still probing
+    std::array<std::atomic<entry*>, k_chunkCount> m_directory{};
+    std::array<std::unique_ptr<entry[]>, k_chunkCount> m_chunks;
+    std::atomic<symbol> m_size{0};
+};
@@ -0,0 +1,634 @@
+/*
+Lazy coroutine task: nothing runs until the task is awaited (or sync_wait'ed), the awaiter becomes the continuation
+and is resumed straight from the final suspend point of the task (symmetric transfer), so long chains of awaits
+neither block a thread nor grow the stack.
+
+  coro::task<int> add(int a, int b) { co_return a + b; }
+  coro::task<int> twice(int a) { co_return co_await add(a, a); }
+  int four = coro::sync_wait(twice(2));
+
+gcc only turns the transfer into a tail call with optimizations on, a debug build can overflow the stack on very
+long synchronous chains.
+
+Frames come from the frame_allocator installed on the creating thread (scoped_frame_allocator), by default
+pooled_frame_allocator(): size classes of 64 bytes up to 1KB carved from 64KB chunks, a free list per class and per
+thread, no lock on the fast path. A frame freed on another thread goes to that thread's list, a list grown past two
+batches hands one batch to a shared depot that the allocating threads refill from, so a producer/consumer pair
+doesn't grow the pool forever. Chunks are never returned to the system. Every frame remembers its allocator so it
+can be destroyed on any thread.
+
+frame_stats() counts coroutine invocations (promise constructions) and frame allocations, the difference is what
+the compiler elided by allocating the frame inside the caller (HALO, clang at -O2 when the task doesn't escape,
+gcc never does it). Define CORO_FRAME_STATS_DISABLED to drop the counters.
+
+https://lewissbaker.github.io/2020/05/11/understanding_symmetric_transfer
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace coro
+{
+
+///Frame memory source. The allocator object has to outlive every frame allocated through it.
+struct frame_allocator
+{
+    void* (*allocate)(size_t size, void* context) = nullptr; // nullptr = out of memory
+    void (*deallocate)(void* ptr, size_t size, void* context) = nullptr;
+    void* context = nullptr;
+};
+
+///Process wide counters, differences of two snapshots measure a section of code
+struct frame_statistics
+{
+    uint64_t invocations = 0; // promises constructed
+    uint64_t allocations = 0; // frames allocated through operator new of the promise
+    uint64_t pooled = 0; // allocations served by pooled_frame_allocator
+
+    ///Frames the compiler placed in the caller's frame
+    uint64_t elided() const { return invocations - allocations; }
+
+    frame_statistics operator-(const frame_statistics& other) const
+    {
+        return {invocations - other.invocations, allocations - other.allocations, pooled - other.pooled};
+    }
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(CORO_FRAME_STATS_DISABLED)
+constexpr bool k_frameStats = false;
+#else
+constexpr bool k_frameStats = true;
+#endif
+
+///Written by its thread only (relaxed load + store, no locked instruction), read by frame_stats()
+struct frame_counters
+{
+    std::atomic<uint64_t> invocations{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> pooled{0};
+
+    static void add(std::atomic<uint64_t>& counter)
+    {
+        if constexpr (k_frameStats)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+};
+
+///Counters of every thread that ever ran a coroutine, kept after the thread exits so the totals don't go back
+class frame_counters_registry
+{
+public:
+    static frame_counters_registry& instance()
+    {
+        static frame_counters_registry* s_registry = new frame_counters_registry(); // outlives detached threads
+        return *s_registry;
+    }
+
+    frame_counters& local()
+    {
+        static thread_local frame_counters* s_counters = create();
+        return *s_counters;
+    }
+
+    frame_statistics total()
+    {
+        frame_statistics stats;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const frame_counters* counters : m_counters)
+        {
+            stats.invocations += counters->invocations.load(std::memory_order_relaxed);
+            stats.allocations += counters->allocations.load(std::memory_order_relaxed);
+            stats.pooled += counters->pooled.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+private:
+    frame_counters* create()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_counters.push_back(new frame_counters());
+        return m_counters.back();
+    }
+
+    std::mutex m_mutex;
+    std::vector<frame_counters*> m_counters;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr size_t k_frameClassSize = 64;
+constexpr size_t k_frameClassCount = 16; // frames up to 1KB, bigger ones go to operator new
+constexpr size_t k_frameChunkSize = size_t(64) << 10;
+constexpr size_t k_frameBatch = 64; // blocks moved at once between a thread and the depot
+
+struct frame_block
+{
+    frame_block* next;
+};
+
+///Batches of free blocks given back by the threads that free more frames than they allocate
+class frame_depot
+{
+public:
+    static frame_depot& instance()
+    {
+        static frame_depot* s_depot = new frame_depot(); // chunks stay valid for detached threads at exit
+        return *s_depot;
+    }
+
+    void push(size_t sizeClass, frame_block* batch)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_batches[sizeClass].push_back(batch);
+    }
+
+    frame_block* pop(size_t sizeClass)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_batches[sizeClass].empty())
+        {
+            return nullptr;
+        }
+        frame_block* batch = m_batches[sizeClass].back();
+        m_batches[sizeClass].pop_back();
+        return batch;
+    }
+
+    char* new_chunk()
+    {
+        char* chunk = static_cast<char*>(std::aligned_alloc(k_frameClassSize, k_frameChunkSize));
+        if (chunk != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_chunks.push_back(chunk);
+        }
+        return chunk;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<frame_block*> m_batches[k_frameClassCount];
+    std::vector<char*> m_chunks; // never freed, blocks migrate between threads
+};
+
+class frame_pool
+{
+public:
+    static frame_pool& local()
+    {
+        static thread_local frame_pool s_pool;
+        return s_pool;
+    }
+
+    static constexpr bool is_pooled(size_t size) { return size <= k_frameClassSize * k_frameClassCount; }
+
+    void* allocate(size_t size)
+    {
+        const size_t sizeClass = (size - 1) / k_frameClassSize;
+        if (m_free[sizeClass] == nullptr)
+        {
+            m_free[sizeClass] = frame_depot::instance().pop(sizeClass);
+            m_count[sizeClass] = m_free[sizeClass] != nullptr ? k_frameBatch : 0;
+        }
+        if (m_free[sizeClass] != nullptr)
+        {
+            frame_block* block = m_free[sizeClass];
+            m_free[sizeClass] = block->next;
+            --m_count[sizeClass];
+            return block;
+        }
+
+        const size_t blockSize = (sizeClass + 1) * k_frameClassSize;
+        if (m_cursor == nullptr || m_cursor + blockSize > m_chunkEnd)
+        {// the tail of the previous chunk is lost
+            m_cursor = frame_depot::instance().new_chunk();
+            if (m_cursor == nullptr)
+            {
+                return nullptr;
+            }
+            m_chunkEnd = m_cursor + k_frameChunkSize;
+        }
+        void* block = m_cursor;
+        m_cursor += blockSize;
+        return block;
+    }
+
+    void deallocate(void* ptr, size_t size)
+    {
+        const size_t sizeClass = (size - 1) / k_frameClassSize;
+        frame_block* block = static_cast<frame_block*>(ptr);
+        block->next = m_free[sizeClass];
+        m_free[sizeClass] = block;
+        if (++m_count[sizeClass] == 2 * k_frameBatch)
+        {// keep one batch, give the other one away
+            frame_block* last = m_free[sizeClass];
+            for (size_t i = 1; i < k_frameBatch; ++i)
+            {
+                last = last->next;
+            }
+            frame_depot::instance().push(sizeClass, std::exchange(last->next, nullptr));
+            m_count[sizeClass] = k_frameBatch;
+        }
+    }
+
+private:
+    frame_block* m_free[k_frameClassCount] = {};
+    size_t m_count[k_frameClassCount] = {};
+    char* m_cursor = nullptr;
+    char* m_chunkEnd = nullptr;
+};
+
+inline void* global_allocate(size_t size, void*) { return ::operator new(size, std::nothrow); }
+inline void global_deallocate(void* ptr, size_t size, void*) { ::operator delete(ptr, size); }
+
+inline void* pooled_allocate(size_t size, void*)
+{
+    if (frame_pool::is_pooled(size))
+    {
+        void* frame = frame_pool::local().allocate(size);
+        frame_counters::add(frame_counters_registry::instance().local().pooled);
+        return frame;
+    }
+    return ::operator new(size, std::nothrow);
+}
+inline void pooled_deallocate(void* ptr, size_t size, void*)
+{
+    if (frame_pool::is_pooled(size))
+    {
+        frame_pool::local().deallocate(ptr, size);
+    }
+    else
+    {
+        ::operator delete(ptr, size);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Global operator new and delete
+inline const frame_allocator& heap_frame_allocator()
+{
+    static const frame_allocator s_allocator{&detail::global_allocate, &detail::global_deallocate, nullptr};
+    return s_allocator;
+}
+
+///Thread local size class pool, the default
+inline const frame_allocator& pooled_frame_allocator()
+{
+    static const frame_allocator s_allocator{&detail::pooled_allocate, &detail::pooled_deallocate, nullptr};
+    return s_allocator;
+}
+
+///Totals of every thread since the start of the process
+inline frame_statistics frame_stats()
+{
+    return detail::frame_counters_registry::instance().total();
+}
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline const frame_allocator*& current_frame_allocator()
+{
+    static thread_local const frame_allocator* s_allocator = &pooled_frame_allocator();
+    return s_allocator;
+}
+
+///Frames start with a pointer to their allocator, padded to keep the frame at the default new alignment
+constexpr size_t k_frameHeaderSize = __STDCPP_DEFAULT_NEW_ALIGNMENT__ > sizeof(void*) ? __STDCPP_DEFAULT_NEW_ALIGNMENT__ : sizeof(void*);
+
+inline void* allocate_frame(size_t size)
+{
+    const frame_allocator* allocator = current_frame_allocator();
+    void* block = allocator->allocate(size + k_frameHeaderSize, allocator->context);
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    *static_cast<const frame_allocator**>(block) = allocator;
+    frame_counters::add(frame_counters_registry::instance().local().allocations);
+    return static_cast<char*>(block) + k_frameHeaderSize;
+}
+
+inline void deallocate_frame(void* frame, size_t size)
+{
+    void* block = static_cast<char*>(frame) - k_frameHeaderSize;
+    const frame_allocator* allocator = *static_cast<const frame_allocator**>(block);
+    allocator->deallocate(block, size + k_frameHeaderSize, allocator->context);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Frames of the coroutines called by this thread come from i_allocator while in scope
+class scoped_frame_allocator
+{
+public:
+    explicit scoped_frame_allocator(const frame_allocator& i_allocator)
+        : m_previous(detail::current_frame_allocator())
+    {
+        detail::current_frame_allocator() = &i_allocator;
+    }
+    ~scoped_frame_allocator()
+    {
+        detail::current_frame_allocator() = m_previous;
+    }
+    scoped_frame_allocator(const scoped_frame_allocator&) = delete;
+    scoped_frame_allocator& operator=(const scoped_frame_allocator&) = delete;
+
+private:
+    const frame_allocator* m_previous;
+};
+
+///Base of the promises of this module, frames go through the frame_allocator hook. The constructor runs for every
+///invocation, elided frame or not.
+class promise_allocation
+{
+public:
+    promise_allocation() { detail::frame_counters::add(detail::frame_counters_registry::instance().local().invocations); }
+
+    static void* operator new(size_t size) { return detail::allocate_frame(size); }
+    static void operator delete(void* ptr, size_t size) { detail::deallocate_frame(ptr, size); }
+};
+
+template<typename T = void>
+class task;
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class task_promise_base : public promise_allocation
+{
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            const std::coroutine_handle<> continuation = handle.promise().m_continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+public:
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+
+    void set_continuation(std::coroutine_handle<> continuation) { m_continuation = continuation; }
+
+protected:
+    void rethrow_if_failed() const
+    {
+        if (m_exception)
+        {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+private:
+    std::coroutine_handle<> m_continuation;
+    std::exception_ptr m_exception;
+};
+
+template<typename T>
+class task_promise : public task_promise_base
+{
+public:
+    task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& value) { m_value.emplace(std::forward<U>(value)); }
+
+    T result()
+    {
+        rethrow_if_failed();
+        return std::move(*m_value);
+    }
+
+private:
+    std::optional<T> m_value;
+};
+
+template<>
+class task_promise<void> : public task_promise_base
+{
+public:
+    task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() { rethrow_if_failed(); }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+template<typename T>
+class task
+{
+    static_assert(!std::is_reference<T>::value, "return a pointer or a std::reference_wrapper");
+
+public:
+    using promise_type = detail::task_promise<T>;
+    using value_type = T;
+
+    task() = default;
+    explicit task(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {}
+    task(task&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {}
+    task& operator=(task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    ~task() { destroy(); }
+
+    bool is_valid() const { return static_cast<bool>(m_handle); }
+    bool is_ready() const { return !m_handle || m_handle.done(); }
+
+    ///Starts the task, the awaiting coroutine resumes when it completes. Returns the value (or rethrows).
+    auto operator co_await() noexcept
+    {
+        struct awaiter : awaiter_base
+        {
+            T await_resume() { return this->m_handle.promise().result(); }
+        };
+        return awaiter{{m_handle}};
+    }
+
+    ///Same without fetching the result, it stays in the task
+    auto when_ready() noexcept
+    {
+        struct awaiter : awaiter_base
+        {
+            void await_resume() noexcept {}
+        };
+        return awaiter{{m_handle}};
+    }
+
+    ///Result of a completed task
+    T result() { return m_handle.promise().result(); }
+
+private:
+    struct awaiter_base
+    {
+        std::coroutine_handle<promise_type> m_handle;
+
+        bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            m_handle.promise().set_continuation(awaiting);
+            return m_handle;
+        }
+    };
+
+    void destroy()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+task<T> task_promise<T>::get_return_object() noexcept
+{
+    return task<T>(std::coroutine_handle<task_promise>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+    return task<void>(std::coroutine_handle<task_promise>::from_promise(*this));
+}
+
+///set() may be the last thing the completing thread does with the event, the waiter owns it: notifying under the
+///lock keeps the waiter from destroying it in between
+class sync_event
+{
+public:
+    void set()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isSet = true;
+        m_condition.notify_all();
+    }
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() { return m_isSet; });
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_isSet = false;
+};
+
+///Top level coroutine of sync_wait, signals the event from its final suspend point and is destroyed by the waiter
+class sync_wait_task
+{
+public:
+    struct promise_type : promise_allocation
+    {
+        struct final_awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept { handle.promise().m_event->set(); }
+            void await_resume() noexcept {}
+        };
+
+        sync_wait_task get_return_object() noexcept { return sync_wait_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); } // the awaited task keeps its own exceptions
+
+        sync_event* m_event = nullptr;
+    };
+
+    explicit sync_wait_task(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {}
+    sync_wait_task(const sync_wait_task&) = delete;
+    sync_wait_task& operator=(const sync_wait_task&) = delete;
+    ~sync_wait_task() { m_handle.destroy(); }
+
+    void run()
+    {
+        sync_event event;
+        m_handle.promise().m_event = &event;
+        m_handle.resume();
+        event.wait();
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template<typename Task>
+sync_wait_task make_sync_wait_task(Task& awaited)
+{
+    co_await awaited.when_ready();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///Runs the task to completion, blocking the calling thread if it completes elsewhere (an executor), and returns its
+///result or rethrows its exception
+template<typename T>
+T sync_wait(task<T>&& awaited)
+{
+    detail::make_sync_wait_task(awaited).run();
+    return awaited.result();
+}
+
+template<typename T>
+T sync_wait(task<T>& awaited)
+{
+    return sync_wait(std::move(awaited));
+}
+
+}//coro
@@ -1,6 +1,338 @@
 #include "memory_allocators.h"
+#include "arena_snapshot.h"
+#include "flat_hash_map.h"
+#include "string_interner.h"
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) if (!(cond)) { std::cerr << __FILE__ << ":" << __LINE__ << " CHECK(" #cond ") failed" << std::endl; return false; }
+
+bool test_factory_handles()
+{
+    Factory<std::string> factory;
+    const FactoryHandle a = factory.Create("a");
+    const FactoryHandle b = factory.Create("b");
+    const FactoryHandle c = factory.Create("c");
+    CHECK(factory.Size() == 3);
+    CHECK(FactoryHandle().IsNull());
+
+    CHECK(factory.Destroy(a));
+    CHECK(factory.Get(a) == nullptr);   // use-after-free is caught
+    CHECK(!factory.Destroy(a));         // double free is caught
+    CHECK(*factory.Get(b) == "b");      // swap-and-pop keeps the other handles valid
+    CHECK(*factory.Get(c) == "c");
+
+    const FactoryHandle d = factory.Create("d"); // reuses a's slot with a new generation
+    CHECK(d.GetIndex() == a.GetIndex());
+    CHECK(d != a);
+    CHECK(factory.Get(a) == nullptr);
+    CHECK(*factory.Get(d) == "d");
+
+    size_t visited = 0;
+    for (const std::string& value : factory)
+    {
+        visited += value.size();
+    }
+    CHECK(visited == 3);
+
+    factory.Clear();
+    CHECK(factory.Empty());
+    CHECK(factory.Get(b) == nullptr);
+
+    // a constructor that throws leaves the factory as it was
+    struct throwing
+    {
+        explicit throwing(bool fail) { if (fail) { throw 42; } }
+    };
+    Factory<throwing> throwingFactory;
+    const FactoryHandle first = throwingFactory.Create(false);
+    bool thrown = false;
+    try
+    {
+        throwingFactory.Create(true);
+    }
+    catch (int)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(throwingFactory.Size() == 1);
+    CHECK(throwingFactory.Get(first) != nullptr);
+    const FactoryHandle second = throwingFactory.Create(false);
+    CHECK(second.GetIndex() != first.GetIndex());
+    CHECK(throwingFactory.Destroy(second) && throwingFactory.Destroy(first));
+    CHECK(throwingFactory.Empty());
+
+    return true;
+}
+
+bool test_arena_concurrent()
+{
+    constexpr size_t k_threads = 4;
+    constexpr size_t k_allocsPerThread = 1000;
+    arena_concurrent<16> arena(k_threads * k_allocsPerThread * 64, 1024);
+
+    std::vector<std::vector<uint32_t*>> allocs(k_threads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < k_threads; ++t)
+    {
+        threads.emplace_back([&arena, &allocs, t]() {
+            for (size_t i = 0; i < k_allocsPerThread; ++i)
+            {
+                uint32_t* p = arena.allocate_array<uint32_t>(4);
+                if (p != nullptr)
+                {
+                    std::fill(p, p + 4, uint32_t(t));
+                }
+                allocs[t].push_back(p);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t t = 0; t < k_threads; ++t)
+    {
+        for (uint32_t* p : allocs[t])
+        {
+            CHECK(p != nullptr);
+            CHECK(reinterpret_cast<uintptr_t>(p) % 16 == 0);
+            CHECK(p[0] == t && p[3] == t); // nobody else wrote over it
+        }
+    }
+
+    arena.reset();
+    CHECK(arena.used() == 0);
+    CHECK(arena.allocate(16) != nullptr);
+
+    return true;
+}
+
+bool test_arena_concurrent_interleaved()
+{
+    // one thread alternating between two arenas keeps a chunk in each, nothing is thrown away
+    constexpr size_t k_chunkSize = 1024;
+    arena_concurrent<16> first(64 * k_chunkSize, k_chunkSize);
+    arena_concurrent<16> second(64 * k_chunkSize, k_chunkSize);
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        CHECK(first.allocate(16) != nullptr);
+        CHECK(second.allocate(16) != nullptr);
+    }
+    CHECK(first.used() <= 1000 * 16 + k_chunkSize);
+    CHECK(second.used() <= 1000 * 16 + k_chunkSize);
+
+    // a request that doesn't fit leaves the space to the ones that do
+    arena_concurrent<16> arena(size_t(1) << 20);
+    CHECK(arena.allocate(100) != nullptr);
+    CHECK(arena.allocate(size_t(4) << 20) == nullptr);
+    CHECK(arena.allocate(size_t(128) << 10) != nullptr);
+    CHECK(arena.used() < (size_t(1) << 20));
+
+    return true;
+}
+
+bool test_flat_hash_map_allocator()
+{
+    using map_t = flat_hash_map<uint32_t, uint32_t, flat_hash<uint32_t>, LinearAllocator<std::pair<uint32_t, uint32_t>>>;
+    std::vector<char> buffer(64 * 1024);
+    LinearAllocator<map_t::slot_type> allocator(buffer.data(), buffer.size());
+    {
+        map_t map(allocator);
+        for (uint32_t key = 0; key < 1000; ++key)
+        {
+            map[key] = key * 2;
+        }
+        for (uint32_t key = 0; key < 1000; key += 2)
+        {
+            CHECK(map.erase(key));
+        }
+        CHECK(!map.erase(0));
+        CHECK(map.size() == 500);
+        CHECK(map.find(0) == nullptr);
+        CHECK(map.find(999) != nullptr && *map.find(999) == 1998);
+
+        uint32_t key = 1000;
+        while (map.try_emplace(key, key).first != nullptr)
+        {
+            ++key;
+        }
+        CHECK(map.size() == 500 + (key - 1000)); // the failed insert left the map as it was
+        CHECK(*map.find(999) == 1998);
+
+        size_t visited = 0;
+        for (const auto& [slotKey, value] : map)
+        {
+            visited += slotKey * 2 == value || slotKey >= 1000;
+        }
+        CHECK(visited == map.size());
+    }
+
+    // values taken from the map itself while the insert grows it
+    flat_hash_map<std::string, std::string> strings;
+    strings.try_emplace("seed", std::string(100, 's'));
+    for (int i = 0; i < 200; ++i)
+    {
+        const std::string& seed = *strings.find("seed");
+        CHECK(strings.try_emplace(std::to_string(i), seed).second);
+    }
+    for (int i = 0; i < 200; ++i)
+    {
+        CHECK(*strings.find(std::to_string(i)) == std::string(100, 's'));
+    }
+    return true;
+}
+
+bool test_allocator_composition()
+{
+    fallback<arena_naive<1024, 16>, mallocator> spilling;
+    std::vector<char*> blocks;
+    for (int i = 0; i < 100; ++i)
+    {
+        blocks.push_back(spilling.allocate(16));
+        CHECK(blocks.back() != nullptr);
+    }
+    CHECK(spilling.primary().owns(blocks.front()));
+    CHECK(!spilling.primary().owns(blocks.back())); // the arena filled up, the rest came from malloc
+    for (size_t i = blocks.size(); i-- > 0;)
+    {
+        spilling.deallocate(blocks[i], 16);
+    }
+    char* grown = spilling.allocate(16);
+    CHECK(spilling.expand(grown, 16, 256));
+    spilling.deallocate(grown, 256);
+
+    segregator<256, free_list<mallocator, 256>, fallback<arena_reusing<4096, 16>, mallocator>> routed;
+    char* small = routed.allocate(100);
+    routed.deallocate(small, 100);
+    CHECK(routed.allocate(200) == small); // recycled by the free list
+    routed.deallocate(small, 200);
+    char* large = routed.allocate(1000);
+    CHECK(routed.large().primary().owns(large));
+    routed.deallocate(large, 1000);
+
+    std::vector<char> buffer(4096);
+    linear_allocator<> linear(buffer.data(), buffer.size());
+    {
+        std::vector<int, typed_allocator<int, linear_allocator<>>> values{typed_allocator<int, linear_allocator<>>(linear)};
+        values.reserve(100);
+        for (int i = 0; i < 100; ++i)
+        {
+            values.push_back(i);
+        }
+        CHECK(linear.owns(reinterpret_cast<const char*>(values.data())));
+    }
+    CHECK(linear.used() == 0); // the only allocation was the last one, freed in place
+    return true;
+}
+
+struct snapshot_node
+{
+    int value = 0;
+    offset_ptr<snapshot_node> next;
+};
+
+struct snapshot_root
+{
+    offset_array<snapshot_node> nodes;
+    offset_ptr<snapshot_node> head;
+};
+
+bool test_arena_snapshot()
+{
+    static_assert(Allocator<relocatable_arena>);
+    const std::string path = (std::filesystem::temp_directory_path() / "test_arena_snapshot.arena").string();
+    {
+        relocatable_arena arena(1 << 20);
+        snapshot_root* root = arena.create<snapshot_root>();
+        CHECK(root != nullptr);
+        root->nodes = arena.create_array<snapshot_node>(10);
+        CHECK(root->nodes.size() == 10);
+        for (size_t i = 0; i < root->nodes.size(); ++i)
+        {
+            root->nodes[i].value = int(i);
+            root->nodes[i].next = i + 1 < root->nodes.size() ? &root->nodes[i + 1] : nullptr;
+        }
+        root->head = &root->nodes[0];
+        CHECK(arena.save(path, root, 3));
+    }
+
+    arena_snapshot snapshot;
+    CHECK(!snapshot.open(path, 4)); // other version
+    CHECK(snapshot.open(path, 3));
+    CHECK(snapshot.root<snapshot_node>() == nullptr);
+    const snapshot_root* root = snapshot.root<snapshot_root>();
+    CHECK(root != nullptr);
+    int expected = 0;
+    for (const snapshot_node* node = root->head.get(); node != nullptr; node = node->next.get())
+    {
+        CHECK(node->value == expected++);
+    }
+    CHECK(expected == 10);
+    CHECK(root->nodes.end()[-1].value == 9);
+    snapshot.close();
+    std::filesystem::remove(path);
+    return true;
+}
+
+bool test_string_interner()
+{
+    string_interner names(1 << 20, 4);
+    const string_interner::symbol hello = names.intern("hello");
+    CHECK(hello == 0);
+    CHECK(names.intern("world") == 1);
+    CHECK(names.intern(std::string("hello")) == hello);
+    CHECK(names.find("nope") == string_interner::k_noSymbol);
+    CHECK(names.intern("") == 2);
+    CHECK(names.view(2).empty());
+    const char* helloText = names.c_str(hello);
+
+    // four threads interning overlapping ranges grow the index while the others look up
+    constexpr int k_count = 5000;
+    std::vector<std::vector<string_interner::symbol>> seen(4, std::vector<string_interner::symbol>(k_count));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < k_count; ++i)
+            {
+                const int value = (t % 2 == 0) ? i : k_count - 1 - i;
+                seen[t][value] = names.intern("token " + std::to_string(value));
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK(names.size() == k_count + 3);
+    for (int i = 0; i < k_count; ++i)
+    {
+        const std::string text = "token " + std::to_string(i);
+        CHECK(seen[0][i] == seen[1][i] && seen[0][i] == seen[2][i] && seen[0][i] == seen[3][i]);
+        CHECK(names.view(seen[0][i]) == text);
+        CHECK(names.find(text) == seen[0][i]);
+    }
+    CHECK(names.c_str(hello) == helloText); // strings never move
+    CHECK(names.view(hello) == "hello");
+    return true;
+}
 
 int main(int argc, char** argv)
 {
-  return 0;
+  bool isOk = true;
+  isOk &= test_factory_handles();
+  isOk &= test_arena_concurrent();
+  isOk &= test_arena_concurrent_interleaved();
+  isOk &= test_flat_hash_map_allocator();
+  isOk &= test_allocator_composition();
+  isOk &= test_arena_snapshot();
+  isOk &= test_string_interner();
+  return isOk ? 0 : 1;
 }
@@ -0,0 +1,371 @@
+#include "thread_pool.h"
+#include "parallel_algorithms.h"
+#include "parallel_sort.h"
+#include "simd_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) if (!(cond)) { std::cerr << __FILE__ << ":" << __LINE__ << " CHECK(" #cond ") failed" << std::endl; return false; }
+
+// odd sizes on purpose: empty, single element, partial last chunks, more than the automatic grain
+const size_t k_sizes[] = {0, 1, 2, 7, 33, 1001, 4097, 100003};
+
+std::vector<int32_t> random_ints(size_t count, int32_t low, int32_t high, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int32_t> distribution(low, high);
+    std::vector<int32_t> values(count);
+    for (int32_t& value : values)
+    {
+        value = distribution(random);
+    }
+    return values;
+}
+
+// grain 1 makes a task per element, keep it to the smaller sizes
+std::vector<size_t> grains_for(size_t count)
+{
+    return count <= 4097 ? std::vector<size_t>{0, 1, 3} : std::vector<size_t>{0, 3, 1000};
+}
+
+bool test_chase_lev_deque()
+{
+    chase_lev_deque<int> deque(4);
+    int value = -1;
+    CHECK(deque.empty());
+    CHECK(!deque.pop(value));
+    CHECK(!deque.steal(value));
+
+    for (int i = 0; i < 100; ++i) // grows past the initial capacity
+    {
+        deque.push(i);
+    }
+    CHECK(deque.steal(value) && value == 0);  // thieves take the oldest
+    CHECK(deque.pop(value) && value == 99);   // the owner the newest
+    for (int expected = 98; expected > 0; --expected)
+    {
+        CHECK(deque.pop(value) && value == expected);
+    }
+    CHECK(!deque.pop(value));
+    CHECK(deque.empty());
+
+    // the owner pushes and pops while thieves steal, every value comes out exactly once
+    constexpr int k_count = 200000;
+    constexpr size_t k_thieves = 3;
+    chase_lev_deque<int> shared(16);
+    std::vector<std::atomic<int>> seen(k_count);
+    std::atomic<bool> isDone{false};
+    std::vector<std::thread> thieves;
+    for (size_t t = 0; t < k_thieves; ++t)
+    {
+        thieves.emplace_back([&shared, &seen, &isDone]() {
+            int stolen;
+            while (!isDone.load(std::memory_order_acquire) || !shared.empty())
+            {
+                if (shared.steal(stolen))
+                {
+                    seen[stolen].fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (int i = 0; i < k_count; ++i)
+    {
+        shared.push(i);
+        if (i % 3 == 0 && shared.pop(value))
+        {
+            seen[value].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    while (shared.pop(value))
+    {
+        seen[value].fetch_add(1, std::memory_order_relaxed);
+    }
+    isDone.store(true, std::memory_order_release);
+    for (std::thread& thief : thieves)
+    {
+        thief.join();
+    }
+    for (int i = 0; i < k_count; ++i)
+    {
+        CHECK(seen[i].load() == 1);
+    }
+
+    return true;
+}
+
+bool test_work_stealing_pool()
+{
+    for (size_t threadCount : {size_t(1), size_t(4)})
+    {
+        work_stealing_pool pool(threadCount);
+        CHECK(pool.thread_count() == threadCount);
+        CHECK(pool.current_worker() == -1);
+
+        for (size_t count : k_sizes)
+        {
+            for (size_t grain : grains_for(count))
+            {
+                const size_t chunkSize = parallel::chunk_size(pool, count, grain);
+                std::vector<std::atomic<int>> visits(count);
+                std::vector<std::atomic<int>> chunkVisits(parallel::chunk_count(count, chunkSize));
+                parallel::for_each_chunk(pool, count, chunkSize, [&](size_t chunk, size_t begin, size_t end) {
+                    chunkVisits[chunk].fetch_add(1, std::memory_order_relaxed);
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        visits[i].fetch_add(1, std::memory_order_relaxed);
+                    }
+                });
+                CHECK(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int>& v) { return v.load() == 1; }));
+                CHECK(std::all_of(chunkVisits.begin(), chunkVisits.end(), [](const std::atomic<int>& v) { return v.load() == 1; }));
+            }
+        }
+
+        // chunks submitting chunks of their own, from worker threads
+        std::atomic<size_t> total{0};
+        parallel::for_each_chunk(pool, 64, 1, [&pool, &total](size_t, size_t, size_t) {
+            parallel::for_each_chunk(pool, 100, 7, [&total](size_t, size_t begin, size_t end) {
+                total.fetch_add(end - begin, std::memory_order_relaxed);
+            });
+        });
+        CHECK(total.load() == 6400);
+    }
+
+    return true;
+}
+
+bool test_parallel_algorithms()
+{
+    work_stealing_pool pool(4);
+    for (size_t count : k_sizes)
+    {
+        const std::vector<int32_t> input = random_ints(count, -1000, 1000, uint32_t(count));
+        for (size_t grain : grains_for(count))
+        {
+            std::vector<int64_t> expected(count);
+            std::vector<int64_t> output(count);
+            const auto twice = [](int32_t v) { return int64_t(v) * 2; };
+
+            std::transform(input.begin(), input.end(), expected.begin(), twice);
+            parallel::transform(pool, input.begin(), input.end(), output.begin(), twice, grain);
+            CHECK(output == expected);
+
+            const int64_t sum = std::accumulate(input.begin(), input.end(), int64_t(5));
+            CHECK(parallel::reduce(pool, input.begin(), input.end(), int64_t(5), std::plus<>(), grain) == sum);
+            CHECK(parallel::transform_reduce(pool, input.begin(), input.end(), int64_t(5), std::plus<>(), twice, grain) == 2 * sum - 5);
+
+            std::vector<int64_t> wide(input.begin(), input.end());
+            std::inclusive_scan(wide.begin(), wide.end(), expected.begin());
+            parallel::inclusive_scan(pool, wide.begin(), wide.end(), output.begin(), std::plus<>(), grain);
+            CHECK(output == expected);
+
+            std::exclusive_scan(wide.begin(), wide.end(), expected.begin(), int64_t(5));
+            parallel::exclusive_scan(pool, wide.begin(), wide.end(), output.begin(), int64_t(5), std::plus<>(), grain);
+            CHECK(output == expected);
+
+            std::adjacent_difference(wide.begin(), wide.end(), expected.begin());
+            parallel::adjacent_difference(pool, wide.begin(), wide.end(), output.begin(), std::minus<>(), grain);
+            CHECK(output == expected);
+            std::vector<int64_t> inPlace = wide;
+            parallel::adjacent_difference(pool, inPlace.begin(), inPlace.end(), inPlace.begin(), std::minus<>(), grain);
+            CHECK(inPlace == expected);
+
+            const auto isEven = [](int32_t v) { return v % 2 == 0; };
+            std::vector<int32_t> kept;
+            std::copy_if(input.begin(), input.end(), std::back_inserter(kept), isEven);
+            std::vector<int32_t> compacted(count);
+            const auto compactedEnd = parallel::copy_if(pool, input.begin(), input.end(), compacted.begin(), isEven, grain);
+            CHECK(size_t(compactedEnd - compacted.begin()) == kept.size());
+            CHECK(std::equal(kept.begin(), kept.end(), compacted.begin()));
+        }
+    }
+
+    return true;
+}
+
+bool test_simd_scans()
+{
+    work_stealing_pool pool(4);
+    for (simd::isa isa : {simd::isa::scalar, simd::isa::avx2, simd::isa::avx512})
+    {
+        simd::set_isa(isa); // clamped to what the host has, the higher ones then rerun the best available
+        for (size_t count : k_sizes)
+        {
+            const std::vector<int32_t> input = random_ints(count, -1000, 1000, uint32_t(count) + 7);
+            // small integers are exact in float whatever the association, the float results can be compared exactly
+            const std::vector<float> floats(input.begin(), input.end());
+            std::vector<int32_t> expected(count);
+            std::vector<int32_t> output(count);
+            std::vector<float> expectedFloats(count);
+            std::vector<float> outputFloats(count);
+
+            std::inclusive_scan(input.begin(), input.end(), expected.begin(), std::plus<>(), int32_t(3));
+            CHECK(simd::inclusive_scan(input.data(), count, output.data(), 3) == (count == 0 ? 3 : expected.back()));
+            CHECK(output == expected);
+            std::exclusive_scan(input.begin(), input.end(), expected.begin(), int32_t(3));
+            simd::exclusive_scan(input.data(), count, output.data(), 3);
+            CHECK(output == expected);
+            std::adjacent_difference(input.begin(), input.end(), expected.begin());
+            simd::adjacent_difference(input.data(), count, output.data());
+            CHECK(output == expected);
+            std::vector<int32_t> inPlace = input;
+            simd::adjacent_difference(inPlace.data(), count, inPlace.data());
+            CHECK(inPlace == expected);
+
+            for (size_t grain : grains_for(count))
+            {
+                std::inclusive_scan(input.begin(), input.end(), expected.begin(), std::plus<>(), int32_t(3));
+                simd::inclusive_scan(pool, input.data(), count, output.data(), 3, grain);
+                CHECK(output == expected);
+                inPlace = input;
+                simd::inclusive_scan(pool, inPlace.data(), count, inPlace.data(), 3, grain);
+                CHECK(inPlace == expected);
+
+                std::exclusive_scan(input.begin(), input.end(), expected.begin(), int32_t(3));
+                simd::exclusive_scan(pool, input.data(), count, output.data(), 3, grain);
+                CHECK(output == expected);
+
+                std::adjacent_difference(input.begin(), input.end(), expected.begin());
+                simd::adjacent_difference(pool, input.data(), count, output.data(), grain);
+                CHECK(output == expected);
+                inPlace = input;
+                simd::adjacent_difference(pool, inPlace.data(), count, inPlace.data(), grain);
+                CHECK(inPlace == expected);
+
+                std::inclusive_scan(floats.begin(), floats.end(), expectedFloats.begin(), std::plus<>(), 0.5f);
+                simd::inclusive_scan(pool, floats.data(), count, outputFloats.data(), 0.5f, grain);
+                CHECK(outputFloats == expectedFloats);
+                std::exclusive_scan(floats.begin(), floats.end(), expectedFloats.begin(), 0.5f);
+                simd::exclusive_scan(pool, floats.data(), count, outputFloats.data(), 0.5f, grain);
+                CHECK(outputFloats == expectedFloats);
+                std::adjacent_difference(floats.begin(), floats.end(), expectedFloats.begin());
+                std::vector<float> inPlaceFloats = floats;
+                simd::adjacent_difference(pool, inPlaceFloats.data(), count, inPlaceFloats.data(), grain);
+                CHECK(inPlaceFloats == expectedFloats);
+            }
+        }
+    }
+    simd::set_isa(simd::detected_isa());
+
+    // int32 wraps like the sequential loop
+    const int32_t large[] = {std::numeric_limits<int32_t>::max(), 1, 1};
+    int32_t wrapped[3];
+    simd::inclusive_scan(large, 3, wrapped);
+    CHECK(wrapped[1] == std::numeric_limits<int32_t>::min() && wrapped[2] == std::numeric_limits<int32_t>::min() + 1);
+
+    return true;
+}
+
+bool test_radix_sort()
+{
+    work_stealing_pool pool(4);
+    for (size_t count : k_sizes)
+    {
+        for (size_t grain : grains_for(count))
+        {
+            std::vector<int32_t> ints = random_ints(count, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max(), uint32_t(count) + 11);
+            std::vector<int32_t> expected = ints;
+            std::sort(expected.begin(), expected.end());
+            parallel::radix_sort(pool, ints.data(), count, grain);
+            CHECK(ints == expected);
+
+            std::vector<uint64_t> wide(count);
+            std::mt19937_64 random(count);
+            for (uint64_t& value : wide)
+            {
+                value = random() >> (value % 3 * 20); // mixes short and long keys
+            }
+            std::vector<uint64_t> expectedWide = wide;
+            std::sort(expectedWide.begin(), expectedWide.end());
+            parallel::radix_sort(pool, wide.data(), count, grain);
+            CHECK(wide == expectedWide);
+
+            // equal keys keep their input order
+            std::vector<int32_t> keys = random_ints(count, -5, 5, uint32_t(count) + 13);
+            std::vector<uint32_t> positions(count);
+            std::iota(positions.begin(), positions.end(), 0u);
+            std::vector<std::pair<int32_t, uint32_t>> pairs(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                pairs[i] = {keys[i], positions[i]};
+            }
+            std::stable_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            parallel::radix_sort_by_key(pool, keys.data(), positions.data(), count, grain);
+            for (size_t i = 0; i < count; ++i)
+            {
+                CHECK(keys[i] == pairs[i].first && positions[i] == pairs[i].second);
+            }
+        }
+    }
+
+    // floats: negatives, infinities, denormals and both zeros
+    std::vector<float> floats = {3.5f, -0.f, 0.f, -1.f, std::numeric_limits<float>::infinity(), 0.f, -0.f,
+        -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::denorm_min(), -2.5e-40f, 1e30f, -1e30f, 2.f};
+    for (size_t grain : {size_t(0), size_t(1), size_t(4)})
+    {
+        std::vector<float> sorted = floats;
+        parallel::radix_sort(pool, sorted.data(), sorted.size(), grain);
+        CHECK(std::is_sorted(sorted.begin(), sorted.end()));
+        const auto firstZero = std::find(sorted.begin(), sorted.end(), 0.f);
+        CHECK(firstZero - sorted.begin() == 4);
+        CHECK(std::signbit(firstZero[0]) && std::signbit(firstZero[1])); // -0 before +0
+        CHECK(!std::signbit(firstZero[2]) && !std::signbit(firstZero[3]));
+    }
+    std::vector<double> doubles = {1.0, -0.0, 0.0, -1e300, 1e-310, -3.0};
+    parallel::radix_sort(pool, doubles.data(), doubles.size(), 1);
+    CHECK(std::is_sorted(doubles.begin(), doubles.end()) && std::signbit(doubles[2]) && !std::signbit(doubles[3]));
+
+    return true;
+}
+
+bool test_sample_sort_and_top_k()
+{
+    work_stealing_pool pool(4);
+    for (size_t count : k_sizes)
+    {
+        for (size_t grain : grains_for(count))
+        {
+            // few distinct values so the splitter buckets get used
+            for (int32_t range : {3, 1000000})
+            {
+                std::vector<int32_t> values = random_ints(count, -range, range, uint32_t(count) + uint32_t(range));
+                std::vector<int32_t> expected = values;
+                std::sort(expected.begin(), expected.end(), std::greater<>());
+                std::vector<int32_t> sorted = values;
+                parallel::sample_sort(pool, sorted.begin(), sorted.end(), std::greater<>(), grain);
+                CHECK(sorted == expected);
+
+                for (size_t k : {size_t(0), size_t(1), size_t(10), count, count + 5})
+                {
+                    std::vector<int32_t> best(std::min(k, count));
+                    const auto bestEnd = parallel::top_k(pool, values.begin(), values.end(), k, best.begin(), std::greater<>(), grain);
+                    CHECK(bestEnd == best.end());
+                    CHECK(std::equal(best.begin(), best.end(), expected.begin()));
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+  bool isOk = true;
+  isOk &= test_chase_lev_deque();
+  isOk &= test_work_stealing_pool();
+  isOk &= test_parallel_algorithms();
+  isOk &= test_simd_scans();
+  isOk &= test_radix_sort();
+  isOk &= test_sample_sort_and_top_k();
+  return isOk ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+/*
+Work-stealing scheduler: every worker owns a Chase-Lev deque, pushes/pops at the bottom and other workers steal
+from the top when they run out of work. Threads not belonging to the pool submit through a locked injection queue.
+
+https://www.dre.vanderbilt.edu/~schmidt/PDF/work-stealing-dequeue.pdf
+https://fzn.fr/readings/ppopp13.pdf (C11 memory orderings used below)
+*/
+#pragma once
+
+#include <algorithm> // std::max
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional> // std::hash
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+///Chase-Lev work-stealing deque. push/pop are only called by the owner thread, steal by anyone.
+///T has to be trivially copyable (the pool stores task pointers).
+template<typename T>
+class chase_lev_deque
+{
+    struct ring
+    {
+        explicit ring(int64_t capacity)
+            : m_capacity(capacity)
+            , m_mask(capacity - 1)
+            , m_buffer(new std::atomic<T>[capacity])
+        {}
+
+        T get(int64_t i) const { return m_buffer[i & m_mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T value) { m_buffer[i & m_mask].store(value, std::memory_order_relaxed); }
+
+        ring* grow(int64_t bottom, int64_t top) const
+        {
+            ring* bigger = new ring(m_capacity * 2);
+            for (int64_t i = top; i != bottom; ++i)
+            {
+                bigger->put(i, get(i));
+            }
+            return bigger;
+        }
+
+        int64_t m_capacity;
+        int64_t m_mask;
+        std::unique_ptr<std::atomic<T>[]> m_buffer;
+    };
+
+public:
+    explicit chase_lev_deque(int64_t capacity = 1024)
+        : m_ring(new ring(capacity))
+    {
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+        m_retired.emplace_back(m_ring.load(std::memory_order_relaxed));
+    }
+    chase_lev_deque(const chase_lev_deque&) = delete;
+    chase_lev_deque& operator=(const chase_lev_deque&) = delete;
+
+    void push(T value)
+    {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed);
+        const int64_t t = m_top.load(std::memory_order_acquire);
+        ring* r = m_ring.load(std::memory_order_relaxed);
+        if (b - t > r->m_capacity - 1)
+        {// stealers may still be reading the old ring, keep it alive until the deque dies
+            r = r->grow(b, t);
+            m_retired.emplace_back(r);
+            m_ring.store(r, std::memory_order_release);
+        }
+        r->put(b, value);
+        m_bottom.store(b + 1, std::memory_order_release);
+    }
+
+    bool pop(T& o_value)
+    {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        ring* r = m_ring.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {// empty
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        o_value = r->get(b);
+        if (t == b)
+        {// last element, race against the stealers
+            const bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(T& o_value)
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return false;
+        }
+
+        ring* r = m_ring.load(std::memory_order_acquire);
+        const T value = r->get(t);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        o_value = value;
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+    std::atomic<ring*> m_ring;
+    std::vector<std::unique_ptr<ring>> m_retired;
+};
+
+///Unit of work scheduled on work_stealing_pool. The pool never owns tasks, whoever submits keeps them alive
+///until they ran (parallel algorithms keep them on the caller stack/vector and wait for completion).
+class pool_task
+{
+public:
+    virtual ~pool_task() = default;
+    virtual void execute() = 0;
+};
+
+class work_stealing_pool
+{
+public:
+    ///@param threadCount 0 uses std::thread::hardware_concurrency()
+    ///@param pinThreads pins worker i to cpu i (linux only)
+    explicit work_stealing_pool(size_t threadCount = 0, bool pinThreads = false)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::vector<int> cpus;
+        for (size_t i = 0; pinThreads && i < threadCount; ++i)
+        {
+            cpus.push_back(static_cast<int>(i));
+        }
+        start(threadCount, cpus);
+    }
+    ///One worker pinned to each of cpus (a NUMA node, a set of cores sharing a cache...)
+    explicit work_stealing_pool(const std::vector<int>& cpus)
+    {
+        start(std::max<size_t>(1, cpus.size()), cpus);
+    }
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stop.store(true);
+        }
+        m_sleepCondition.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker->thread.join();
+        }
+    }
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    size_t thread_count() const { return m_workers.size(); }
+
+    ///@return index of the calling worker of this pool, -1 for foreign threads
+    int current_worker() const
+    {
+        const thread_context& context = this_thread_context();
+        return context.pool == this ? context.index : -1;
+    }
+
+    ///Workers push into their own deque (LIFO, cache hot), foreign threads into the shared injection queue
+    void submit(pool_task* task)
+    {
+        const int index = current_worker();
+        if (index >= 0)
+        {
+            m_workers[index]->tasks.push(task);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_injectionMutex);
+            m_injection.push_back(task);
+        }
+        wake_sleepers();
+    }
+
+    ///Runs one pending task on the calling thread, used to help instead of blocking while waiting for results
+    ///@return false if no task could be found
+    bool try_run_one()
+    {
+        pool_task* task = nullptr;
+        const int index = current_worker();
+        if (find_task(index, task))
+        {
+            task->execute();
+            return true;
+        }
+        return false;
+    }
+
+    ///Helps the pool until done() is true
+    template<typename Predicate>
+    void run_until(Predicate done)
+    {
+        unsigned idleSpins = 0;
+        while (!done())
+        {
+            if (try_run_one())
+            {
+                idleSpins = 0;
+            }
+            else if (++idleSpins > 64)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    struct worker
+    {
+        chase_lev_deque<pool_task*> tasks;
+        std::thread thread;
+    };
+
+    struct thread_context
+    {
+        const work_stealing_pool* pool = nullptr;
+        int index = -1;
+    };
+
+    static thread_context& this_thread_context()
+    {
+        static thread_local thread_context s_context;
+        return s_context;
+    }
+
+    void start(size_t threadCount, const std::vector<int>& cpus)
+    {
+        m_workers.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            m_workers.emplace_back(new worker());
+        }
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            m_workers[i]->thread = std::thread([this, i]() { run_worker(i); });
+            if (i < cpus.size())
+            {
+                pin_to_cpu(m_workers[i]->thread, static_cast<size_t>(cpus[i]));
+            }
+        }
+    }
+
+    static void pin_to_cpu(std::thread& thread, size_t cpu)
+    {
+#if defined(__linux__)
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu % CPU_SETSIZE, &cpuSet);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet);
+#else
+        (void)thread;
+        (void)cpu;
+#endif
+    }
+
+    bool pop_injection(pool_task*& o_task)
+    {
+        std::lock_guard<std::mutex> lock(m_injectionMutex);
+        if (m_injection.empty())
+        {
+            return false;
+        }
+        o_task = m_injection.front();
+        m_injection.pop_front();
+        return true;
+    }
+
+    bool find_task(int index, pool_task*& o_task)
+    {
+        if (index >= 0 && m_workers[index]->tasks.pop(o_task))
+        {
+            return true;
+        }
+        if (pop_injection(o_task))
+        {
+            return true;
+        }
+
+        // start stealing from a different victim each time so thieves don't gang up on worker 0
+        const size_t count = m_workers.size();
+        const size_t first = next_victim();
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t victim = (first + i) % count;
+            if (static_cast<int>(victim) != index && m_workers[victim]->tasks.steal(o_task))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t next_victim()
+    {
+        // xorshift, per thread so stealing stays contention free
+        static thread_local uint32_t s_state = 2463534242u ^ static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        s_state ^= s_state << 13;
+        s_state ^= s_state >> 17;
+        s_state ^= s_state << 5;
+        return s_state % m_workers.size();
+    }
+
+    void wake_sleepers()
+    {
+        m_wakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_seq_cst) > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_sleepCondition.notify_all();
+        }
+    }
+
+    void run_worker(size_t index)
+    {
+        thread_context& context = this_thread_context();
+        context.pool = this;
+        context.index = static_cast<int>(index);
+
+        unsigned idleSpins = 0;
+        while (!m_stop.load(std::memory_order_relaxed))
+        {
+            const uint64_t epoch = m_wakeEpoch.load(std::memory_order_seq_cst);
+
+            pool_task* task = nullptr;
+            if (find_task(context.index, task))
+            {
+                task->execute();
+                idleSpins = 0;
+                continue;
+            }
+
+            if (++idleSpins < 128)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+            m_sleepCondition.wait(lock, [this, epoch]() {
+                return m_stop.load() || m_wakeEpoch.load(std::memory_order_seq_cst) != epoch;
+            });
+            m_sleepers.fetch_sub(1, std::memory_order_seq_cst);
+            idleSpins = 0;
+        }
+    }
+
+    std::vector<std::unique_ptr<worker>> m_workers;
+
+    std::mutex m_injectionMutex;
+    std::deque<pool_task*> m_injection;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+    std::atomic<uint64_t> m_wakeEpoch{0};
+    std::atomic<int> m_sleepers{0};
+    std::atomic<bool> m_stop{false};
+};
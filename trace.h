@@ -0,0 +1,342 @@
+/*
+Hot path tracing:
+
+  void transcode(...)
+  {
+      TRACE_SCOPE("transcode");
+      ...
+  }
+
+  trace::collector collector("trace.json"); // events are only recorded while a collector is alive
+
+A span reads the timestamp counter twice (rdtsc, CLOCK_MONOTONIC_COARSE where there is no tsc) and pushes
+{tag, begin, end} into a per-thread single producer/single consumer ring, no locks, no allocations and no strings are
+built on the hot path. Tags have to be string literals (consteval), only their pointer is stored.
+A background thread drains the rings into a Chrome trace-event file (chrome://tracing, https://ui.perfetto.dev).
+When a ring is full the event is dropped and counted instead of blocking the traced thread.
+
+Define TRACE_DISABLED to compile every TRACE_SCOPE out, TRACE_COARSE_CLOCK to use CLOCK_MONOTONIC_COARSE even with a tsc
+(cheaper on VMs trapping rdtsc, but only has the resolution of the kernel tick).
+
+https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(TRACE_COARSE_CLOCK)
+#define TRACE_USE_TSC 1
+#include <x86intrin.h>
+#else
+#define TRACE_USE_TSC 0
+#include <time.h>
+#endif
+
+namespace trace
+{
+
+///Compile-time tag, a string literal whose address identifies the span
+struct tag
+{
+    const char* name;
+
+    consteval tag(const char* i_name) : name(i_name) {}
+};
+
+struct event
+{
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///@return raw ticks, tsc cycles or nanoseconds depending on the platform
+inline uint64_t now()
+{
+#if TRACE_USE_TSC
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+#endif
+}
+
+///@return ticks per microsecond, measured against steady_clock once (tsc frequency isn't exposed by the cpu)
+inline double ticks_per_microsecond()
+{
+#if TRACE_USE_TSC
+    static const double s_ticksPerUs = []() {
+        const auto t0 = std::chrono::steady_clock::now();
+        const uint64_t tick0 = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const auto t1 = std::chrono::steady_clock::now();
+        const uint64_t tick1 = now();
+        return double(tick1 - tick0) / std::chrono::duration<double, std::micro>(t1 - t0).count();
+    }();
+    return s_ticksPerUs;
+#else
+    return 1000.0;
+#endif
+}
+
+inline std::atomic<bool>& enabled_flag()
+{
+    static std::atomic<bool> s_isEnabled{false};
+    return s_isEnabled;
+}
+
+///Single producer (the traced thread) / single consumer (the collector) ring of events
+class ring_buffer
+{
+public:
+    static constexpr size_t k_capacity = 1 << 14;
+
+public:
+    explicit ring_buffer(uint32_t threadId) : m_threadId(threadId) {}
+
+    void push(const event& e)
+    {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cachedTail >= k_capacity)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail >= k_capacity)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        m_events[head & (k_capacity - 1)] = e;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    ///@return number of events passed to f
+    template<typename F>
+    size_t drain(F&& f)
+    {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        const size_t count = static_cast<size_t>(head - tail);
+        for (; tail != head; ++tail)
+        {
+            f(m_events[tail & (k_capacity - 1)]);
+        }
+        m_tail.store(tail, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed); }
+    uint32_t thread_id() const { return m_threadId; }
+    ///@return events dropped since the last call
+    uint64_t take_dropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    uint64_t m_cachedTail = 0; // producer side copy of m_tail, refreshed only when the ring looks full
+    std::atomic<uint64_t> m_dropped{0};
+    alignas(64) std::atomic<uint64_t> m_tail{0};
+    uint32_t m_threadId;
+    event m_events[k_capacity];
+};
+
+///Owns every thread's ring, they outlive their thread until the collector drained them
+class registry
+{
+public:
+    static registry& instance()
+    {
+        static registry s_registry;
+        return s_registry;
+    }
+
+    std::shared_ptr<ring_buffer> register_thread()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_buffers.push_back(std::make_shared<ring_buffer>(m_nextThreadId++));
+        return m_buffers.back();
+    }
+
+    ///Calls f on every ring and forgets the ones whose thread is gone and that are empty
+    template<typename F>
+    void for_each(F&& f)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::shared_ptr<ring_buffer>& buffer : m_buffers)
+        {
+            f(*buffer);
+        }
+        m_buffers.erase(std::remove_if(std::begin(m_buffers), std::end(m_buffers), [](const std::shared_ptr<ring_buffer>& buffer) {
+            return buffer.use_count() == 1 && buffer->empty();
+        }), std::end(m_buffers));
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<ring_buffer>> m_buffers;
+    uint32_t m_nextThreadId = 1;
+};
+
+inline ring_buffer& local_buffer()
+{
+    // the raw pointer is a trivial thread_local (no init guard on the hot path), the shared_ptr tells the registry
+    // when the thread is gone
+    static thread_local ring_buffer* s_buffer = nullptr;
+    if (s_buffer == nullptr)
+    {
+        static thread_local std::shared_ptr<ring_buffer> s_owner = registry::instance().register_thread();
+        s_buffer = s_owner.get();
+    }
+    return *s_buffer;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+inline bool is_enabled() { return detail::enabled_flag().load(std::memory_order_relaxed); }
+
+///Records [construction, destruction) as a complete event
+class scope
+{
+public:
+    explicit scope(tag i_tag)
+        : m_name(i_tag.name)
+        , m_begin(is_enabled() ? detail::now() : 0)
+    {}
+    ~scope()
+    {
+        if (m_begin != 0)
+        {
+            detail::local_buffer().push(event{m_name, m_begin, detail::now()});
+        }
+    }
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_begin;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///Enables tracing while alive and streams the events into a Chrome trace-event JSON file. Only one at a time.
+class collector
+{
+public:
+    explicit collector(const std::string& path, std::chrono::milliseconds period = std::chrono::milliseconds(50))
+        : m_file(path, std::ios::trunc)
+        , m_period(period)
+        , m_ticksPerUs(detail::ticks_per_microsecond())
+        , m_baseTick(detail::now())
+    {
+        if (!m_file)
+        {
+            std::cerr << "cannot open trace file " << path << std::endl;
+            return;
+        }
+        m_file << std::fixed;
+        m_file.precision(3);
+        m_file << "{\"traceEvents\":[\n";
+        m_file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"trace\"}}";
+        detail::enabled_flag().store(true, std::memory_order_relaxed);
+        m_thread = std::thread([this]() { run(); });
+    }
+    ~collector() { stop(); }
+    collector(const collector&) = delete;
+    collector& operator=(const collector&) = delete;
+
+    bool is_open() const { return m_thread.joinable(); }
+
+    ///Disables tracing, drains what is left and closes the file
+    void stop()
+    {
+        if (!m_thread.joinable())
+        {
+            return;
+        }
+        detail::enabled_flag().store(false, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_isStopped = true;
+        }
+        m_wakeUp.notify_one();
+        m_thread.join();
+
+        drain();
+        m_file << "\n],\"otherData\":{\"dropped\":" << m_dropped << "}}\n";
+        m_file.close();
+        if (m_dropped > 0)
+        {
+            std::cerr << "trace: " << m_dropped << " events dropped, the collector period is too long" << std::endl;
+        }
+    }
+
+    size_t event_count() const { return m_eventCount; }
+    uint64_t dropped_count() const { return m_dropped; }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_isStopped)
+        {
+            m_wakeUp.wait_for(lock, m_period, [this]() { return m_isStopped; });
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+    }
+
+    void drain()
+    {
+        detail::registry::instance().for_each([this](detail::ring_buffer& buffer) {
+            const uint32_t threadId = buffer.thread_id();
+            m_eventCount += buffer.drain([this, threadId](const event& e) {
+                const double ts = e.begin > m_baseTick ? double(e.begin - m_baseTick) / m_ticksPerUs : 0.0;
+                const double dur = double(e.end - e.begin) / m_ticksPerUs;
+                m_file << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+                    << ",\"ts\":" << ts << ",\"dur\":" << dur << "}";
+            });
+            m_dropped += buffer.take_dropped();
+        });
+    }
+
+    std::ofstream m_file;
+    std::chrono::milliseconds m_period;
+    double m_ticksPerUs;
+    uint64_t m_baseTick;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    bool m_isStopped = false;
+
+    size_t m_eventCount = 0;
+    uint64_t m_dropped = 0;
+};
+
+}//trace
+
+#if defined(TRACE_DISABLED)
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) trace::scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#endif
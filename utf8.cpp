@@ -10,7 +10,23 @@ https://www.branah.com/unicode-converter
 #include <iostream>
 #include <vector>
 #include <bitset>
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <optional>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "async_io.h"
+#include "benchmark.h"
+#include "generator.h"
+#include "trace.h"
 
  
 namespace detail
@@ -221,6 +237,7 @@ bool encode_utf8(const uint32_t codePoint, std::string& output) {
 
 
 bool encode_utf32_to_utf8(const std::vector<uint32_t>& src, std::string& output) {
+    TRACE_SCOPE("encode_utf32_to_utf8");
     output.reserve(src.size());
 
     bool isValid = true;
@@ -238,6 +255,7 @@ bool encode_utf32_to_utf8(const std::vector<uint32_t>& src, std::string& output)
 
 
 bool encode_utf8_to_utf32(const char *src, std::vector<uint32_t>& dst) {
+    TRACE_SCOPE("encode_utf8_to_utf32");
     const uint8_t* srcPtr = (uint8_t*)src;
 
     while (*srcPtr != 0) {
@@ -252,10 +270,472 @@ bool encode_utf8_to_utf32(const char *src, std::vector<uint32_t>& dst) {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+// streaming a big corpus from disk through encode_utf8_to_utf32, k_streamDepth blocks in flight
+
+constexpr size_t k_streamBlock = size_t(1) << 20;
+constexpr size_t k_streamDepth = 4;
+constexpr size_t k_streamSlot = 4 + k_streamBlock + 4; // room for the carried bytes in front and the terminator behind
+
+///Block of whole copies of a multilingual sample, so the file ends on a complete codepoint
+std::string make_corpus_block()
+{
+    const std::string sample = "𤭢€¢$ Μπορώ να φάω σπασμένα γυαλιά χωρίς να πάθω τίποτα. kācaṃ śaknomyattum; ᛖᚴ ᚷᛖᛏ ᛖᛏᛁ ᚧ ᚷᛚᛖᚱ. Ich kann Glas essen.\n";
+    std::string block;
+    while (block.size() + sample.size() <= k_streamBlock)
+    {
+        block += sample;
+    }
+    return block;
+}
+
+coro::task<bool> write_corpus(coro::io_loop& loop, int fd, uint64_t i_blockCount)
+{
+    const std::string block = make_corpus_block();
+    std::optional<coro::io_operation> writes[k_streamDepth];
+    bool isOk = true;
+    for (uint64_t i = 0; i < i_blockCount + k_streamDepth; ++i)
+    {
+        std::optional<coro::io_operation>& slot = writes[i % k_streamDepth];
+        if (slot)
+        {
+            isOk &= co_await *slot == static_cast<ssize_t>(block.size());
+            slot.reset();
+        }
+        if (i < i_blockCount)
+        {
+            slot.emplace(loop, coro::io_operation::kind::write, fd, const_cast<char*>(block.data()), block.size(), i * block.size());
+        }
+    }
+    co_return isOk;
+}
+
+///Transcodes the complete codepoints of [i_data, i_data + i_size), moves the trailing partial one to o_carry.
+///i_data[i_size] has to be writable (terminator).
+size_t transcode_block(char* i_data, size_t i_size, std::string& o_carry, std::vector<uint32_t>& o_scratch)
+{
+    size_t complete = i_size;
+    for (size_t back = 1; back <= 4 && back <= i_size; ++back)
+    {
+        const uint8_t c = static_cast<uint8_t>(i_data[i_size - back]);
+        if ((c & 0b11000000) != 0b10000000)
+        {// lead byte, keep it if its sequence is cut
+            if (detail::peek_utf8(reinterpret_cast<const uint8_t*>(i_data + i_size - back)) > back)
+            {
+                complete = i_size - back;
+            }
+            break;
+        }
+    }
+    o_carry.assign(i_data + complete, i_size - complete);
+    i_data[complete] = 0;
+
+    o_scratch.clear();
+    encode_utf8_to_utf32(i_data, o_scratch);
+    return o_scratch.size();
+}
+
+///Prepends the carry of the previous block in the 4 bytes reserved in front of the slot
+char* prepend_carry(char* i_slot, const std::string& i_carry)
+{
+    char* begin = i_slot + 4 - i_carry.size();
+    std::memcpy(begin, i_carry.data(), i_carry.size());
+    return begin;
+}
+
+coro::task<uint64_t> stream_utf8(coro::io_loop& loop, int fd, uint64_t i_fileSize, char* i_slots, bool i_useFixedBuffers)
+{
+    std::optional<coro::io_operation> reads[k_streamDepth];
+    size_t sizes[k_streamDepth] = {};
+    uint64_t nextOffset = 0;
+    auto issue = [&](size_t slot) {
+        if (nextOffset < i_fileSize)
+        {
+            sizes[slot] = static_cast<size_t>(std::min<uint64_t>(k_streamBlock, i_fileSize - nextOffset));
+            const int fixedBuffer = i_useFixedBuffers ? static_cast<int>(slot) : -1;
+            reads[slot].emplace(loop, coro::io_operation::kind::read, fd, i_slots + slot * k_streamSlot + 4, sizes[slot], nextOffset, fixedBuffer);
+            nextOffset += sizes[slot];
+        }
+    };
+    for (size_t slot = 0; slot < k_streamDepth; ++slot)
+    {
+        issue(slot);
+    }
+
+    std::string carry;
+    std::vector<uint32_t> scratch;
+    uint64_t codepoints = 0;
+    for (size_t slot = 0; reads[slot]; slot = (slot + 1) % k_streamDepth)
+    {
+        const ssize_t bytes = co_await *reads[slot];
+        reads[slot].reset();
+        if (bytes != static_cast<ssize_t>(sizes[slot]))
+        {
+            std::cerr << "stream read failed: " << (bytes < 0 ? std::strerror(static_cast<int>(-bytes)) : "short read") << std::endl;
+            for (std::optional<coro::io_operation>& pending : reads)
+            {// let the other reads land before their buffers go away
+                if (pending)
+                {
+                    co_await *pending;
+                }
+            }
+            co_return codepoints;
+        }
+        char* begin = prepend_carry(i_slots + slot * k_streamSlot, carry);
+        codepoints += transcode_block(begin, i_slots + slot * k_streamSlot + 4 + bytes - begin, carry, scratch);
+        issue(slot);
+    }
+    co_return codepoints;
+}
+
+uint64_t stream_utf8_blocking(int fd, char* i_slot)
+{
+    std::string carry;
+    std::vector<uint32_t> scratch;
+    uint64_t codepoints = 0;
+    ssize_t bytes;
+    while ((bytes = read(fd, i_slot + 4, k_streamBlock)) > 0)
+    {
+        char* begin = prepend_carry(i_slot, carry);
+        codepoints += transcode_block(begin, i_slot + 4 + bytes - begin, carry, scratch);
+    }
+    return codepoints;
+}
+
+///utf8 --stream [MB=4096] [PATH]: writes a MB sized corpus (kept for the next runs) and streams it from a cold page cache
+///with read(), io_uring with registered buffers and the pread thread pool
+int stream_benchmark(uint64_t i_megaBytes, const std::string& i_path)
+{
+    const uint64_t blockCount = std::max<uint64_t>(1, i_megaBytes * (size_t(1) << 20) / make_corpus_block().size());
+    const uint64_t fileSize = blockCount * make_corpus_block().size();
+
+    std::error_code error;
+    if (std::filesystem::file_size(i_path, error) != fileSize)
+    {
+        const int fd = open(i_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd < 0)
+        {
+            std::cerr << "cannot create " << i_path << ": " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        coro::io_loop loop(2 * k_streamDepth);
+        const auto start = std::chrono::steady_clock::now();
+        const bool isWritten = loop.run(write_corpus(loop, fd, blockCount));
+        fsync(fd);
+        close(fd);
+        std::cout << "wrote " << fileSize / (1 << 20) << "MB corpus with " << loop.backend_name() << " in "
+            << bench::format_duration(std::chrono::steady_clock::now() - start) << std::endl;
+        if (!isWritten)
+        {
+            std::cerr << "corpus write failed" << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<char> slots(k_streamDepth * k_streamSlot);
+    bench::runner runner;
+    bench::settings setup;
+    setup.warmup = 0;
+    setup.samples = 3;
+    setup.bytes = fileSize;
+
+    uint64_t expected = 0;
+    auto open_cold = [&]() {
+        const int fd = open(i_path.c_str(), O_RDONLY);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        return fd;
+    };
+
+    runner.run("read() + transcode", setup, [&]() {
+        const int fd = open_cold();
+        expected = stream_utf8_blocking(fd, slots.data());
+        close(fd);
+    });
+
+    for (const coro::io_loop::backend backend : {coro::io_loop::backend::io_uring, coro::io_loop::backend::thread_pool})
+    {
+        coro::io_loop loop(2 * k_streamDepth, backend);
+        std::vector<iovec> buffers(k_streamDepth);
+        for (size_t slot = 0; slot < k_streamDepth; ++slot)
+        {
+            buffers[slot].iov_base = slots.data() + slot * k_streamSlot;
+            buffers[slot].iov_len = k_streamSlot;
+        }
+        const bool useFixedBuffers = loop.register_buffers(buffers);
+
+        uint64_t codepoints = 0;
+        runner.run(std::string(loop.backend_name()) + " + transcode", setup, [&]() {
+            const int fd = open_cold();
+            codepoints = loop.run(stream_utf8(loop, fd, fileSize, slots.data(), useFixedBuffers));
+            close(fd);
+        });
+        std::cout << loop.backend_name() << ": " << codepoints << " codepoints" << (codepoints == expected ? "" : " (MISMATCH)") << std::endl;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// word histogram: decode -> tokenize -> map -> reduce, materialized or streamed in batches
+
+constexpr size_t k_pipelineBatch = size_t(64) << 10;
+constexpr size_t k_wordBuckets = 4096;
+
+struct token
+{
+    uint64_t hash;
+    uint32_t length;
+};
+
+///Splits codepoints on whitespace and ASCII punctuation, a word can span two batches
+class tokenizer
+{
+public:
+    void feed(const std::vector<uint32_t>& i_codepoints, std::vector<token>& o_tokens)
+    {
+        for (const uint32_t c : i_codepoints)
+        {
+            if (c < 0x80 && !std::isalnum(static_cast<int>(c)))
+            {
+                flush(o_tokens);
+            }
+            else
+            {
+                m_hash = (m_hash ^ c) * 0x100000001b3ull;
+                ++m_length;
+            }
+        }
+    }
+
+    void flush(std::vector<token>& o_tokens)
+    {
+        if (m_length != 0)
+        {
+            o_tokens.push_back({m_hash, m_length});
+        }
+        m_hash = 0xcbf29ce484222325ull;
+        m_length = 0;
+    }
+
+private:
+    uint64_t m_hash = 0xcbf29ce484222325ull;
+    uint32_t m_length = 0;
+};
+
+void map_tokens(const std::vector<token>& i_tokens, std::vector<uint32_t>& o_buckets)
+{
+    for (const token& word : i_tokens)
+    {
+        o_buckets.push_back(static_cast<uint32_t>((word.hash ^ (word.hash >> 29)) % k_wordBuckets));
+    }
+}
+
+void reduce_buckets(const std::vector<uint32_t>& i_buckets, std::vector<uint64_t>& io_histogram)
+{
+    for (const uint32_t bucket : i_buckets)
+    {
+        ++io_histogram[bucket];
+    }
+}
+
+///Largest intermediate buffers seen by each stage
+struct pipeline_memory
+{
+    size_t codepoints = 0;
+    size_t tokens = 0;
+    size_t buckets = 0;
+
+    template<typename T>
+    static void note(size_t& o_peak, const std::vector<T>& i_buffer) { o_peak = std::max(o_peak, i_buffer.capacity() * sizeof(T)); }
+    size_t total() const { return codepoints + tokens + buckets; }
+};
+
+std::vector<uint64_t> histogram_materialized(const std::string& i_text, pipeline_memory& o_memory)
+{
+    std::vector<uint32_t> codepoints;
+    encode_utf8_to_utf32(i_text.c_str(), codepoints);
+
+    std::vector<token> tokens;
+    tokenizer words;
+    words.feed(codepoints, tokens);
+    words.flush(tokens);
+
+    std::vector<uint32_t> buckets;
+    map_tokens(tokens, buckets);
+
+    std::vector<uint64_t> histogram(k_wordBuckets);
+    reduce_buckets(buckets, histogram);
+
+    pipeline_memory::note(o_memory.codepoints, codepoints);
+    pipeline_memory::note(o_memory.tokens, tokens);
+    pipeline_memory::note(o_memory.buckets, buckets);
+    return histogram;
+}
+
+coro::generator<std::vector<uint32_t>> decode_stage(const std::string& i_text, pipeline_memory& o_memory)
+{
+    std::vector<char> slot(4 + k_pipelineBatch + 4);
+    std::string carry;
+    std::vector<uint32_t> codepoints;
+    for (size_t offset = 0; offset < i_text.size(); offset += k_pipelineBatch)
+    {
+        const size_t size = std::min(k_pipelineBatch, i_text.size() - offset);
+        std::memcpy(slot.data() + 4, i_text.data() + offset, size);
+        char* begin = prepend_carry(slot.data(), carry);
+        transcode_block(begin, slot.data() + 4 + size - begin, carry, codepoints);
+        pipeline_memory::note(o_memory.codepoints, codepoints);
+        co_yield codepoints;
+    }
+}
+
+coro::generator<std::vector<token>> tokenize_stage(coro::generator<std::vector<uint32_t>> input, pipeline_memory& o_memory)
+{
+    tokenizer words;
+    std::vector<token> tokens;
+    for (const std::vector<uint32_t>& codepoints : input)
+    {
+        tokens.clear();
+        words.feed(codepoints, tokens);
+        pipeline_memory::note(o_memory.tokens, tokens);
+        co_yield tokens;
+    }
+    tokens.clear();
+    words.flush(tokens);
+    co_yield tokens;
+}
+
+coro::generator<std::vector<uint32_t>> map_stage(coro::generator<std::vector<token>> input, pipeline_memory& o_memory)
+{
+    std::vector<uint32_t> buckets;
+    for (const std::vector<token>& tokens : input)
+    {
+        buckets.clear();
+        map_tokens(tokens, buckets);
+        pipeline_memory::note(o_memory.buckets, buckets);
+        co_yield buckets;
+    }
+}
+
+std::vector<uint64_t> histogram_generators(const std::string& i_text, pipeline_memory& o_memory)
+{
+    std::vector<uint64_t> histogram(k_wordBuckets);
+    for (const std::vector<uint32_t>& buckets : map_stage(tokenize_stage(decode_stage(i_text, o_memory), o_memory), o_memory))
+    {
+        reduce_buckets(buckets, histogram);
+    }
+    return histogram;
+}
+
+// same stages as async generators, the reduce is the task driving them
+coro::async_generator<std::vector<uint32_t>> async_decode_stage(const std::string& i_text)
+{
+    std::vector<char> slot(4 + k_pipelineBatch + 4);
+    std::string carry;
+    std::vector<uint32_t> codepoints;
+    for (size_t offset = 0; offset < i_text.size(); offset += k_pipelineBatch)
+    {
+        const size_t size = std::min(k_pipelineBatch, i_text.size() - offset);
+        std::memcpy(slot.data() + 4, i_text.data() + offset, size);
+        char* begin = prepend_carry(slot.data(), carry);
+        transcode_block(begin, slot.data() + 4 + size - begin, carry, codepoints);
+        co_yield codepoints;
+    }
+}
+
+coro::async_generator<std::vector<token>> async_tokenize_stage(coro::async_generator<std::vector<uint32_t>> input)
+{
+    tokenizer words;
+    std::vector<token> tokens;
+    while (const std::vector<uint32_t>* codepoints = co_await input.next())
+    {
+        tokens.clear();
+        words.feed(*codepoints, tokens);
+        co_yield tokens;
+    }
+    tokens.clear();
+    words.flush(tokens);
+    co_yield tokens;
+}
+
+coro::async_generator<std::vector<uint32_t>> async_map_stage(coro::async_generator<std::vector<token>> input)
+{
+    std::vector<uint32_t> buckets;
+    while (const std::vector<token>* tokens = co_await input.next())
+    {
+        buckets.clear();
+        map_tokens(*tokens, buckets);
+        co_yield buckets;
+    }
+}
+
+coro::task<std::vector<uint64_t>> async_reduce_stage(coro::async_generator<std::vector<uint32_t>> input)
+{
+    std::vector<uint64_t> histogram(k_wordBuckets);
+    while (const std::vector<uint32_t>* buckets = co_await input.next())
+    {
+        reduce_buckets(*buckets, histogram);
+    }
+    co_return histogram;
+}
+
+///utf8 --pipeline [MB=256]: word histogram of an in memory corpus, vectors between the stages against 64KB batches
+///pulled through generators
+int pipeline_benchmark(uint64_t i_megaBytes)
+{
+    const std::string block = make_corpus_block();
+    std::string text;
+    text.reserve(i_megaBytes << 20);
+    while (text.size() + block.size() <= (i_megaBytes << 20) || text.empty())
+    {
+        text += block;
+    }
+
+    bench::runner runner;
+    bench::settings setup;
+    setup.warmup = 1;
+    setup.samples = 5;
+    setup.bytes = text.size();
+
+    pipeline_memory materializedMemory;
+    pipeline_memory generatorMemory;
+    std::vector<uint64_t> materialized;
+    std::vector<uint64_t> generated;
+    std::vector<uint64_t> asyncGenerated;
+
+    runner.run("materialized stages", setup, [&]() { materialized = histogram_materialized(text, materializedMemory); });
+    runner.run("generator stages", setup, [&]() { generated = histogram_generators(text, generatorMemory); });
+    runner.run("async_generator stages", setup, [&]() {
+        asyncGenerated = coro::sync_wait(async_reduce_stage(async_map_stage(async_tokenize_stage(async_decode_stage(text)))));
+    });
+
+    std::cout << "intermediate buffers: materialized " << materializedMemory.total() / 1024 << "KB, generators "
+        << generatorMemory.total() / 1024 << "KB" << std::endl;
+    const bool isSame = materialized == generated && materialized == asyncGenerated;
+    std::cout << "histograms " << (isSame ? "match" : "DIFFER") << ", "
+        << std::accumulate(materialized.begin(), materialized.end(), uint64_t(0)) << " words" << std::endl;
+    return isSame ? 0 : -1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
 int main(int argc, char **argv) {
+    // utf8 --trace PATH writes the transcoding spans as a chrome trace
+    std::unique_ptr<trace::collector> traceCollector;
+    if (argc > 2 && std::string(argv[1]) == "--trace")
+    {
+        traceCollector.reset(new trace::collector(argv[2]));
+    }
+    if (argc > 1 && std::string(argv[1]) == "--stream")
+    {
+        const uint64_t megaBytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4096;
+        const std::string path = argc > 3 ? argv[3] : (std::filesystem::temp_directory_path() / "utf8_corpus.txt").string();
+        return stream_benchmark(megaBytes, path);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--pipeline")
+    {
+        return pipeline_benchmark(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 256);
+    }
+
     if (1)
     {// simple multi-byte test
         std::string temp = "𤭢€¢$"; //4,3,2,1bytes
@@ -0,0 +1,523 @@
+/*
+Small float vectors for geometry code and the batch kernels that run over arrays of them.
+
+vec2/vec3/vec4 are packed aggregates (no padding, trivially copyable, vec4 16 byte aligned) with the usual
+arithmetic. The vector_space concept is what the generic code asks for, packed_vector adds the layout guarantees the
+batch kernels rely on:
+
+  template<vector_space V> typename V::value_type length(const V& v);
+
+Arrays come in two layouts:
+  - AoS, a V* (std::vector<vec3>): x y z x y z ... Batch kernels run element by element, the compiler can't do much
+    more than one vector per iteration (the components are interleaved).
+  - SoA, vec_soa<V>: one array per component. Batch kernels load 8 (avx2) or 16 (avx512) x, then y, ... and process
+    that many vectors per instruction, same runtime dispatch as simd_reduce.h.
+
+dot and length add the components in order with no FMA, so both layouts and every ISA give the same bits. normalize
+multiplies by simd_sqrt.h's rsqrt estimate + Newton step on avx2/avx512 (a few ULP off 1 / length), both divide
+instead when the squared length is denormal (rsqrtps gives inf there, the Newton step loses bits), zero vectors stay
+zero.
+*/
+#pragma once
+
+#include "simd_sqrt.h"
+
+#include <array>
+#include <cfloat> // FLT_MIN
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// same bits on every ISA needs a*b+c to stay two roundings (avx512f implies FMA)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+template <typename T>
+concept equality_comparable = requires (T obj) {
+  { obj == obj } -> std::same_as<bool>;
+  { obj != obj } -> std::same_as<bool>;
+};
+
+///Vectors with component access, addition and scaling, and a dot product found by ADL
+template<typename V>
+concept vector_space = equality_comparable<V> && std::floating_point<typename V::value_type>
+    && requires (V a, V b, typename V::value_type s, size_t i) {
+        { V::dimension } -> std::convertible_to<size_t>;
+        { a[i] } -> std::convertible_to<typename V::value_type>;
+        { a + b } -> std::same_as<V>;
+        { a - b } -> std::same_as<V>;
+        { a * s } -> std::same_as<V>;
+        { dot(a, b) } -> std::same_as<typename V::value_type>;
+    };
+
+///Components stored back to back and nothing else, arrays of V can be read as arrays of value_type
+template<typename V>
+concept packed_vector = vector_space<V> && std::is_trivially_copyable_v<V>
+    && sizeof(V) == V::dimension * sizeof(typename V::value_type);
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///What the component wise operators below need, opted in with a static dimension
+template<typename V>
+concept vec_components = requires (V v, const V c, size_t i) {
+    typename V::value_type;
+    { V::dimension } -> std::convertible_to<size_t>;
+    { v[i] } -> std::same_as<typename V::value_type&>;
+    { c[i] } -> std::convertible_to<typename V::value_type>;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+template<detail::vec_components V>
+bool operator==(const V& lhs, const V& rhs)
+{
+    for (size_t i = 0; i < V::dimension; ++i)
+    {
+        if (lhs[i] != rhs[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<detail::vec_components V>
+V operator+(V lhs, const V& rhs)
+{
+    for (size_t i = 0; i < V::dimension; ++i)
+    {
+        lhs[i] += rhs[i];
+    }
+    return lhs;
+}
+
+template<detail::vec_components V>
+V operator-(V lhs, const V& rhs)
+{
+    for (size_t i = 0; i < V::dimension; ++i)
+    {
+        lhs[i] -= rhs[i];
+    }
+    return lhs;
+}
+
+template<detail::vec_components V>
+V operator*(V lhs, typename V::value_type s)
+{
+    for (size_t i = 0; i < V::dimension; ++i)
+    {
+        lhs[i] *= s;
+    }
+    return lhs;
+}
+
+template<detail::vec_components V>
+V operator*(typename V::value_type s, const V& rhs)
+{
+    return rhs * s;
+}
+
+template<detail::vec_components V>
+typename V::value_type dot(const V& lhs, const V& rhs)
+{
+    typename V::value_type sum = 0;
+    for (size_t i = 0; i < V::dimension; ++i)
+    {
+        sum += lhs[i] * rhs[i];
+    }
+    return sum;
+}
+
+struct vec2
+{
+    using value_type = float;
+    static constexpr size_t dimension = 2;
+
+    float x, y;
+
+    float& operator[](size_t i) { return i == 0 ? x : y; }
+    float operator[](size_t i) const { return i == 0 ? x : y; }
+
+    // operator!= not needed in C++20 due to operator rewrite rules!
+};
+
+struct vec3
+{
+    using value_type = float;
+    static constexpr size_t dimension = 3;
+
+    float x, y, z;
+
+    float& operator[](size_t i) { return i == 0 ? x : i == 1 ? y : z; }
+    float operator[](size_t i) const { return i == 0 ? x : i == 1 ? y : z; }
+};
+
+struct alignas(16) vec4
+{
+    using value_type = float;
+    static constexpr size_t dimension = 4;
+
+    float x, y, z, w;
+
+    float& operator[](size_t i) { return i == 0 ? x : i == 1 ? y : i == 2 ? z : w; }
+    float operator[](size_t i) const { return i == 0 ? x : i == 1 ? y : i == 2 ? z : w; }
+};
+
+static_assert(packed_vector<vec2> && packed_vector<vec3> && packed_vector<vec4>);
+
+template<vector_space V>
+typename V::value_type length(const V& v)
+{
+    return std::sqrt(dot(v, v));
+}
+
+///v / length(v), zero stays zero
+template<vector_space V>
+V normalize(const V& v)
+{
+    const typename V::value_type squared = dot(v, v);
+    return squared > 0 ? v * (1 / std::sqrt(squared)) : v;
+}
+
+///One contiguous array per component
+template<packed_vector V>
+class vec_soa
+{
+public:
+    using value_type = typename V::value_type;
+    static constexpr size_t dimension = V::dimension;
+
+    vec_soa() = default;
+    explicit vec_soa(size_t count)
+    {
+        resize(count);
+    }
+    explicit vec_soa(const std::vector<V>& aos)
+    {
+        resize(aos.size());
+        for (size_t i = 0; i < aos.size(); ++i)
+        {
+            set(i, aos[i]);
+        }
+    }
+
+    size_t size() const { return m_components[0].size(); }
+    void resize(size_t count)
+    {
+        for (std::vector<value_type>& component : m_components)
+        {
+            component.resize(count);
+        }
+    }
+
+    V get(size_t i) const
+    {
+        V v;
+        for (size_t c = 0; c < dimension; ++c)
+        {
+            v[c] = m_components[c][i];
+        }
+        return v;
+    }
+    void set(size_t i, const V& v)
+    {
+        for (size_t c = 0; c < dimension; ++c)
+        {
+            m_components[c][i] = v[c];
+        }
+    }
+
+    value_type* component(size_t c) { return m_components[c].data(); }
+    const value_type* component(size_t c) const { return m_components[c].data(); }
+
+private:
+    std::array<std::vector<value_type>, dimension> m_components;
+};
+
+namespace detail
+{
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///SoA kernels over Dimension component arrays
+struct vec_scalar
+{
+    template<size_t Dimension>
+    static void dot(const float* const* a, const float* const* b, size_t count, float* out)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            float sum = 0.f;
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                sum += a[c][i] * b[c][i];
+            }
+            out[i] = sum;
+        }
+    }
+    template<size_t Dimension>
+    static void length(const float* const* a, size_t count, float* out)
+    {
+        dot<Dimension>(a, a, count, out);
+        simd::sqrt(out, count, out);
+    }
+    template<size_t Dimension>
+    static void normalize(float* const* a, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            float squared = 0.f;
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                squared += a[c][i] * a[c][i];
+            }
+            const float scale = squared > 0.f ? 1.f / simd::sqrt(squared) : 1.f;
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                a[c][i] *= scale;
+            }
+        }
+    }
+};
+
+#if SIMD_REDUCE_X86
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2, 8 vectors per iteration
+
+#define VEC_AVX2 __attribute__((target("avx2")))
+
+struct vec_avx2
+{
+    template<size_t Dimension>
+    VEC_AVX2 static __m256 dot8(const float* const* a, const float* const* b, size_t i)
+    {
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(a[0] + i), _mm256_loadu_ps(b[0] + i));
+        for (size_t c = 1; c < Dimension; ++c)
+        {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a[c] + i), _mm256_loadu_ps(b[c] + i)));
+        }
+        return sum;
+    }
+
+    template<size_t Dimension>
+    VEC_AVX2 static void dot(const float* const* a, const float* const* b, size_t count, float* out)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(out + i, dot8<Dimension>(a, b, i));
+        }
+        const float* tailA[Dimension];
+        const float* tailB[Dimension];
+        for (size_t c = 0; c < Dimension; ++c)
+        {
+            tailA[c] = a[c] + i;
+            tailB[c] = b[c] + i;
+        }
+        vec_scalar::dot<Dimension>(tailA, tailB, count - i, out + i);
+    }
+
+    template<size_t Dimension>
+    VEC_AVX2 static void length(const float* const* a, size_t count, float* out)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(out + i, _mm256_sqrt_ps(dot8<Dimension>(a, a, i)));
+        }
+        const float* tail[Dimension];
+        for (size_t c = 0; c < Dimension; ++c)
+        {
+            tail[c] = a[c] + i;
+        }
+        vec_scalar::length<Dimension>(tail, count - i, out + i);
+    }
+
+    template<size_t Dimension>
+    VEC_AVX2 static void normalize(float* const* a, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 squared = dot8<Dimension>(a, a, i);
+            const __m256 estimate = simd::detail::sqrt_avx2::refine(squared, _mm256_rsqrt_ps(squared));
+            // rsqrtps flushes denormal squared lengths (lengths ~1e-22..1e-19) to inf, divide for those lanes
+            const __m256 isDenormal = _mm256_cmp_ps(squared, _mm256_set1_ps(FLT_MIN), _CMP_LT_OQ);
+            const __m256 inverse = _mm256_blendv_ps(estimate, _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(squared)), isDenormal);
+            // inf for zero vectors, scale by 1 there
+            const __m256 scale = _mm256_blendv_ps(_mm256_set1_ps(1.f), inverse, _mm256_cmp_ps(squared, _mm256_setzero_ps(), _CMP_GT_OQ));
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                _mm256_storeu_ps(a[c] + i, _mm256_mul_ps(_mm256_loadu_ps(a[c] + i), scale));
+            }
+        }
+        float* tail[Dimension];
+        for (size_t c = 0; c < Dimension; ++c)
+        {
+            tail[c] = a[c] + i;
+        }
+        vec_scalar::normalize<Dimension>(tail, count - i);
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX-512, 16 vectors per iteration, masked tails
+
+#define VEC_AVX512 __attribute__((target("avx512f")))
+
+struct vec_avx512
+{
+    template<size_t Dimension>
+    VEC_AVX512 static __m512 dot16(const float* const* a, const float* const* b, size_t i, __mmask16 mask)
+    {
+        __m512 sum = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a[0] + i), _mm512_maskz_loadu_ps(mask, b[0] + i));
+        for (size_t c = 1; c < Dimension; ++c)
+        {
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a[c] + i), _mm512_maskz_loadu_ps(mask, b[c] + i)));
+        }
+        return sum;
+    }
+
+    template<size_t Dimension>
+    VEC_AVX512 static void dot(const float* const* a, const float* const* b, size_t count, float* out)
+    {
+        for (size_t i = 0; i < count; i += 16)
+        {
+            const __mmask16 mask = count - i >= 16 ? __mmask16(0xFFFF) : simd::detail::sqrt_avx512::tail_mask(count - i);
+            _mm512_mask_storeu_ps(out + i, mask, dot16<Dimension>(a, b, i, mask));
+        }
+    }
+
+    template<size_t Dimension>
+    VEC_AVX512 static void length(const float* const* a, size_t count, float* out)
+    {
+        for (size_t i = 0; i < count; i += 16)
+        {
+            const __mmask16 mask = count - i >= 16 ? __mmask16(0xFFFF) : simd::detail::sqrt_avx512::tail_mask(count - i);
+            _mm512_mask_storeu_ps(out + i, mask, _mm512_sqrt_ps(dot16<Dimension>(a, a, i, mask)));
+        }
+    }
+
+    template<size_t Dimension>
+    VEC_AVX512 static void normalize(float* const* a, size_t count)
+    {
+        for (size_t i = 0; i < count; i += 16)
+        {
+            const __mmask16 mask = count - i >= 16 ? __mmask16(0xFFFF) : simd::detail::sqrt_avx512::tail_mask(count - i);
+            const __m512 squared = dot16<Dimension>(a, a, i, mask);
+            const __m512 estimate = simd::detail::sqrt_avx512::refine(squared, _mm512_rsqrt14_ps(squared));
+            // the Newton step loses bits on denormal squared lengths, divide there as the other paths do
+            const __mmask16 isDenormal = _mm512_cmp_ps_mask(squared, _mm512_set1_ps(FLT_MIN), _CMP_LT_OQ);
+            const __m512 inverse = _mm512_mask_div_ps(estimate, isDenormal, _mm512_set1_ps(1.f), _mm512_sqrt_ps(squared));
+            const __mmask16 isNonZero = _mm512_cmp_ps_mask(squared, _mm512_setzero_ps(), _CMP_GT_OQ);
+            const __m512 scale = _mm512_mask_blend_ps(isNonZero, _mm512_set1_ps(1.f), inverse);
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                _mm512_mask_storeu_ps(a[c] + i, mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a[c] + i), scale));
+            }
+        }
+    }
+};
+
+#undef VEC_AVX2
+#undef VEC_AVX512
+#endif // SIMD_REDUCE_X86
+
+#if SIMD_REDUCE_X86
+#define VEC_DISPATCH(f, ...) \
+    switch (simd::detail::isa_override()) \
+    { \
+        case simd::isa::avx512: return detail::vec_avx512::f(__VA_ARGS__); \
+        case simd::isa::avx2: return detail::vec_avx2::f(__VA_ARGS__); \
+        case simd::isa::scalar: break; \
+    } \
+    return detail::vec_scalar::f(__VA_ARGS__)
+#else
+#define VEC_DISPATCH(f, ...) return detail::vec_scalar::f(__VA_ARGS__)
+#endif
+
+template<size_t Dimension, typename Soa>
+std::array<const float*, Dimension> components(const Soa& soa)
+{
+    std::array<const float*, Dimension> pointers;
+    for (size_t c = 0; c < Dimension; ++c)
+    {
+        pointers[c] = soa.component(c);
+    }
+    return pointers;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+}//detail
+
+///out[i] = dot(a[i], b[i])
+template<packed_vector V>
+void dot(const V* a, const V* b, size_t count, float* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = dot(a[i], b[i]);
+    }
+}
+
+///out[i] = length(a[i])
+template<packed_vector V>
+void length(const V* a, size_t count, float* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = simd::sqrt(dot(a[i], a[i]));
+    }
+}
+
+///a[i] = normalize(a[i])
+template<packed_vector V>
+void normalize(V* a, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        a[i] = normalize(a[i]);
+    }
+}
+
+template<packed_vector V>
+void dot(const vec_soa<V>& a, const vec_soa<V>& b, float* out)
+{
+    const auto componentsA = detail::components<V::dimension>(a);
+    const auto componentsB = detail::components<V::dimension>(b);
+    VEC_DISPATCH(template dot<V::dimension>, componentsA.data(), componentsB.data(), a.size(), out);
+}
+
+template<packed_vector V>
+void length(const vec_soa<V>& a, float* out)
+{
+    const auto componentsA = detail::components<V::dimension>(a);
+    VEC_DISPATCH(template length<V::dimension>, componentsA.data(), a.size(), out);
+}
+
+template<packed_vector V>
+void normalize(vec_soa<V>& a)
+{
+    std::array<float*, V::dimension> componentsA;
+    for (size_t c = 0; c < V::dimension; ++c)
+    {
+        componentsA[c] = a.component(c);
+    }
+    VEC_DISPATCH(template normalize<V::dimension>, componentsA.data(), a.size());
+}
+
+#undef VEC_DISPATCH
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif